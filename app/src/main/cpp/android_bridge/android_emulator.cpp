@@ -14,20 +14,11 @@
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
 #define LOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 
-// Display constants
-constexpr int DISPLAY_WIDTH = 320;
-constexpr int DISPLAY_HEIGHT = 240;
-constexpr size_t FRAMEBUFFER_SIZE = DISPLAY_WIDTH * DISPLAY_HEIGHT * 2; // RGB565
-
 AndroidEmulator::AndroidEmulator()
     : paused_(false),
       currentFPS_(0.0f),
       frameCount_(0) {
     
-    // Pre-allocate buffers
-    framebuffer_.resize(FRAMEBUFFER_SIZE);
-    audioBuffer_.reserve(2048 * 2); // Reserve space for audio
-    
     lastFrameTime_ = Clock::now();
     fpsUpdateTime_ = lastFrameTime_;
 }
@@ -79,6 +70,9 @@ bool AndroidEmulator::initialize(
             timing
         );
         
+        // PPU writes RGB565 directly, so frames need no conversion pass
+        emulator_->SetPixelFormat(PixelFormat::RGB565);
+        
         LOGI("Emulator initialized successfully");
         return true;
         
@@ -96,25 +90,6 @@ void AndroidEmulator::runFrame() {
     // Run one frame of emulation
     emulator_->RunFrame();
     
-    // Get video output (RGB555 format)
-    auto picture = emulator_->GetPicture();
-    
-    // Convert RGB555 to RGB565 (Android-friendly)
-    convertFramebufferRGB555toRGB565(
-        picture.data(),
-        framebuffer_.data(),
-        DISPLAY_WIDTH * DISPLAY_HEIGHT
-    );
-    
-    // Get audio output
-    auto audioSpan = emulator_->GetAudio();
-    audioBuffer_.clear();
-    audioBuffer_.insert(
-        audioBuffer_.end(),
-        audioSpan.begin(),
-        audioSpan.end()
-    );
-    
     // Update FPS counter
     updateFPS();
 }
@@ -141,19 +116,15 @@ void AndroidEmulator::updateInput(const ControllerInput& input) {
 }
 
 const uint8_t* AndroidEmulator::getFramebuffer() const {
-    return framebuffer_.data();
+    return emulator_ ? emulator_->GetPicture().data() : nullptr;
 }
 
 size_t AndroidEmulator::getFramebufferSize() const {
-    return framebuffer_.size();
+    return emulator_ ? emulator_->GetPicture().size() : 0;
 }
 
-const int16_t* AndroidEmulator::getAudioSamples() const {
-    return audioBuffer_.data();
-}
-
-size_t AndroidEmulator::getAudioSampleCount() const {
-    return audioBuffer_.size();
+AudioRingBuffer* AndroidEmulator::getAudioBuffer() const {
+    return emulator_ ? &emulator_->GetAudioBuffer() : nullptr;
 }
 
 void AndroidEmulator::pause() {
@@ -182,16 +153,22 @@ float AndroidEmulator::getFPS() const {
 }
 
 std::vector<uint8_t> AndroidEmulator::saveState() {
-    // TODO: Implement save state serialization
-    // This would serialize emulator state to bytes
-    LOGI("Save state requested (not yet implemented)");
-    return std::vector<uint8_t>();
+    std::vector<uint8_t> data;
+    if (emulator_) {
+        emulator_->SaveState(data);
+    }
+    return data;
 }
 
 bool AndroidEmulator::loadState(const std::vector<uint8_t>& data) {
-    // TODO: Implement load state deserialization
-    LOGI("Load state requested (not yet implemented)");
-    return false;
+    if (!emulator_) {
+        return false;
+    }
+    if (!emulator_->LoadState(data)) {
+        LOGE("Rejected save state (%zu bytes)", data.size());
+        return false;
+    }
+    return true;
 }
 
 void AndroidEmulator::updateFPS() {
@@ -210,36 +187,6 @@ void AndroidEmulator::updateFPS() {
     }
 }
 
-void AndroidEmulator::convertFramebufferRGB555toRGB565(
-    const uint8_t* src,
-    uint8_t* dst,
-    size_t pixelCount) {
-    
-    // Convert RGB555 (veesem format) to RGB565 (Android OpenGL ES format)
-    // RGB555: XRRRRRGGGGGBBBBB (X = unused bit)
-    // RGB565: RRRRRGGGGGGBBBBB
-    
-    const uint16_t* src16 = reinterpret_cast<const uint16_t*>(src);
-    uint16_t* dst16 = reinterpret_cast<uint16_t*>(dst);
-    
-    for (size_t i = 0; i < pixelCount; i++) {
-        uint16_t color555 = src16[i];
-        
-        // Extract RGB555 components (5 bits each)
-        uint16_t r = (color555 >> 10) & 0x1F;  // Red: bits 10-14
-        uint16_t g = (color555 >> 5) & 0x1F;   // Green: bits 5-9
-        uint16_t b = color555 & 0x1F;          // Blue: bits 0-4
-        
-        // Convert 5-bit green to 6-bit by duplicating MSB
-        uint16_t g6 = (g << 1) | (g >> 4);
-        
-        // Pack into RGB565
-        uint16_t color565 = (r << 11) | (g6 << 5) | b;
-        
-        dst16[i] = color565;
-    }
-}
-
 
 
 
@@ -11,6 +11,7 @@
 #include <chrono>
 
 // Forward declare veesem types (keeps veesem includes isolated)
+class AudioRingBuffer;
 class VSmile;
 enum class VideoTiming;
 
@@ -67,7 +68,7 @@ public:
     
     /**
      * Get framebuffer (320x240 RGB565)
-     * Returns pointer to internal buffer (valid until next runFrame)
+     * Returns pointer to the PPU output (valid until next runFrame)
      */
     const uint8_t* getFramebuffer() const;
     
@@ -77,15 +78,10 @@ public:
     size_t getFramebufferSize() const;
     
     /**
-     * Get audio samples (16-bit stereo interleaved)
-     * Returns pointer to internal buffer (valid until next runFrame)
+     * Get the audio buffer (unsigned 16-bit stereo interleaved, 281.25 kHz)
+     * Filled by runFrame, can be drained from the audio thread
      */
-    const int16_t* getAudioSamples() const;
-    
-    /**
-     * Get number of audio samples (per channel)
-     */
-    size_t getAudioSampleCount() const;
+    AudioRingBuffer* getAudioBuffer() const;
     
     /**
      * Pause emulation
@@ -124,8 +120,6 @@ public:
     
 private:
     std::unique_ptr<VSmile> emulator_;
-    std::vector<uint8_t> framebuffer_;  // RGB565 format
-    std::vector<int16_t> audioBuffer_;   // Stereo interleaved
     bool paused_ = false;
     
     // FPS tracking
@@ -137,7 +131,6 @@ private:
     TimePoint fpsUpdateTime_;
     
     void updateFPS();
-    void convertFramebufferRGB555toRGB565(const uint8_t* src, uint8_t* dst, size_t pixelCount);
 };
 
 
@@ -0,0 +1,77 @@
+/**
+ * Frame Exchange Implementation
+ */
+
+#include "frame_exchange.h"
+
+#include <cstring>
+
+#include "core/spg200/audio_ring_buffer.h"
+#include "core/spg200/resampler.h"
+
+bool FrameExchange::setVideoBuffer(void* data, size_t size) {
+    if (data == nullptr || size < kVideoBytes) {
+        video_ = nullptr;
+        return false;
+    }
+    video_ = static_cast<uint8_t*>(data);
+    return true;
+}
+
+bool FrameExchange::setAudioBuffer(void* data, size_t size) {
+    // Samples are stored directly, so the buffer has to be aligned for them
+    const bool aligned = reinterpret_cast<uintptr_t>(data) % alignof(int16_t) == 0;
+    if (data == nullptr || !aligned || size < 2 * sizeof(int16_t)) {
+        audio_ = nullptr;
+        audioCapacity_ = 0;
+        return false;
+    }
+    audio_ = static_cast<int16_t*>(data);
+    audioCapacity_ = size / (2 * sizeof(int16_t));
+    return true;
+}
+
+void FrameExchange::clearBuffers() {
+    video_ = nullptr;
+    audio_ = nullptr;
+    audioCapacity_ = 0;
+}
+
+bool FrameExchange::hasVideoBuffer() const {
+    return video_ != nullptr;
+}
+
+bool FrameExchange::hasAudioBuffer() const {
+    return audio_ != nullptr;
+}
+
+size_t FrameExchange::getAudioCapacity() const {
+    return audioCapacity_;
+}
+
+bool FrameExchange::writeVideo(std::span<const uint8_t> picture) {
+    if (video_ == nullptr || picture.size() > kVideoBytes) {
+        return false;
+    }
+    std::memcpy(video_, picture.data(), picture.size());
+    return true;
+}
+
+size_t FrameExchange::writeAudio(AudioRingBuffer& audio, Resampler& resampler) {
+    drainAudio(audio, resampler);
+
+    if (audio_ == nullptr) {
+        return 0;
+    }
+    return resampler.Read(audio_, audioCapacity_);
+}
+
+void FrameExchange::drainAudio(AudioRingBuffer& audio, Resampler& resampler) {
+    // Straight from the ring buffer's storage, in up to two runs when the
+    // queued samples wrap around
+    for (int run = 0; run < 2; run++) {
+        auto samples = audio.Peek();
+        resampler.Push(samples);
+        audio.Consume(samples.size() / 2);
+    }
+}
@@ -0,0 +1,79 @@
+/**
+ * Frame Exchange
+ * Hands video and audio to buffers owned by the Kotlin side
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+class AudioRingBuffer;
+class Resampler;
+
+/**
+ * Writes each frame's output into memory registered once, normally the
+ * storage of direct ByteBuffers, instead of allocating Java arrays per frame.
+ * Holds no JNI types, so it builds and runs the same on a desktop host.
+ *
+ * The registered memory must stay valid until it is replaced or cleared, and
+ * must not be read while a frame is being written.
+ */
+class FrameExchange {
+public:
+    /**
+     * Size of one 320x240 RGB565 picture
+     */
+    static constexpr size_t kVideoBytes = 320 * 240 * 2;
+
+    /**
+     * Register where pictures go
+     * @return false if the buffer is null or smaller than kVideoBytes
+     */
+    bool setVideoBuffer(void* data, size_t size);
+
+    /**
+     * Register where audio goes, as signed 16-bit stereo frames
+     * @return false if the buffer is null or holds less than one frame
+     */
+    bool setAudioBuffer(void* data, size_t size);
+
+    /**
+     * Forget both buffers, e.g. before the Kotlin side releases them
+     */
+    void clearBuffers();
+
+    bool hasVideoBuffer() const;
+    bool hasAudioBuffer() const;
+
+    /**
+     * Audio frames the registered buffer holds
+     */
+    size_t getAudioCapacity() const;
+
+    /**
+     * Copy a picture into the video buffer
+     * @return false if no buffer is registered or the picture does not fit
+     */
+    bool writeVideo(std::span<const uint8_t> picture);
+
+    /**
+     * Drain the SPU output into the resampler and write as much resampled
+     * audio as fits into the audio buffer. Anything that does not fit stays in
+     * the resampler for the next call.
+     * @return Frames written
+     */
+    size_t writeAudio(AudioRingBuffer& audio, Resampler& resampler);
+
+    /**
+     * Move everything queued in the SPU output into the resampler, for callers
+     * that read the resampled audio themselves
+     */
+    static void drainAudio(AudioRingBuffer& audio, Resampler& resampler);
+
+private:
+    uint8_t* video_ = nullptr;
+    int16_t* audio_ = nullptr;
+    size_t audioCapacity_ = 0;
+};
@@ -0,0 +1,83 @@
+/**
+ * Frame Exchange Benchmark
+ * Time per frame to hand a picture and its audio over, through registered
+ * buffers and, for comparison, through fresh arrays per frame as the Java
+ * array path allocates them
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "core/spg200/audio_ring_buffer.h"
+#include "core/spg200/resampler.h"
+#include "frame_exchange.h"
+
+namespace {
+
+constexpr int kFrames = 2000;
+// SPU output of one 50 Hz frame
+constexpr size_t kSpuFramesPerFrame = Resampler::kInputRate / 50;
+
+using Clock = std::chrono::steady_clock;
+
+double microsecondsPerFrame(Clock::time_point start) {
+    return std::chrono::duration<double, std::micro>(Clock::now() - start).count() / kFrames;
+}
+
+}  // namespace
+
+int main() {
+    std::vector<uint8_t> picture(FrameExchange::kVideoBytes, 0x5a);
+    std::vector<uint16_t> spuOutput(kSpuFramesPerFrame * 2);
+    for (size_t i = 0; i < spuOutput.size(); i++) {
+        spuOutput[i] = static_cast<uint16_t>(i * 37);
+    }
+
+    AudioRingBuffer ring(1 << 16);
+    Resampler resampler;
+    uint64_t checksum = 0;
+
+    FrameExchange exchange;
+    std::vector<uint8_t> video(FrameExchange::kVideoBytes);
+    std::vector<int16_t> audio(4096 * 2);
+    exchange.setVideoBuffer(video.data(), video.size());
+    exchange.setAudioBuffer(audio.data(), audio.size() * sizeof(int16_t));
+
+    auto start = Clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+        exchange.writeVideo(picture);
+        checksum += video[frame % video.size()];
+    }
+    const double registeredVideo = microsecondsPerFrame(start);
+
+    start = Clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+        std::vector<uint8_t> videoArray(picture.begin(), picture.end());
+        checksum += videoArray[frame % videoArray.size()];
+    }
+    const double arrayVideo = microsecondsPerFrame(start);
+
+    start = Clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+        ring.Write(spuOutput.data(), kSpuFramesPerFrame);
+        checksum += exchange.writeAudio(ring, resampler);
+    }
+    const double registeredAudio = microsecondsPerFrame(start);
+
+    start = Clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+        ring.Write(spuOutput.data(), kSpuFramesPerFrame);
+        FrameExchange::drainAudio(ring, resampler);
+        std::vector<int16_t> audioArray(resampler.GetAvailableFrames() * 2);
+        checksum += resampler.Read(audioArray.data(), audioArray.size() / 2);
+    }
+    const double arrayAudio = microsecondsPerFrame(start);
+
+    std::printf("                    video      audio (us/frame)\n");
+    std::printf("registered buffers  %6.2f  %9.2f\n", registeredVideo, registeredAudio);
+    std::printf("arrays per frame    %6.2f  %9.2f\n", arrayVideo, arrayAudio);
+    std::printf("(checksum %llu)\n", static_cast<unsigned long long>(checksum));
+    return 0;
+}
@@ -0,0 +1,134 @@
+/**
+ * Frame Exchange Test
+ * Host-side checks of the buffers handed to the Kotlin side
+ */
+
+#include <cstdint>
+#include <vector>
+
+#include "core/spg200/audio_ring_buffer.h"
+#include "core/spg200/resampler.h"
+#include "core/testing.h"
+#include "frame_exchange.h"
+
+namespace {
+
+/**
+ * Interleaved stereo SPU output: a rising and a falling ramp
+ */
+std::vector<uint16_t> makeSpuOutput(size_t frames, size_t start) {
+    std::vector<uint16_t> samples(frames * 2);
+    for (size_t i = 0; i < frames; i++) {
+        samples[i * 2] = static_cast<uint16_t>((start + i) * 97);
+        samples[i * 2 + 1] = static_cast<uint16_t>(0xffff - (start + i) * 131);
+    }
+    return samples;
+}
+
+void testVideo() {
+    FrameExchange exchange;
+    std::vector<uint8_t> buffer(FrameExchange::kVideoBytes);
+    std::vector<uint8_t> picture(FrameExchange::kVideoBytes);
+    for (size_t i = 0; i < picture.size(); i++) {
+        picture[i] = static_cast<uint8_t>(i * 7);
+    }
+
+    EXPECT(!exchange.writeVideo(picture));
+    EXPECT(!exchange.setVideoBuffer(nullptr, buffer.size()));
+    EXPECT(!exchange.setVideoBuffer(buffer.data(), buffer.size() - 1));
+    EXPECT(!exchange.hasVideoBuffer());
+
+    EXPECT(exchange.setVideoBuffer(buffer.data(), buffer.size()));
+    EXPECT(exchange.hasVideoBuffer());
+    EXPECT(exchange.writeVideo(picture));
+    EXPECT(buffer == picture);
+
+    std::vector<uint8_t> oversized(FrameExchange::kVideoBytes + 1);
+    EXPECT(!exchange.writeVideo(oversized));
+
+    exchange.clearBuffers();
+    EXPECT(!exchange.hasVideoBuffer());
+    EXPECT(!exchange.writeVideo(picture));
+}
+
+void testAudioBuffer() {
+    FrameExchange exchange;
+    alignas(int16_t) uint8_t buffer[64];
+
+    EXPECT(!exchange.setAudioBuffer(nullptr, sizeof(buffer)));
+    EXPECT(!exchange.setAudioBuffer(buffer, 3));
+    EXPECT(!exchange.setAudioBuffer(buffer + 1, sizeof(buffer) - 1));
+    EXPECT(!exchange.hasAudioBuffer());
+    EXPECT(exchange.getAudioCapacity() == 0);
+
+    // Capacity rounds down to whole frames
+    EXPECT(exchange.setAudioBuffer(buffer, sizeof(buffer) - 2));
+    EXPECT(exchange.hasAudioBuffer());
+    EXPECT(exchange.getAudioCapacity() == 15);
+}
+
+/**
+ * Queued SPU output that wraps around the ring buffer has to come out of the
+ * resampler the same as when it is pushed in one piece
+ */
+void testWriteAudio() {
+    constexpr size_t kRingFrames = 1024;
+    constexpr size_t kFrames = 800;
+    constexpr size_t kCapacity = 64;
+
+    AudioRingBuffer ring(kRingFrames);
+    // Moves the read position so that the next write wraps
+    std::vector<uint16_t> discard(700 * 2);
+    ring.Write(discard.data(), 700);
+    ring.Read(discard.data(), 700);
+
+    const std::vector<uint16_t> input = makeSpuOutput(kFrames, 0);
+    ring.Write(input.data(), kFrames);
+    EXPECT(ring.Peek().size() < kFrames * 2);
+
+    Resampler resampler(48000, Resampler::Quality::HIGH);
+    Resampler reference(48000, Resampler::Quality::HIGH);
+    reference.Push(input);
+
+    FrameExchange exchange;
+    std::vector<int16_t> buffer(kCapacity * 2);
+    std::vector<int16_t> output;
+    EXPECT(exchange.writeAudio(ring, resampler) == 0);
+    EXPECT(ring.GetFillLevel() == 0);
+
+    EXPECT(exchange.setAudioBuffer(buffer.data(), buffer.size() * sizeof(int16_t)));
+    for (;;) {
+        const size_t frames = exchange.writeAudio(ring, resampler);
+        EXPECT(frames <= kCapacity);
+        output.insert(output.end(), buffer.begin(), buffer.begin() + frames * 2);
+        if (frames < kCapacity) {
+            break;
+        }
+    }
+
+    std::vector<int16_t> expected(reference.GetAvailableFrames() * 2);
+    expected.resize(reference.Read(expected.data(), expected.size() / 2) * 2);
+    EXPECT(!expected.empty());
+    EXPECT(output == expected);
+}
+
+void testDrainAudio() {
+    AudioRingBuffer ring(256);
+    const std::vector<uint16_t> input = makeSpuOutput(200, 0);
+    ring.Write(input.data(), 200);
+
+    Resampler resampler;
+    FrameExchange::drainAudio(ring, resampler);
+    EXPECT(ring.GetFillLevel() == 0);
+    EXPECT(resampler.GetAvailableFrames() > 0);
+}
+
+}  // namespace
+
+int main() {
+    testVideo();
+    testAudioBuffer();
+    testWriteAudio();
+    testDrainAudio();
+    return TestResult();
+}
@@ -2,6 +2,7 @@
 #include <android/log.h>
 #include <memory>
 #include <cstring>
+#include <string>
 #include <vector>
 
 // Undefine Android system register macros that conflict with veesem
@@ -30,8 +31,15 @@
 #undef REG_R7
 #endif
 
+#include "core/spg200/rate_controller.h"
+#include "core/spg200/resampler.h"
+#include "core/vsmile/boot_cache.h"
+#include "core/vsmile/emulation_thread.h"
+#include "core/vsmile/rewind_buffer.h"
+#include "core/vsmile/run_ahead.h"
 #include "core/vsmile/vsmile.h"
 #include "core/vsmile/vsmile_joy.h"
+#include "frame_exchange.h"
 
 #define LOG_TAG "VSmileNative"
 #define LOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
@@ -40,6 +48,65 @@
 // Global emulator instance
 static std::unique_ptr<VSmile> g_vsmile;
 
+// Runs g_vsmile between nativeStartEmulation and nativeStopEmulation. Input and
+// other changes go through it so that they reach the emulator between frames.
+static std::unique_ptr<EmulationThread> g_emulation_thread;
+
+// History for rewinding, 4 MB with a snapshot every other frame: from ten
+// seconds for a game that rewrites all of its RAM every frame to minutes for
+// one that changes little. Frames run through it on either path; while the
+// emulation thread runs, it belongs to that thread.
+static std::unique_ptr<RewindBuffer> g_rewind_buffer;
+
+// Frames to run ahead by, for nativeRunFrame; the emulation thread keeps its own
+static RunAhead g_run_ahead;
+static int g_run_ahead_frames = 0;
+
+// Directory of boot states for nativeInit to skip the intros with; empty for none
+static std::string g_boot_cache_dir;
+// The cache in that directory, from nativeInit on. A boot it did not have is
+// stored once it gets far enough. Belongs to the emulation thread while it runs.
+static std::unique_ptr<BootCache> g_boot_cache;
+
+// Converts SPU output to the AudioTrack rate, 48 kHz unless changed from Kotlin
+static Resampler g_resampler;
+static std::vector<int16_t> g_audio_output;
+
+// Keeps the audio queued on the Kotlin side near a target, 100 ms by default
+static RateController g_rate_control(4800);
+
+// Direct ByteBuffers registered from Kotlin, filled by nativeRunFrame or
+// nativePollFrame and nativePollAudio
+static FrameExchange g_frame_exchange;
+
+// Resample pending SPU output into the registered audio buffer, steering the
+// output rate with the amount still queued for playback
+static jint WriteAudio(jint queuedFrames) {
+    if (!g_frame_exchange.hasAudioBuffer()) {
+        return 0;
+    }
+    if (queuedFrames >= 0) {
+        g_resampler.SetRateAdjustment(g_rate_control.Update(static_cast<size_t>(queuedFrames)));
+    }
+    return static_cast<jint>(
+        g_frame_exchange.writeAudio(g_vsmile->GetAudioBuffer(), g_resampler));
+}
+
+// Call after each frame run forward
+static void UpdateBootCache(VSmile& vsmile) {
+    if (g_boot_cache && g_boot_cache->Update(vsmile)) {
+        LOGI("Boot state stored in cache");
+    }
+}
+
+// Input and anything else but running frames keep the boot in progress from
+// being stored
+static void CancelBootCache() {
+    if (g_boot_cache) {
+        g_boot_cache->Cancel();
+    }
+}
+
 extern "C" {
 
 /**
@@ -59,6 +126,9 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeInit(
         jboolean usePAL) {
     
     try {
+        g_emulation_thread.reset();
+        g_boot_cache.reset();
+        
         // Prepare system ROM
         auto sysrom_data = std::make_unique<VSmile::SysRomType>();
         
@@ -110,6 +180,10 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeInit(
         
         // Create emulator instance
         VideoTiming timing = usePAL ? VideoTiming::PAL : VideoTiming::NTSC;
+        BootCache::Key boot_key{0, 0xe, true, timing};
+        if (!g_boot_cache_dir.empty()) {
+            boot_key.rom_hash = BootCache::HashRoms(*sysrom_data, *cartrom_data);
+        }
         
         g_vsmile = std::make_unique<VSmile>(
             std::move(sysrom_data),
@@ -121,8 +195,27 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeInit(
             timing
         );
         
+        // Bitmap.Config.RGB_565 on the Kotlin side takes PPU output as-is
+        g_vsmile->SetPixelFormat(PixelFormat::RGB565);
+
         // CRITICAL: Reset the system to initialize CPU state and program counter
         g_vsmile->Reset();
+        if (!g_boot_cache_dir.empty()) {
+            // Room for about 160 games
+            g_boot_cache = std::make_unique<BootCache>(g_boot_cache_dir, 4 * 1024 * 1024);
+            if (g_boot_cache->Boot(boot_key, *g_vsmile)) {
+                LOGI("Boot state loaded from cache");
+            } else {
+                LOGI("Boot state not cached, storing it %.0f s in", BootCache::kBootSeconds);
+            }
+        }
+        g_rewind_buffer = std::make_unique<RewindBuffer>(4 * 1024 * 1024, 2);
+        g_emulation_thread = std::make_unique<EmulationThread>(*g_vsmile);
+        g_emulation_thread->SetRewindBuffer(g_rewind_buffer.get());
+        g_emulation_thread->SetFrameCallback(UpdateBootCache);
+        g_emulation_thread->SetRunAheadFrames(g_run_ahead_frames);
+        g_resampler.Reset();
+        g_rate_control.ResetStats();
         LOGI("VSmile system reset - CPU initialized");
         
         LOGI("Emulator initialized successfully (%s timing)", usePAL ? "PAL" : "NTSC");
@@ -135,16 +228,59 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeInit(
 }
 
 /**
- * Run one frame of emulation
+ * Register the direct ByteBuffers nativeRunFrame writes its output to
+ * @param video At least 320x240x2 bytes, receives RGB565 pictures; nullable
+ * @param audio Receives signed 16-bit stereo frames at the output rate; nullable
+ * @return false if a buffer was given but cannot be used
  */
-JNIEXPORT void JNICALL
+JNIEXPORT jboolean JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSetFrameBuffers(
+        JNIEnv* env,
+        jobject /* this */,
+        jobject video,
+        jobject audio) {
+    
+    g_frame_exchange.clearBuffers();
+    bool ok = true;
+    
+    if (video != nullptr) {
+        ok &= g_frame_exchange.setVideoBuffer(env->GetDirectBufferAddress(video),
+                                              env->GetDirectBufferCapacity(video));
+    }
+    if (audio != nullptr) {
+        ok &= g_frame_exchange.setAudioBuffer(env->GetDirectBufferAddress(audio),
+                                              env->GetDirectBufferCapacity(audio));
+    }
+    
+    if (!ok) {
+        LOGE("setFrameBuffers: buffers must be direct and large enough");
+        g_frame_exchange.clearBuffers();
+        return JNI_FALSE;
+    }
+    LOGI("Frame buffers registered (%zu audio frames)", g_frame_exchange.getAudioCapacity());
+    return JNI_TRUE;
+}
+
+/**
+ * Run one frame of emulation on the calling thread and write its output to the
+ * buffers registered with nativeSetFrameBuffers. Not available while the
+ * emulation thread runs.
+ * @param queuedFrames Output frames still waiting to be played, or -1 if unknown
+ * @return Audio frames written to the audio buffer
+ */
+JNIEXPORT jint JNICALL
 Java_com_vsmileemu_android_core_EmulatorCore_nativeRunFrame(
         JNIEnv* /* env */,
-        jobject /* this */) {
+        jobject /* this */,
+        jint queuedFrames) {
     
     if (!g_vsmile) {
         LOGE("runFrame: g_vsmile is NULL!");
-        return;
+        return 0;
+    }
+    if (g_emulation_thread && g_emulation_thread->IsRunning()) {
+        LOGE("runFrame: the emulation thread is running");
+        return 0;
     }
     
     static int frame_counter = 0;
@@ -152,17 +288,88 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeRunFrame(
         LOGI("runFrame: Calling RunFrame() #%d", frame_counter);
     }
     
-    g_vsmile->RunFrame();
+    g_rewind_buffer->RunFrame(*g_vsmile);
+    UpdateBootCache(*g_vsmile);
+    g_run_ahead.Run(*g_vsmile, g_run_ahead_frames);
     
     if (frame_counter < 3) {
         LOGI("runFrame: RunFrame() #%d completed", frame_counter);
     }
     frame_counter++;
+    
+    g_frame_exchange.writeVideo(g_vsmile->GetPicture());
+    return WriteAudio(queuedFrames);
+}
+
+/**
+ * Start running frames on a native thread, paced to the emulated frame rate.
+ * Poll for output with nativePollFrame and nativePollAudio.
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeStartEmulation(
+        JNIEnv* /* env */,
+        jobject /* this */) {
+    
+    if (g_emulation_thread) {
+        g_emulation_thread->Start();
+        LOGI("Emulation thread started");
+    }
+}
+
+/**
+ * Stop the emulation thread after the frame in progress
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeStopEmulation(
+        JNIEnv* /* env */,
+        jobject /* this */) {
+    
+    if (g_emulation_thread && g_emulation_thread->IsRunning()) {
+        g_emulation_thread->Stop();
+        const EmulationThreadStats stats = g_emulation_thread->GetStats();
+        LOGI("Emulation thread stopped (%llu frames, %llu late)",
+             static_cast<unsigned long long>(stats.frames),
+             static_cast<unsigned long long>(stats.late_frames));
+    }
+}
+
+/**
+ * Copy the newest picture from the emulation thread to the registered video buffer
+ * @return Number of the frame copied, or -1 if none finished since the last call
+ */
+JNIEXPORT jlong JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativePollFrame(
+        JNIEnv* /* env */,
+        jobject /* this */) {
+    
+    if (!g_emulation_thread || !g_emulation_thread->UpdateFrame()) {
+        return -1;
+    }
+    const EmulationThread::Frame& frame = g_emulation_thread->GetFrame();
+    g_frame_exchange.writeVideo(frame.pixels);
+    return frame.number;
 }
 
 /**
- * Get the current video frame (320x240 RGB565 format)
+ * Write the audio the emulation thread produced since the last call to the
+ * registered audio buffer
+ * @param queuedFrames Output frames still waiting to be played, or -1 if unknown
+ * @return Audio frames written
+ */
+JNIEXPORT jint JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativePollAudio(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint queuedFrames) {
+    
+    return g_vsmile ? WriteAudio(queuedFrames) : 0;
+}
+
+/**
+ * Get the current video frame (320x240 RGB565 format, converted by the PPU)
  * @return ByteArray containing frame data
+ *
+ * Allocates a new array on every call; nativeSetFrameBuffers avoids that.
  */
 JNIEXPORT jbyteArray JNICALL
 Java_com_vsmileemu_android_core_EmulatorCore_nativeGetFrameBuffer(
@@ -175,7 +382,6 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeGetFrameBuffer(
     }
     
     auto picture = g_vsmile->GetPicture();
-    LOGI("getFrameBuffer: picture.size() = %zu", picture.size());
     
     if (picture.size() == 0) {
         LOGE("getFrameBuffer: picture is EMPTY!");
@@ -193,47 +399,327 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeGetFrameBuffer(
     env->SetByteArrayRegion(result, 0, static_cast<jsize>(picture.size()),
                             reinterpret_cast<const jbyte*>(picture.data()));
     
-    LOGI("getFrameBuffer: Returning %zu bytes", picture.size());
     return result;
 }
 
 /**
  * Get audio samples for the current frame
- * @return ShortArray containing stereo audio samples
- * 
- * IMPORTANT: VSmile SPU outputs UNSIGNED 16-bit audio (0-65535)
- * but Android AudioTrack expects SIGNED 16-bit (-32768 to 32767)
- * We need to convert by subtracting 32768 (or XOR with 0x8000)
+ * @param queuedFrames Output frames still waiting to be played, or -1 if unknown
+ * @return ShortArray containing signed 16-bit stereo samples at the output rate
+ *
+ * The SPU outputs unsigned 16-bit audio at 281.25 kHz. The resampler converts
+ * it to signed samples at the rate set with nativeSetAudioOutput, nudged by up
+ * to 0.5% to keep the queued audio at the target set with nativeSetAudioLatency.
  */
 JNIEXPORT jshortArray JNICALL
 Java_com_vsmileemu_android_core_EmulatorCore_nativeGetAudioSamples(
         JNIEnv* env,
-        jobject /* this */) {
+        jobject /* this */,
+        jint queuedFrames) {
     
     if (!g_vsmile) {
         return nullptr;
     }
     
-    auto audio = g_vsmile->GetAudio();
-    jshortArray result = env->NewShortArray(static_cast<jsize>(audio.size()));
+    if (queuedFrames >= 0) {
+        g_resampler.SetRateAdjustment(g_rate_control.Update(static_cast<size_t>(queuedFrames)));
+    }
+    
+    FrameExchange::drainAudio(g_vsmile->GetAudioBuffer(), g_resampler);
+    const size_t frames = g_resampler.GetAvailableFrames();
+    g_audio_output.resize(frames * 2);
+    g_resampler.Read(g_audio_output.data(), frames);
+    
+    jshortArray result = env->NewShortArray(static_cast<jsize>(g_audio_output.size()));
     
     if (result == nullptr) {
         return nullptr;
     }
     
-    // Convert unsigned 16-bit to signed 16-bit
-    // Method: XOR with 0x8000 to flip the sign bit (fastest method)
-    std::vector<int16_t> converted(audio.size());
-    for (size_t i = 0; i < audio.size(); i++) {
-        converted[i] = static_cast<int16_t>(audio[i] ^ 0x8000);
+    env->SetShortArrayRegion(result, 0, static_cast<jsize>(g_audio_output.size()),
+                             g_audio_output.data());
+    
+    return result;
+}
+
+/**
+ * Set the sample rate and resampling quality of nativeGetAudioSamples output
+ * @param sampleRate Output rate in Hz
+ * @param quality 0 = low, 1 = medium, 2 = high
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSetAudioOutput(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint sampleRate,
+        jint quality) {
+    
+    if (sampleRate <= 0 || quality < 0 || quality > 2) {
+        LOGE("setAudioOutput: invalid rate %d or quality %d", sampleRate, quality);
+        return;
+    }
+    
+    g_resampler.Configure(sampleRate, static_cast<Resampler::Quality>(quality));
+    LOGI("Audio output: %d Hz, quality %d", sampleRate, quality);
+}
+
+/**
+ * Set how many output frames rate control tries to keep queued for playback
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSetAudioLatency(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint targetFrames) {
+    
+    if (targetFrames <= 0) {
+        LOGE("setAudioLatency: invalid target %d", targetFrames);
+        return;
+    }
+    
+    g_rate_control.SetTarget(static_cast<size_t>(targetFrames));
+    LOGI("Audio latency target: %d frames", targetFrames);
+}
+
+/**
+ * Get audio pacing statistics since the last call
+ * @return DoubleArray of [rate adjustment, average queued frames, min queued,
+ *         max queued, updates, updates with nothing queued]
+ */
+JNIEXPORT jdoubleArray JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeGetAudioStats(
+        JNIEnv* env,
+        jobject /* this */) {
+    
+    const RateControlStats stats = g_rate_control.GetStats();
+    g_rate_control.ResetStats();
+    
+    const jdouble values[] = {
+        stats.adjustment,
+        stats.average_fill,
+        static_cast<jdouble>(stats.min_fill),
+        static_cast<jdouble>(stats.max_fill),
+        static_cast<jdouble>(stats.updates),
+        static_cast<jdouble>(stats.empty_updates),
+    };
+    jdoubleArray result = env->NewDoubleArray(std::size(values));
+    if (result != nullptr) {
+        env->SetDoubleArrayRegion(result, 0, std::size(values), values);
+    }
+    return result;
+}
+
+/**
+ * Get the emulated frame rate (about 50.08 Hz for PAL, 60.05 Hz for NTSC)
+ */
+JNIEXPORT jdouble JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeGetFrameRate(
+        JNIEnv* /* env */,
+        jobject /* this */) {
+    
+    return g_vsmile ? g_vsmile->GetFrameRate() : 0.0;
+}
+
+/**
+ * Start recording every SPU channel and the mix to WAV files
+ * @param pathPrefix Files are named <pathPrefix>_ch00.wav and so on
+ * @return true if the files were created
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeStartStemCapture(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring pathPrefix) {
+    
+    if (!g_emulation_thread) {
+        return JNI_FALSE;
+    }
+    
+    const char* path = env->GetStringUTFChars(pathPrefix, nullptr);
+    if (path == nullptr) {
+        return JNI_FALSE;
+    }
+    bool started = false;
+    g_emulation_thread->Invoke([&](VSmile& vsmile) {
+        started = vsmile.StartStemCapture(path);
+    });
+    if (started) {
+        LOGI("Capturing audio stems to %s_*.wav", path);
+    } else {
+        LOGE("Failed to create audio stem files at %s", path);
+    }
+    env->ReleaseStringUTFChars(pathPrefix, path);
+    return started ? JNI_TRUE : JNI_FALSE;
+}
+
+/**
+ * Stop recording audio stems and finish the files
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeStopStemCapture(
+        JNIEnv* /* env */,
+        jobject /* this */) {
+    
+    if (g_emulation_thread) {
+        g_emulation_thread->Post([](VSmile& vsmile) { vsmile.StopStemCapture(); });
+    }
+}
+
+/**
+ * Step back through recent history instead of running forward, one snapshot
+ * per frame, for as long as rewinding is on
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSetRewinding(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jboolean rewinding) {
+    
+    if (g_emulation_thread) {
+        // Before any frame is rewound
+        if (rewinding) {
+            g_emulation_thread->Post([](VSmile&) { CancelBootCache(); });
+        }
+        g_emulation_thread->SetRewinding(rewinding);
+    }
+}
+
+/**
+ * Show pictures a number of frames ahead of the emulation to cut input lag.
+ * Each frame ahead costs about as much as a normal frame.
+ * @param frames 0 to turn run-ahead off
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSetRunAheadFrames(
+        JNIEnv* /* env */,
+        jobject /* this */,
+        jint frames) {
+    
+    if (frames < 0) {
+        LOGE("setRunAheadFrames: invalid count %d", frames);
+        return;
+    }
+    
+    g_run_ahead_frames = frames;
+    if (g_emulation_thread) {
+        g_emulation_thread->SetRunAheadFrames(frames);
+    }
+    LOGI("Run-ahead: %d frames", frames);
+}
+
+/**
+ * Set where nativeInit caches machine states from after the intros, to boot
+ * straight to the game the next time. A boot not cached yet is stored as it
+ * gets there, unless there was input or a rewind or state load before.
+ * @param dir Cache directory, created if needed; null to boot normally
+ */
+JNIEXPORT void JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSetBootCacheDir(
+        JNIEnv* env,
+        jobject /* this */,
+        jstring dir) {
+    
+    g_boot_cache_dir.clear();
+    if (dir != nullptr) {
+        const char* dir_chars = env->GetStringUTFChars(dir, nullptr);
+        if (dir_chars != nullptr) {
+            g_boot_cache_dir = dir_chars;
+            env->ReleaseStringUTFChars(dir, dir_chars);
+        }
+    }
+    LOGI("Boot cache: %s", g_boot_cache_dir.empty() ? "off" : g_boot_cache_dir.c_str());
+}
+
+/**
+ * Get how much history there is to rewind through
+ * @return DoubleArray of [seconds, memory used in bytes, compression ratio,
+ *         snapshots], or null if not initialized
+ */
+JNIEXPORT jdoubleArray JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeGetRewindStats(
+        JNIEnv* env,
+        jobject /* this */) {
+    
+    if (!g_emulation_thread) {
+        return nullptr;
+    }
+    
+    RewindStats stats;
+    double frame_rate = 0;
+    g_emulation_thread->Invoke([&](VSmile& vsmile) {
+        stats = g_rewind_buffer->GetStats();
+        frame_rate = vsmile.GetFrameRate();
+    });
+    
+    const jdouble values[] = {
+        stats.frames / frame_rate,
+        static_cast<jdouble>(stats.memory_bytes),
+        stats.memory_bytes ? static_cast<jdouble>(stats.uncompressed_bytes) / stats.memory_bytes
+                           : 0.0,
+        static_cast<jdouble>(stats.snapshots),
+    };
+    jdoubleArray result = env->NewDoubleArray(std::size(values));
+    if (result != nullptr) {
+        env->SetDoubleArrayRegion(result, 0, std::size(values), values);
+    }
+    return result;
+}
+
+/**
+ * Save the whole machine state
+ * @return State bytes, or null if not initialized
+ */
+JNIEXPORT jbyteArray JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeSaveState(
+        JNIEnv* env,
+        jobject /* this */) {
+    
+    if (!g_emulation_thread) {
+        return nullptr;
     }
     
-    env->SetShortArrayRegion(result, 0, static_cast<jsize>(converted.size()),
-                             converted.data());
+    std::vector<uint8_t> state;
+    g_emulation_thread->Invoke([&](VSmile& vsmile) { vsmile.SaveState(state); });
     
+    jbyteArray result = env->NewByteArray(static_cast<jsize>(state.size()));
+    if (result != nullptr) {
+        env->SetByteArrayRegion(result, 0, static_cast<jsize>(state.size()),
+                                reinterpret_cast<const jbyte*>(state.data()));
+    }
     return result;
 }
 
+/**
+ * Load a state saved by nativeSaveState. A state that does not fit the
+ * running machine is rejected and leaves it unchanged.
+ */
+JNIEXPORT jboolean JNICALL
+Java_com_vsmileemu_android_core_EmulatorCore_nativeLoadState(
+        JNIEnv* env,
+        jobject /* this */,
+        jbyteArray stateData) {
+    
+    if (!g_emulation_thread || stateData == nullptr) {
+        return JNI_FALSE;
+    }
+    
+    std::vector<uint8_t> state(env->GetArrayLength(stateData));
+    env->GetByteArrayRegion(stateData, 0, static_cast<jsize>(state.size()),
+                            reinterpret_cast<jbyte*>(state.data()));
+    
+    bool loaded = false;
+    g_emulation_thread->Invoke([&](VSmile& vsmile) {
+        loaded = vsmile.LoadState(state);
+        if (loaded) {
+            CancelBootCache();
+        }
+    });
+    if (!loaded) {
+        LOGE("Rejected save state (%zu bytes)", state.size());
+    }
+    return loaded ? JNI_TRUE : JNI_FALSE;
+}
+
 /**
  * Send joystick input to the emulator
  */
@@ -252,7 +738,7 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeSendInput(
         jint joyX,
         jint joyY) {
     
-    if (!g_vsmile) {
+    if (!g_emulation_thread) {
         return;
     }
     
@@ -268,7 +754,12 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeSendInput(
     input.x = static_cast<int>(joyX);
     input.y = static_cast<int>(joyY);
     
-    g_vsmile->UpdateJoystick(input);
+    g_emulation_thread->Post([input](VSmile& vsmile) {
+        vsmile.UpdateJoystick(input);
+        if (input != VSmileJoy::JoyInput{}) {
+            CancelBootCache();
+        }
+    });
 }
 
 /**
@@ -280,8 +771,13 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativePressOnButton(
         jobject /* this */,
         jboolean pressed) {
     
-    if (g_vsmile) {
-        g_vsmile->UpdateOnButton(pressed);
+    if (g_emulation_thread) {
+        g_emulation_thread->Post([pressed](VSmile& vsmile) {
+            vsmile.UpdateOnButton(pressed);
+            if (pressed) {
+                CancelBootCache();
+            }
+        });
     }
 }
 
@@ -293,6 +789,10 @@ Java_com_vsmileemu_android_core_EmulatorCore_nativeDestroy(
         JNIEnv* /* env */,
         jobject /* this */) {
     
+    g_emulation_thread.reset();
+    g_boot_cache.reset();
+    g_rewind_buffer.reset();
+    g_frame_exchange.clearBuffers();
     g_vsmile.reset();
     LOGI("Emulator destroyed");
 }
@@ -0,0 +1,25 @@
+# Writes a header that defines VEESEM_CORE_BUILD_HASH, a hash of the core's
+# sources, so that data tied to how the core behaves can tell which build made
+# it. Run in script mode with CORE_DIR set to src/core and OUTPUT to the header
+# to write, which is left alone if the hash has not changed.
+
+file(GLOB_RECURSE sources RELATIVE ${CORE_DIR} ${CORE_DIR}/*.cc ${CORE_DIR}/*.h)
+list(FILTER sources EXCLUDE REGEX "_test\\.cc$|^testing\\.h$")
+list(SORT sources)
+
+set(contents "")
+foreach(source IN LISTS sources)
+  file(SHA256 ${CORE_DIR}/${source} source_hash)
+  string(APPEND contents "${source} ${source_hash}\n")
+endforeach()
+string(SHA256 hash "${contents}")
+string(SUBSTRING ${hash} 0 16 hash)
+
+set(header "#pragma once\n\n// Generated by core_build_hash.cmake\n#define VEESEM_CORE_BUILD_HASH 0x${hash}ull\n")
+set(old_header "")
+if(EXISTS ${OUTPUT})
+  file(READ ${OUTPUT} old_header)
+endif()
+if(NOT header STREQUAL old_header)
+  file(WRITE ${OUTPUT} "${header}")
+endif()
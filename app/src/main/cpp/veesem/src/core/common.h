@@ -2,6 +2,7 @@
 
 #include <cstdint>
 #include <iostream>
+#include <limits>
 #include <span>
 #include <type_traits>
 
@@ -43,6 +44,9 @@ inline unsigned rotr(unsigned val, unsigned step) {
   return ((val >> step) | (val << (Bits - step))) & mask;
 }
 
+// Returned by GetCyclesToNextEvent() when a device has nothing scheduled.
+constexpr int kNoEvent = std::numeric_limits<int>::max();
+
 class SimpleConfigurableClock {
 public:
   SimpleConfigurableClock(int a, int b) : counter_(a), a_(a), b_(b) {}
@@ -57,6 +61,14 @@ public:
 
   inline void Reset() { counter_ = a_; }
 
+  // Smallest number of cycles for which Tick() will return true.
+  inline int GetCyclesToTick() const { return counter_ > 0 ? (counter_ + b_ - 1) / b_ : 1; }
+
+  template <typename State>
+  void Serialize(State& state) {
+    state.Value(counter_);
+  }
+
 protected:
   int counter_;
   const int a_;
@@ -77,8 +89,27 @@ public:
     return false;
   }
 
+  // Like Tick(), but the cycles may span any number of ticks, which are
+  // returned.
+  inline int TickMultiple(int cycles) {
+    counter_ -= B * cycles;
+    if (counter_ > 0)
+      return 0;
+    const int ticks = -counter_ / A + 1;
+    counter_ += ticks * A;
+    return ticks;
+  }
+
   inline void Reset() { counter_ = A; }
 
+  // Smallest number of cycles for which Tick() will return true.
+  inline int GetCyclesToTick() const { return counter_ > 0 ? (counter_ + B - 1) / B : 1; }
+
+  template <typename State>
+  void Serialize(State& state) {
+    state.Value(counter_);
+  }
+
 protected:
   int counter_ = A;
 };
@@ -96,6 +127,12 @@ public:
     return ret;
   }
 
+  inline int TickMultiple(int cycles) {
+    const int ticks = SimpleClock<A, B>::TickMultiple(cycles);
+    div_counter_ += ticks;
+    return ticks;
+  }
+
   inline void Reset() {
     SimpleClock<A, B>::Reset();
     ClearDivCounter();
@@ -105,6 +142,12 @@ public:
 
   inline void ClearDivCounter() { div_counter_ = 0; }
 
+  template <typename State>
+  void Serialize(State& state) {
+    SimpleClock<A, B>::Serialize(state);
+    state.Value(div_counter_);
+  }
+
 private:
   int div_counter_ = 0;
 };
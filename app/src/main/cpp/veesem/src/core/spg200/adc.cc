@@ -1,5 +1,6 @@
 #include "adc.h"
 
+#include "core/state_serializer.h"
 #include "irq.h"
 #include "spg200_io.h"
 
@@ -14,6 +15,17 @@ void Adc::Reset() {
   data_.raw = 0;
 }
 
+void Adc::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("ADC ", 1))
+    return;
+  state.Value(ctrl_.raw);
+  state.Value(status_.raw);
+  state.Value(data_.raw);
+  adc_clock_.Serialize(state);
+  state.Value(active_channel_);
+  state.EndChunk();
+}
+
 void Adc::RunCycles(int cycles) {
   if (active_channel_ >= 0) {
     if (adc_clock_.Tick(cycles) && adc_clock_.GetDividedTick(ctrl_.clock)) {
@@ -41,6 +53,12 @@ void Adc::RunCycles(int cycles) {
   }
 }
 
+int Adc::GetCyclesToNextEvent() const {
+  if (active_channel_ < 0)
+    return kNoEvent;
+  return adc_clock_.GetCyclesToTick();
+}
+
 void Adc::SetControl(uint16_t value) {
   ctrl_.raw = value & AdcControl::WriteMask;
   status_.raw &= ~(value & AdcControlStatus::WriteMask);
@@ -4,13 +4,16 @@
 
 class Irq;
 class Spg200Io;
+class StateSerializer;
 
 class Adc {
 public:
   Adc(Irq& irq, Spg200Io& spg200);
 
   void Reset();
+  void Serialize(StateSerializer& state);
   void RunCycles(int cycles);
+  int GetCyclesToNextEvent() const;
 
   void SetControl(word_t value);
   word_t GetControl();
@@ -2,6 +2,8 @@
 
 #include <algorithm>
 
+#include "core/state_serializer.h"
+
 namespace {
 static const int StepSizeTable[89] = {
     7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,
@@ -21,6 +23,11 @@ void Adpcm::Reset() {
   last_sample_ = 0;
 }
 
+void Adpcm::Serialize(StateSerializer& state) {
+  state.Value(step_index_);
+  state.Value(last_sample_);
+}
+
 int16_t Adpcm::Decode(uint8_t code) {
   int ss = StepSizeTable[step_index_];
   int e =
@@ -35,3 +42,16 @@ int16_t Adpcm::Decode(uint8_t code) {
 
   return sample;
 }
+
+int Adpcm::GetStepIndex() const {
+  return step_index_;
+}
+
+int16_t Adpcm::GetLastSample() const {
+  return last_sample_;
+}
+
+void Adpcm::SetState(int step_index, int16_t last_sample) {
+  step_index_ = step_index;
+  last_sample_ = last_sample;
+}
@@ -3,12 +3,21 @@
 #include <cstdint>
 #include <unordered_map>
 
+class StateSerializer;
+
 class Adpcm {
 public:
   Adpcm() = default;
   void Reset();
   int16_t Decode(uint8_t nibble);
 
+  // Decoder state, for caching decoded samples
+  int GetStepIndex() const;
+  int16_t GetLastSample() const;
+  void SetState(int step_index, int16_t last_sample);
+
+  void Serialize(StateSerializer& state);
+
 private:
   int8_t step_index_ = 0;
   int16_t last_sample_ = 0;
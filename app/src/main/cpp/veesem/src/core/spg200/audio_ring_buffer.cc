@@ -0,0 +1,97 @@
+#include "audio_ring_buffer.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+
+AudioRingBuffer::AudioRingBuffer(std::size_t capacity)
+    : capacity_(std::bit_ceil(capacity)),
+      mask_(capacity_ - 1),
+      // Every sample is written before it is read, so the storage is not
+      // cleared, nor touched at all until the audio gets there
+      samples_(std::make_unique_for_overwrite<uint16_t[]>(capacity_ * 2)) {}
+
+std::size_t AudioRingBuffer::Write(const uint16_t* samples, std::size_t frames) {
+  const std::size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+  if (write_pos - cached_read_pos_ + frames > capacity_)
+    cached_read_pos_ = read_pos_.load(std::memory_order_acquire);
+
+  const std::size_t count = std::min(frames, capacity_ - (write_pos - cached_read_pos_));
+  const std::size_t start = write_pos & mask_;
+  const std::size_t first = std::min(count, capacity_ - start);
+  std::memcpy(&samples_[start * 2], samples, first * 2 * sizeof(uint16_t));
+  std::memcpy(&samples_[0], samples + first * 2, (count - first) * 2 * sizeof(uint16_t));
+  write_pos_.store(write_pos + count, std::memory_order_release);
+
+  if (count < frames)
+    overruns_.fetch_add(frames - count, std::memory_order_relaxed);
+  return count;
+}
+
+std::size_t AudioRingBuffer::WriteRepeated(uint16_t left, uint16_t right, std::size_t frames) {
+  const std::size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+  if (write_pos - cached_read_pos_ + frames > capacity_)
+    cached_read_pos_ = read_pos_.load(std::memory_order_acquire);
+
+  const std::size_t count = std::min(frames, capacity_ - (write_pos - cached_read_pos_));
+  for (std::size_t i = 0; i < count; i++) {
+    const std::size_t index = ((write_pos + i) & mask_) * 2;
+    samples_[index] = left;
+    samples_[index + 1] = right;
+  }
+  write_pos_.store(write_pos + count, std::memory_order_release);
+
+  if (count < frames)
+    overruns_.fetch_add(frames - count, std::memory_order_relaxed);
+  return count;
+}
+
+std::size_t AudioRingBuffer::Read(uint16_t* samples, std::size_t frames) {
+  const std::size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+  const std::size_t available = write_pos_.load(std::memory_order_acquire) - read_pos;
+
+  const std::size_t count = std::min(frames, available);
+  const std::size_t start = read_pos & mask_;
+  const std::size_t first = std::min(count, capacity_ - start);
+  std::memcpy(samples, &samples_[start * 2], first * 2 * sizeof(uint16_t));
+  std::memcpy(samples + first * 2, &samples_[0], (count - first) * 2 * sizeof(uint16_t));
+  read_pos_.store(read_pos + count, std::memory_order_release);
+
+  if (count < frames)
+    underruns_.fetch_add(1, std::memory_order_relaxed);
+  return count;
+}
+
+std::span<const uint16_t> AudioRingBuffer::Peek() const {
+  const std::size_t read_pos = read_pos_.load(std::memory_order_relaxed);
+  const std::size_t available = write_pos_.load(std::memory_order_acquire) - read_pos;
+
+  const std::size_t start = read_pos & mask_;
+  return {&samples_[start * 2], std::min(available, capacity_ - start) * 2};
+}
+
+void AudioRingBuffer::Consume(std::size_t frames) {
+  read_pos_.store(read_pos_.load(std::memory_order_relaxed) + frames, std::memory_order_release);
+}
+
+void AudioRingBuffer::Clear() {
+  read_pos_.store(write_pos_.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+std::size_t AudioRingBuffer::GetCapacity() const {
+  return capacity_;
+}
+
+std::size_t AudioRingBuffer::GetFillLevel() const {
+  // Read position first, so that the difference can not underflow
+  const std::size_t read_pos = read_pos_.load(std::memory_order_acquire);
+  return write_pos_.load(std::memory_order_acquire) - read_pos;
+}
+
+uint64_t AudioRingBuffer::GetOverruns() const {
+  return overruns_.load(std::memory_order_relaxed);
+}
+
+uint64_t AudioRingBuffer::GetUnderruns() const {
+  return underruns_.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+
+// Lock-free queue of interleaved stereo samples between one producer thread
+// (the emulation, through the SPU) and one consumer thread (usually a frontend
+// audio callback). Neither side ever blocks: frames that do not fit are
+// dropped and counted as overruns, and reads that come up short are counted as
+// underruns.
+class AudioRingBuffer {
+public:
+  // Capacity in frames, rounded up to a power of two
+  explicit AudioRingBuffer(std::size_t capacity);
+
+  AudioRingBuffer(const AudioRingBuffer&) = delete;
+  AudioRingBuffer& operator=(const AudioRingBuffer&) = delete;
+
+  // Producer side. Returns false if the buffer was full and the frame dropped.
+  bool WriteFrame(uint16_t left, uint16_t right);
+  std::size_t Write(const uint16_t* samples, std::size_t frames);
+  std::size_t WriteRepeated(uint16_t left, uint16_t right, std::size_t frames);
+
+  // Consumer side. Read() copies up to the given number of frames and counts
+  // an underrun if fewer were available. Peek() gives the contiguous run of
+  // queued samples that starts at the read position without copying, to be
+  // released with Consume(); the rest, if any, follows after the wrap.
+  std::size_t Read(uint16_t* samples, std::size_t frames);
+  std::span<const uint16_t> Peek() const;
+  void Consume(std::size_t frames);
+  void Clear();
+
+  // Safe to call from either side
+  std::size_t GetCapacity() const;
+  std::size_t GetFillLevel() const;
+  uint64_t GetOverruns() const;
+  uint64_t GetUnderruns() const;
+
+private:
+  const std::size_t capacity_;
+  const std::size_t mask_;
+  std::unique_ptr<uint16_t[]> samples_;
+
+  // Frame counters that only ever grow; positions in the buffer are taken
+  // modulo the capacity. Each side owns one and only reads the other.
+  alignas(64) std::atomic<std::size_t> write_pos_ = 0;
+  std::size_t cached_read_pos_ = 0;  // producer's last view of read_pos_
+  std::atomic<uint64_t> overruns_ = 0;
+  alignas(64) std::atomic<std::size_t> read_pos_ = 0;
+  std::atomic<uint64_t> underruns_ = 0;
+};
+
+inline bool AudioRingBuffer::WriteFrame(uint16_t left, uint16_t right) {
+  const std::size_t write_pos = write_pos_.load(std::memory_order_relaxed);
+  if (write_pos - cached_read_pos_ == capacity_) {
+    cached_read_pos_ = read_pos_.load(std::memory_order_acquire);
+    if (write_pos - cached_read_pos_ == capacity_) {
+      overruns_.fetch_add(1, std::memory_order_relaxed);
+      return false;
+    }
+  }
+
+  const std::size_t index = (write_pos & mask_) * 2;
+  samples_[index] = left;
+  samples_[index + 1] = right;
+  write_pos_.store(write_pos + 1, std::memory_order_release);
+  return true;
+}
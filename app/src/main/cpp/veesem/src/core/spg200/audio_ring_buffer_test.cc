@@ -0,0 +1,238 @@
+// Checks the audio queue on one thread, where wraparound, overruns and
+// underruns can be placed exactly, and with a producer and a consumer thread
+// going through it as fast as they can, using every way to write and read.
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include "audio_ring_buffer.h"
+#include "core/testing.h"
+
+namespace {
+// Frames come in runs of four equal ones, so that WriteRepeated() can write
+// parts of the same stream as the other calls
+uint16_t Left(uint64_t frame) {
+  return static_cast<uint16_t>(((frame >> 2) * 0x9e3779b1u) >> 16);
+}
+
+uint16_t Right(uint64_t frame) {
+  return static_cast<uint16_t>(~Left(frame) ^ (frame >> 18));
+}
+
+std::vector<uint16_t> MakeFrames(uint64_t first, std::size_t count) {
+  std::vector<uint16_t> samples;
+  for (uint64_t frame = first; frame < first + count; frame++) {
+    samples.push_back(Left(frame));
+    samples.push_back(Right(frame));
+  }
+  return samples;
+}
+
+bool MatchesFrames(const uint16_t* samples, uint64_t first, std::size_t count) {
+  for (std::size_t i = 0; i < count; i++) {
+    if (samples[i * 2] != Left(first + i) || samples[i * 2 + 1] != Right(first + i))
+      return false;
+  }
+  return true;
+}
+
+void TestCapacity() {
+  EXPECT(AudioRingBuffer(5).GetCapacity() == 8);
+  EXPECT(AudioRingBuffer(8).GetCapacity() == 8);
+  EXPECT(AudioRingBuffer(1000).GetCapacity() == 1024);
+}
+
+// Writes and reads of every length up to the capacity, from every position
+void TestWrapAround() {
+  AudioRingBuffer buffer(8);
+  uint64_t written = 0;
+  uint64_t read = 0;
+  bool all_match = true;
+
+  for (std::size_t start = 0; start < 8; start++) {
+    for (std::size_t count = 1; count <= 8; count++) {
+      const std::vector<uint16_t> samples = MakeFrames(written, count);
+      all_match &= buffer.Write(samples.data(), count) == count;
+      written += count;
+      all_match &= buffer.GetFillLevel() == count;
+
+      std::vector<uint16_t> out(count * 2);
+      all_match &= buffer.Read(out.data(), count) == count;
+      all_match &= MatchesFrames(out.data(), read, count);
+      read += count;
+    }
+    // Move the start one frame on
+    buffer.WriteFrame(Left(written), Right(written));
+    written++;
+    buffer.Consume(1);
+    read++;
+  }
+  EXPECT(all_match);
+  EXPECT(buffer.GetFillLevel() == 0);
+  EXPECT(buffer.GetOverruns() == 0);
+  EXPECT(buffer.GetUnderruns() == 0);
+}
+
+// Peek() stops at the end of the storage, the rest follows after Consume()
+void TestPeekConsume() {
+  AudioRingBuffer buffer(8);
+  buffer.WriteRepeated(0, 0, 6);
+  buffer.Consume(6);
+
+  const std::vector<uint16_t> samples = MakeFrames(0, 5);
+  EXPECT(buffer.Write(samples.data(), 5) == 5);
+
+  std::span<const uint16_t> run = buffer.Peek();
+  EXPECT(run.size() == 2 * 2);
+  EXPECT(MatchesFrames(run.data(), 0, 2));
+  buffer.Consume(run.size() / 2);
+
+  run = buffer.Peek();
+  EXPECT(run.size() == 3 * 2);
+  EXPECT(MatchesFrames(run.data(), 2, 3));
+  buffer.Consume(run.size() / 2);
+
+  EXPECT(buffer.Peek().empty());
+  EXPECT(buffer.GetFillLevel() == 0);
+}
+
+void TestWriteRepeated() {
+  AudioRingBuffer buffer(8);
+  buffer.WriteRepeated(0, 0, 5);
+  buffer.Consume(5);
+
+  // Wraps after three frames
+  EXPECT(buffer.WriteRepeated(0x1234, 0x5678, 6) == 6);
+  std::vector<uint16_t> out(6 * 2);
+  EXPECT(buffer.Read(out.data(), 6) == 6);
+  bool all_match = true;
+  for (std::size_t i = 0; i < out.size(); i += 2)
+    all_match &= out[i] == 0x1234 && out[i + 1] == 0x5678;
+  EXPECT(all_match);
+
+  EXPECT(buffer.WriteRepeated(1, 2, 0) == 0);
+  EXPECT(buffer.GetFillLevel() == 0);
+}
+
+// Frames that do not fit are dropped and counted one by one
+void TestOverruns() {
+  AudioRingBuffer buffer(8);
+  EXPECT(buffer.WriteRepeated(1, 1, 6) == 6);
+  EXPECT(buffer.WriteFrame(2, 2));
+  EXPECT(buffer.WriteFrame(3, 3));
+  EXPECT(!buffer.WriteFrame(4, 4));
+  EXPECT(buffer.GetOverruns() == 1);
+
+  buffer.Consume(3);
+  const std::vector<uint16_t> samples = MakeFrames(0, 5);
+  EXPECT(buffer.Write(samples.data(), 5) == 3);
+  EXPECT(buffer.GetOverruns() == 3);
+  EXPECT(buffer.WriteRepeated(5, 5, 4) == 0);
+  EXPECT(buffer.GetOverruns() == 7);
+  EXPECT(buffer.GetFillLevel() == 8);
+
+  // What was kept is intact, in order
+  std::vector<uint16_t> out(8 * 2);
+  EXPECT(buffer.Read(out.data(), 8) == 8);
+  EXPECT(out[0] == 1 && out[5] == 1 && out[6] == 2 && out[8] == 3);
+  EXPECT(MatchesFrames(&out[10], 0, 3));
+}
+
+// Every short read counts as one underrun; reads of nothing do not
+void TestUnderruns() {
+  AudioRingBuffer buffer(8);
+  std::vector<uint16_t> out(8 * 2);
+  EXPECT(buffer.Read(out.data(), 0) == 0);
+  EXPECT(buffer.GetUnderruns() == 0);
+  EXPECT(buffer.Read(out.data(), 4) == 0);
+  EXPECT(buffer.GetUnderruns() == 1);
+
+  buffer.WriteRepeated(7, 7, 3);
+  EXPECT(buffer.Read(out.data(), 4) == 3);
+  EXPECT(buffer.GetUnderruns() == 2);
+  buffer.WriteRepeated(7, 7, 3);
+  EXPECT(buffer.Read(out.data(), 3) == 3);
+  EXPECT(buffer.GetUnderruns() == 2);
+}
+
+void TestClear() {
+  AudioRingBuffer buffer(8);
+  buffer.WriteRepeated(1, 1, 7);
+  buffer.Clear();
+  EXPECT(buffer.GetFillLevel() == 0);
+  EXPECT(buffer.Peek().empty());
+  EXPECT(buffer.WriteRepeated(1, 1, 8) == 8);
+  EXPECT(buffer.GetOverruns() == 0);
+}
+
+// The producer retries what was dropped, so the consumer has to see the whole
+// stream in order however the two interleave
+void TestTwoThreads() {
+  constexpr uint64_t kFrames = 1 << 22;
+  AudioRingBuffer buffer(256);
+
+  std::thread producer([&buffer] {
+    std::mt19937 rng(1);
+    uint64_t frame = 0;
+    while (frame < kFrames) {
+      std::size_t count = 0;
+      switch (rng() % 3) {
+        case 0:
+          count = buffer.WriteFrame(Left(frame), Right(frame)) ? 1 : 0;
+          break;
+        case 1: {
+          const std::size_t frames = std::min<uint64_t>(1 + rng() % 100, kFrames - frame);
+          const std::vector<uint16_t> samples = MakeFrames(frame, frames);
+          count = buffer.Write(samples.data(), frames);
+          break;
+        }
+        case 2:
+          count = buffer.WriteRepeated(Left(frame), Right(frame), 4 - frame % 4);
+          break;
+      }
+      frame += count;
+      if (count == 0)
+        std::this_thread::yield();
+    }
+  });
+
+  std::mt19937 rng(2);
+  uint64_t frame = 0;
+  bool in_order = true;
+  std::vector<uint16_t> out(2 * 256);
+  while (frame < kFrames) {
+    std::size_t count = 0;
+    if (rng() % 2) {
+      count = buffer.Read(out.data(), 1 + rng() % 256);
+      in_order &= MatchesFrames(out.data(), frame, count);
+    } else {
+      const std::span<const uint16_t> run = buffer.Peek();
+      count = std::min<std::size_t>(run.size() / 2, 1 + rng() % 256);
+      in_order &= MatchesFrames(run.data(), frame, count);
+      buffer.Consume(count);
+    }
+    frame += count;
+    if (count == 0)
+      std::this_thread::yield();
+  }
+  producer.join();
+
+  EXPECT(in_order);
+  EXPECT(buffer.GetFillLevel() == 0);
+}
+}  // namespace
+
+int main() {
+  TestCapacity();
+  TestWrapAround();
+  TestPeekConsume();
+  TestWriteRepeated();
+  TestOverruns();
+  TestUnderruns();
+  TestClear();
+  TestTwoThreads();
+  return TestResult();
+}
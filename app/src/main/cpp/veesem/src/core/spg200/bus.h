@@ -0,0 +1,13 @@
+#pragma once
+
+// Cpu, Ppu, Spu and Dma access memory through a Bus. By default this is the
+// concrete Spg200, so accesses are direct calls the compiler can inline.
+// Building with VEESEM_VIRTUAL_BUS routes them through BusInterface instead,
+// e.g. to interpose a tracing or test bus.
+#ifdef VEESEM_VIRTUAL_BUS
+class BusInterface;
+using Bus = BusInterface;
+#else
+class Spg200;
+using Bus = Spg200;
+#endif
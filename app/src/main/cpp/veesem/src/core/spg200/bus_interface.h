@@ -8,4 +8,9 @@ public:
 
   virtual word_t ReadWord(addr_t addr) = 0;
   virtual void WriteWord(addr_t addr, word_t value) = 0;
+
+  // Whether addr holds memory that no write can change, so that what is read
+  // from there may be cached until the memory map changes. Interposed buses
+  // keep the default and see every read.
+  virtual bool IsReadOnly(addr_t addr) const { return false; }
 };
\ No newline at end of file
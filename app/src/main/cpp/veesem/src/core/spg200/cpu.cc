@@ -3,7 +3,8 @@
 #include <bit>
 #include <iostream>
 
-#include "bus_interface.h"
+#include "core/state_serializer.h"
+#include "spg200.h"
 
 #define SR (reinterpret_cast<StatusReg&>(regs_[REG_SR]))
 
@@ -86,9 +87,12 @@ enum cpu_branchop {
   BRANCHOP_JMP = 14,
 };
 
-Cpu::Cpu(BusInterface& bus) : bus_(bus) {}
+Cpu::Cpu(Bus& bus) : bus_(bus) {
+  FlushDecodeCache();
+}
 
 void Cpu::Reset() {
+  FlushDecodeCache();
   regs_.fill(0);
   sb_.fill(0);
   irq_ = false;
@@ -102,6 +106,32 @@ void Cpu::Reset() {
   regs_[REG_PC] = bus_.ReadWord(0xfff7);
 }
 
+void Cpu::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("CPU ", 1))
+    return;
+  state.Value(regs_);
+  state.Value(sb_);
+  state.Value(irq_signal_);
+  state.Value(fiq_signal_);
+  state.Value(irq_);
+  state.Value(fiq_);
+  state.Value(irq_enable_);
+  state.Value(fiq_enable_);
+  state.Value(fir_mov_);
+  state.EndChunk();
+
+  // Decoded instructions in RAM belong to whatever was there before. RAM
+  // addresses only ever take the entries of the same index. Spg200 flushes the
+  // rest if external memory changed.
+  static_assert(kDecodeCacheSize >= 0x2800);
+  if (state.IsLoading()) {
+    for (addr_t addr = 0; addr < 0x2800; addr++) {
+      if (decode_cache_[addr].addr < 0x2800)
+        decode_cache_[addr].addr = kInvalidAddr;
+    }
+  }
+}
+
 void Cpu::PrintRegisterState() {
   std::printf(
       "SP: %04x, R1: %04x, R2: %04x, R3: %04x, "
@@ -145,391 +175,517 @@ int Cpu::Step() {
     return 10;
   }
 
-  const Instruction iw{ReadWordFromPc()};
+  const addr_t cs_pc = GetCsPc();
+  DecodedInstruction& insn = decode_cache_[cs_pc & (kDecodeCacheSize - 1)];
+  if (insn.addr != cs_pc)
+    Decode(insn, cs_pc);
+
+  SetCsPc(cs_pc + 1);
+  return (this->*insn.handler)(insn);
+}
+
+void Cpu::FlushDecodeCache() {
+  for (auto& insn : decode_cache_)
+    insn.addr = kInvalidAddr;
+}
+
+// Reads the instruction word (and the following immediate word for two-word
+// instructions) at addr and selects its handler. The entry is only tagged with
+// the address if the instruction lives in RAM or external memory, since reads
+// from the I/O region may have side effects and must not be replayed.
+void Cpu::Decode(DecodedInstruction& insn, addr_t addr) {
+  const Instruction iw{bus_.ReadWord(addr)};
+  bool has_imm = false;
+
+  insn.raw = iw.raw;
+  insn.handler = &Cpu::OpInvalid;
 
   if (iw.op0 == 0xf) {
     switch (iw.op1) {
-      case 0:  // mul us
-        if (iw.rd != REG_PC && iw.rs != REG_PC && iw.opn == 1) {
-          const unsigned result = regs_[iw.rd] * static_cast<int16_t>(regs_[iw.rs]);
-          regs_[REG_R3] = result & 0xffff;
-          regs_[REG_R4] = (result >> 16) & 0xffff;
-          return 12;
-        } else {
-          die("Unknown instruction");
-        }
-      case 1:  // call
-      {
-        const addr_t new_pc = (iw.imm6 << 16) | ReadWordFromPc();
-        PushWord(regs_[REG_SP], regs_[REG_PC]);
-        PushWord(regs_[REG_SP], regs_[REG_SR]);
-        SetCsPc(new_pc);
-        return 9;
-      }
-      case 2:  // goto or muls us
+      case 0:
+        if (iw.rd != REG_PC && iw.rs != REG_PC && iw.opn == 1)
+          insn.handler = &Cpu::OpMulUs;
+        break;
+      case 1:
+        insn.handler = &Cpu::OpCall;
+        has_imm = true;
+        break;
+      case 2:
         if (iw.rd == REG_PC) {
-          const addr_t new_pc = (iw.imm6 << 16) | ReadWordFromPc();
-          SetCsPc(new_pc);
-          return 5;
+          insn.handler = &Cpu::OpGoto;
+          has_imm = true;
+          break;
         }
         [[fallthrough]];
-      case 3:  // muls us
-        if (iw.rd != REG_PC && iw.rs != REG_PC) {
-          const int n = iw.muls_n ? iw.muls_n : 16;
-          int64_t sum = 0;
-
-          word_t old_val1 = 0;
-          for (int i = 0; i < n; i++) {
-            word_t val1 = bus_.ReadWord(regs_[iw.rd]);
-            word_t val2 = bus_.ReadWord(regs_[iw.rs]);
-            sum += val1 * static_cast<int16_t>(val2);
-
-            if (fir_mov_) {
-              if (i > 0)
-                bus_.WriteWord(regs_[iw.rd], old_val1);
-              old_val1 = val1;
-            }
-
-            regs_[iw.rd]++;
-            regs_[iw.rs]++;
-          }
-
-          regs_[REG_R3] = sum & 0xffff;
-          regs_[REG_R4] = (sum >> 16) & 0xffff;
-          return 10 * n + 6;
-        } else {
-          die("Unknown instruction");
-        }
-      case 4:  // mul ss
-      {
-        if (iw.rd != REG_PC && iw.rs != REG_PC && iw.opn == 1) {
-          const unsigned result =
-              static_cast<int16_t>(regs_[iw.rd]) * static_cast<int16_t>(regs_[iw.rs]);
-
-          regs_[REG_R3] = result & 0xffff;
-          regs_[REG_R4] = (result >> 16) & 0xffff;
-          return 12;
-        } else {
-          die("Unknown instruction");
-        }
-      }
-      case 5:  // irq control, break, other settings
-      {
-        switch (iw.imm6) {
-          case 0 ... 3:
-            irq_enable_ = (iw.imm6 & 1);
-            fiq_enable_ = (iw.imm6 & 2);
-            return 2;
-          case 4 ... 5:
-            fir_mov_ = !(iw.imm6 & 1);
-            return 2;
-          case 8 ... 9:
-            irq_enable_ = (iw.imm6 & 1);
-            return 2;
-          case 12:
-          case 14:
-            fiq_enable_ = (iw.imm6 & 2);
-            return 2;
-          case 32:
-          case 40:
-          case 48:
-          case 56:  // break
-            PushWord(regs_[REG_SP], regs_[REG_PC]);
-            PushWord(regs_[REG_SP], regs_[REG_SR]);
-            regs_[REG_PC] = bus_.ReadWord(0xfff5);
-            regs_[REG_SR] = 0;
-            return 10;
-          case 37:  // nop
-            return 2;
-          default:
-            die("Unknown instruction");
-            return 0;
-        }
-      }
+      case 3:
+        if (iw.rd != REG_PC && iw.rs != REG_PC)
+          insn.handler = &Cpu::OpMulsUs;
+        break;
+      case 4:
+        if (iw.rd != REG_PC && iw.rs != REG_PC && iw.opn == 1)
+          insn.handler = &Cpu::OpMulSs;
+        break;
+      case 5:
+        insn.handler = &Cpu::OpSystem;
+        break;
       case 6:
-      case 7:  // muls ss
-        if (iw.rd != REG_PC && iw.rs != REG_PC) {
-          const int n = iw.muls_n ? iw.muls_n : 16;
-          int64_t sum = 0;
-
-          word_t old_val1 = 0;
-          for (int i = 0; i < n; i++) {
-            word_t val1 = bus_.ReadWord(regs_[iw.rd]);
-            word_t val2 = bus_.ReadWord(regs_[iw.rs]);
-            sum += static_cast<int16_t>(val1) * static_cast<int16_t>(val2);
-
-            if (fir_mov_) {
-              if (i > 0)
-                bus_.WriteWord(regs_[iw.rd], old_val1);
-              old_val1 = val1;
-            }
-
-            regs_[iw.rd]++;
-            regs_[iw.rs]++;
-          }
-
-          regs_[REG_R3] = sum & 0xffff;
-          regs_[REG_R4] = (sum >> 16) & 0xffff;
-          return 10 * n + 6;
-        } else {
-          die("Unknown instruction");
-        }
-      default:
-        die("Unknown instruction");
+      case 7:
+        if (iw.rd != REG_PC && iw.rs != REG_PC)
+          insn.handler = &Cpu::OpMulsSs;
+        break;
     }
-  } else {  // ALU and branch operations
+  } else {
     switch (iw.op1n) {
-      case 0 ... 7:  // [bp+imm6] or branch forward if rd = PC
-        if (iw.rd == REG_PC) {
-          const bool do_branch = CheckBranch(iw.op0);
-          if (do_branch) {
-            const addr_t cs_pc = GetCsPc();
-            SetCsPc(cs_pc + iw.imm6);
-          }
-          return do_branch ? 4 : 2;
-        } else {
-          const addr_t addr = regs_[REG_BP] + iw.imm6;
-          if (iw.op0 != ALUOP_STORE) {
-            const word_t value = bus_.ReadWord(addr);
-            AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-          } else {
-            bus_.WriteWord(addr, regs_[iw.rd]);
-          }
-          return 6;
-        }
-      case 8 ... 15:  // imm6 or branch backward if rd = PC
-        if (iw.rd == REG_PC) {
-          const bool do_branch = CheckBranch(iw.op0);
-          if (do_branch) {
-            const addr_t cs_pc = GetCsPc();
-            SetCsPc(cs_pc - iw.imm6);
-          }
-          return do_branch ? 4 : 2;
-        } else {
-          if (iw.op0 != ALUOP_STORE) {
-            AluOp(regs_[iw.rd], regs_[iw.rd], iw.imm6, iw.op0, iw.rd != REG_PC);
-          } else {
-            die("Attempting to store using immediate addressing mode");
-          }
-          return 2;
-        }
-      case 16 ... 23: {  // push and pop
-        int n = iw.opn;
-        int reg = iw.rd;
-
-        if (iw.op0 == ALUOP_LOAD)  // pop / reti (pseudo-op)
-        {
-          // special encoding for reti
-          if (iw.rd == REG_BP && iw.opn == 3 && iw.rs == REG_SP) {
-            if (fiq_)
-              fiq_ = false;
-            else if (irq_)
-              irq_ = false;
-            n = 2;  // otherwise handle like usual
-          }
-
-          int left = n;
-          while (left-- && (reg + 1) <= 7) {
-            regs_[++reg] = PopWord(regs_[iw.rs]);
-          }
-        } else if (iw.op0 == ALUOP_STORE) {
-          int left = n;
-          while (left-- && reg >= 0) {
-            PushWord(regs_[iw.rs], regs_[reg--]);
-          }
-        } else {
-          die("Attempting to push/pop using invalid alu op");
-        }
-        return 2 * n + 4;
-      }
-      case 24 ... 31: {
-        addr_t addr = 0;
-        switch (iw.op1n) {
-          case 24:
-            addr = regs_[iw.rs];
-            break;
-          case 25:
-            addr = regs_[iw.rs]--;
-            break;
-          case 26:
-            addr = regs_[iw.rs]++;
-            break;
-          case 27:
-            addr = ++regs_[iw.rs];
-            break;
-          case 28:
-            addr = (SR.ds << 16) | regs_[iw.rs];
-            break;
-          case 29:
-            addr = (SR.ds << 16) | regs_[iw.rs]--;
-            if (regs_[iw.rs] == 0xFFFF)
-              SR.ds--;
-            break;
-          case 30:
-            addr = (SR.ds << 16) | regs_[iw.rs]++;
-            if (regs_[iw.rs] == 0x0000)
-              SR.ds++;
-            break;
-          case 31:
-            if (++regs_[iw.rs] == 0x0000)
-              SR.ds++;
-            addr = SR.ds << 16 | regs_[iw.rs];
-            break;
-        }
+      case 0 ... 7:
+        insn.handler = iw.rd == REG_PC ? &Cpu::OpBranchForward : &Cpu::OpBpImm6;
+        break;
+      case 8 ... 15:
+        insn.handler = iw.rd == REG_PC ? &Cpu::OpBranchBackward : &Cpu::OpImm6;
+        break;
+      case 16 ... 23:
+        insn.handler = &Cpu::OpPushPop;
+        break;
+      case 24 ... 31:
+        insn.handler = &Cpu::OpIndirect;
+        break;
+      case 32:
+        insn.handler = &Cpu::OpRegister;
+        break;
+      case 33:
+        insn.handler = &Cpu::OpImm16;
+        has_imm = true;
+        break;
+      case 34:
+        insn.handler = &Cpu::OpDirect16;
+        has_imm = true;
+        break;
+      case 35:
+        insn.handler = &Cpu::OpDirect16Store;
+        has_imm = true;
+        break;
+      case 36 ... 39:
+        insn.handler = &Cpu::OpAsr;
+        break;
+      case 40 ... 43:
+        insn.handler = &Cpu::OpLsl;
+        break;
+      case 44 ... 47:
+        insn.handler = &Cpu::OpLsr;
+        break;
+      case 48 ... 51:
+        insn.handler = &Cpu::OpRol;
+        break;
+      case 52 ... 55:
+        insn.handler = &Cpu::OpRor;
+        break;
+      case 56 ... 63:
+        insn.handler = &Cpu::OpDirect6;
+        break;
+    }
+  }
 
-        if (iw.op0 != ALUOP_STORE) {
-          word_t value = bus_.ReadWord(addr);
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          bus_.WriteWord(addr, regs_[iw.rd]);
-        }
+  const addr_t imm_addr = (addr + 1) & 0x3fffff;
+  insn.imm = has_imm ? bus_.ReadWord(imm_addr) : 0;
 
-        return iw.rd == REG_PC ? 7 : 6;
-      }
-      case 32:  // register
-      {
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], regs_[iw.rd], regs_[iw.rs], iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempting to store using register mode");
-        }
-        return iw.rd == REG_PC ? 5 : 3;
-      }
-      case 33:  // imm16
-      {
-        const word_t rs_val = regs_[iw.rs];
-        const word_t imm = ReadWordFromPc();
-
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], rs_val, imm, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempting to store using immediate mode");
-        }
-        return iw.rd == REG_PC ? 5 : 4;
-      }
-      case 34:  // [imm16]
-      {
-        const word_t rs_val = regs_[iw.rs];
-        const word_t addr = ReadWordFromPc();
-
-        if (iw.op0 != ALUOP_STORE) {
-          const word_t value = bus_.ReadWord(addr);
-          AluOp(regs_[iw.rd], rs_val, value, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempts to store using [imm16] read mode");
-        }
-        return iw.rd == REG_PC ? 8 : 7;
-      }
-      case 35:  // [imm16] store
-      {
-        const word_t rs_val = regs_[iw.rs];
-        const word_t rd_val = regs_[iw.rd];
-        const word_t addr = ReadWordFromPc();
-
-        if (iw.op0 != ALUOP_STORE) {
-          word_t result = 0;
-          AluOp(result, rs_val, rd_val, iw.op0, iw.rd != REG_PC);
-          bus_.WriteWord(addr, result);
-        } else {
-          bus_.WriteWord(addr, rs_val);
-        }
+  const bool cacheable = IsCacheable(addr) && (!has_imm || IsCacheable(imm_addr));
+  insn.addr = cacheable ? addr : kInvalidAddr;
+}
 
-        return iw.rd == REG_PC ? 8 : 7;
-      }
-      case 36 ... 39:  // register with arithmetic shift right
-      {
-        uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
-        const int n = (iw.opn & 0x03) + 1;
-
-        const int shift = sext<20>((regs_[iw.rs] << 4) | cur_sb) >> n;
-        const word_t value = (shift >> 4) & 0xffff;
-        cur_sb = shift & 0xf;
-
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempts to store using shift mode");
-        }
-        return iw.rd == REG_PC ? 5 : 3;
-      }
-      case 40 ... 43:  // register with logical shift left
-      {
-        uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
-        const int n = (iw.opn & 0x03) + 1;
-
-        const unsigned shift = ((cur_sb << 16) | regs_[iw.rs]) << n;
-        const word_t value = shift & 0xffff;
-        cur_sb = (shift >> 16) & 0xf;
-
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempts to store using shift mode");
-        }
-        return iw.rd == REG_PC ? 5 : 3;
-      }
-      case 44 ... 47:  // register with logical shift right
-      {
-        uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
-        const int n = (iw.opn & 0x03) + 1;
-
-        const unsigned shift = ((regs_[iw.rs] << 4) | cur_sb) >> n;
-        const word_t value = (shift >> 4) & 0xffff;
-        cur_sb = shift & 0xf;
-
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempts to store using shift mode");
-        }
-        return iw.rd == REG_PC ? 5 : 3;
-      }
-      case 48 ... 51:  // register with rotate left
-      {
-        uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
-        const int n = (iw.opn & 0x03) + 1;
-
-        const unsigned shift = rotl<20>((cur_sb << 16) | regs_[iw.rs], n);
-        const word_t value = shift & 0xffff;
-        cur_sb = (shift >> 16) & 0xf;
-
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempts to store using shift mode");
-        }
-        return iw.rd == REG_PC ? 5 : 3;
-      }
-      case 52 ... 55:  // register with rotate right
-      {
-        uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
-        const int n = (iw.opn & 0x03) + 1;
-
-        const unsigned shift = rotr<20>((regs_[iw.rs] << 4) | cur_sb, n);
-        const word_t value = (shift >> 4) & 0xffff;
-        cur_sb = shift & 0xf;
-
-        if (iw.op0 != ALUOP_STORE) {
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          die("Attempts to store using shift mode");
-        }
-        return iw.rd == REG_PC ? 5 : 3;
-      }
-      case 56 ... 63:  // [A6]
-      {
-        if (iw.op0 != ALUOP_STORE) {
-          const word_t value = bus_.ReadWord(iw.imm6);
-          AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
-        } else {
-          bus_.WriteWord(iw.imm6, regs_[iw.rd]);
-        }
-        return iw.rd == REG_PC ? 6 : 5;
-      }
+inline word_t Cpu::ReadImmediate(const DecodedInstruction& insn) {
+  SetCsPc(GetCsPc() + 1);
+  return insn.imm;
+}
+
+int Cpu::OpInvalid(const DecodedInstruction& insn) {
+  die("Unknown instruction");
+}
+
+int Cpu::OpMulUs(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const unsigned result = regs_[iw.rd] * static_cast<int16_t>(regs_[iw.rs]);
+  regs_[REG_R3] = result & 0xffff;
+  regs_[REG_R4] = (result >> 16) & 0xffff;
+  return 12;
+}
+
+int Cpu::OpCall(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const addr_t new_pc = (iw.imm6 << 16) | ReadImmediate(insn);
+  PushWord(regs_[REG_SP], regs_[REG_PC]);
+  PushWord(regs_[REG_SP], regs_[REG_SR]);
+  SetCsPc(new_pc);
+  return 9;
+}
+
+int Cpu::OpGoto(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const addr_t new_pc = (iw.imm6 << 16) | ReadImmediate(insn);
+  SetCsPc(new_pc);
+  return 5;
+}
+
+int Cpu::OpMulsUs(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const int n = iw.muls_n ? iw.muls_n : 16;
+  int64_t sum = 0;
+
+  word_t old_val1 = 0;
+  for (int i = 0; i < n; i++) {
+    word_t val1 = bus_.ReadWord(regs_[iw.rd]);
+    word_t val2 = bus_.ReadWord(regs_[iw.rs]);
+    sum += val1 * static_cast<int16_t>(val2);
+
+    if (fir_mov_) {
+      if (i > 0)
+        bus_.WriteWord(regs_[iw.rd], old_val1);
+      old_val1 = val1;
+    }
+
+    regs_[iw.rd]++;
+    regs_[iw.rs]++;
+  }
+
+  regs_[REG_R3] = sum & 0xffff;
+  regs_[REG_R4] = (sum >> 16) & 0xffff;
+  return 10 * n + 6;
+}
+
+int Cpu::OpMulSs(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const unsigned result = static_cast<int16_t>(regs_[iw.rd]) * static_cast<int16_t>(regs_[iw.rs]);
+
+  regs_[REG_R3] = result & 0xffff;
+  regs_[REG_R4] = (result >> 16) & 0xffff;
+  return 12;
+}
+
+int Cpu::OpSystem(const DecodedInstruction& insn) {  // irq control, break, other settings
+  const Instruction iw{insn.raw};
+  switch (iw.imm6) {
+    case 0 ... 3:
+      irq_enable_ = (iw.imm6 & 1);
+      fiq_enable_ = (iw.imm6 & 2);
+      return 2;
+    case 4 ... 5:
+      fir_mov_ = !(iw.imm6 & 1);
+      return 2;
+    case 8 ... 9:
+      irq_enable_ = (iw.imm6 & 1);
+      return 2;
+    case 12:
+    case 14:
+      fiq_enable_ = (iw.imm6 & 2);
+      return 2;
+    case 32:
+    case 40:
+    case 48:
+    case 56:  // break
+      PushWord(regs_[REG_SP], regs_[REG_PC]);
+      PushWord(regs_[REG_SP], regs_[REG_SR]);
+      regs_[REG_PC] = bus_.ReadWord(0xfff5);
+      regs_[REG_SR] = 0;
+      return 10;
+    case 37:  // nop
+      return 2;
+    default:
+      die("Unknown instruction");
+      return 0;
+  }
+}
+
+int Cpu::OpMulsSs(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const int n = iw.muls_n ? iw.muls_n : 16;
+  int64_t sum = 0;
+
+  word_t old_val1 = 0;
+  for (int i = 0; i < n; i++) {
+    word_t val1 = bus_.ReadWord(regs_[iw.rd]);
+    word_t val2 = bus_.ReadWord(regs_[iw.rs]);
+    sum += static_cast<int16_t>(val1) * static_cast<int16_t>(val2);
+
+    if (fir_mov_) {
+      if (i > 0)
+        bus_.WriteWord(regs_[iw.rd], old_val1);
+      old_val1 = val1;
+    }
+
+    regs_[iw.rd]++;
+    regs_[iw.rs]++;
+  }
+
+  regs_[REG_R3] = sum & 0xffff;
+  regs_[REG_R4] = (sum >> 16) & 0xffff;
+  return 10 * n + 6;
+}
+
+int Cpu::OpBranchForward(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const bool do_branch = CheckBranch(iw.op0);
+  if (do_branch) {
+    const addr_t cs_pc = GetCsPc();
+    SetCsPc(cs_pc + iw.imm6);
+  }
+  return do_branch ? 4 : 2;
+}
+
+int Cpu::OpBranchBackward(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const bool do_branch = CheckBranch(iw.op0);
+  if (do_branch) {
+    const addr_t cs_pc = GetCsPc();
+    SetCsPc(cs_pc - iw.imm6);
+  }
+  return do_branch ? 4 : 2;
+}
+
+int Cpu::OpBpImm6(const DecodedInstruction& insn) {  // [bp+imm6]
+  const Instruction iw{insn.raw};
+  const addr_t addr = regs_[REG_BP] + iw.imm6;
+  if (iw.op0 != ALUOP_STORE) {
+    const word_t value = bus_.ReadWord(addr);
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    bus_.WriteWord(addr, regs_[iw.rd]);
+  }
+  return 6;
+}
+
+int Cpu::OpImm6(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], iw.imm6, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempting to store using immediate addressing mode");
+  }
+  return 2;
+}
+
+int Cpu::OpPushPop(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  int n = iw.opn;
+  int reg = iw.rd;
+
+  if (iw.op0 == ALUOP_LOAD)  // pop / reti (pseudo-op)
+  {
+    // special encoding for reti
+    if (iw.rd == REG_BP && iw.opn == 3 && iw.rs == REG_SP) {
+      if (fiq_)
+        fiq_ = false;
+      else if (irq_)
+        irq_ = false;
+      n = 2;  // otherwise handle like usual
+    }
+
+    int left = n;
+    while (left-- && (reg + 1) <= 7) {
+      regs_[++reg] = PopWord(regs_[iw.rs]);
+    }
+  } else if (iw.op0 == ALUOP_STORE) {
+    int left = n;
+    while (left-- && reg >= 0) {
+      PushWord(regs_[iw.rs], regs_[reg--]);
     }
+  } else {
+    die("Attempting to push/pop using invalid alu op");
   }
+  return 2 * n + 4;
+}
+
+int Cpu::OpIndirect(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  addr_t addr = 0;
+  switch (iw.op1n) {
+    case 24:
+      addr = regs_[iw.rs];
+      break;
+    case 25:
+      addr = regs_[iw.rs]--;
+      break;
+    case 26:
+      addr = regs_[iw.rs]++;
+      break;
+    case 27:
+      addr = ++regs_[iw.rs];
+      break;
+    case 28:
+      addr = (SR.ds << 16) | regs_[iw.rs];
+      break;
+    case 29:
+      addr = (SR.ds << 16) | regs_[iw.rs]--;
+      if (regs_[iw.rs] == 0xFFFF)
+        SR.ds--;
+      break;
+    case 30:
+      addr = (SR.ds << 16) | regs_[iw.rs]++;
+      if (regs_[iw.rs] == 0x0000)
+        SR.ds++;
+      break;
+    case 31:
+      if (++regs_[iw.rs] == 0x0000)
+        SR.ds++;
+      addr = SR.ds << 16 | regs_[iw.rs];
+      break;
+  }
+
+  if (iw.op0 != ALUOP_STORE) {
+    word_t value = bus_.ReadWord(addr);
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    bus_.WriteWord(addr, regs_[iw.rd]);
+  }
+
+  return iw.rd == REG_PC ? 7 : 6;
+}
+
+int Cpu::OpRegister(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], regs_[iw.rs], iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempting to store using register mode");
+  }
+  return iw.rd == REG_PC ? 5 : 3;
+}
+
+int Cpu::OpImm16(const DecodedInstruction& insn) {
+  const Instruction iw{insn.raw};
+  const word_t rs_val = regs_[iw.rs];
+  const word_t imm = ReadImmediate(insn);
+
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], rs_val, imm, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempting to store using immediate mode");
+  }
+  return iw.rd == REG_PC ? 5 : 4;
+}
 
-  return 1;
+int Cpu::OpDirect16(const DecodedInstruction& insn) {  // [imm16]
+  const Instruction iw{insn.raw};
+  const word_t rs_val = regs_[iw.rs];
+  const word_t addr = ReadImmediate(insn);
+
+  if (iw.op0 != ALUOP_STORE) {
+    const word_t value = bus_.ReadWord(addr);
+    AluOp(regs_[iw.rd], rs_val, value, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempts to store using [imm16] read mode");
+  }
+  return iw.rd == REG_PC ? 8 : 7;
+}
+
+int Cpu::OpDirect16Store(const DecodedInstruction& insn) {  // [imm16] store
+  const Instruction iw{insn.raw};
+  const word_t rs_val = regs_[iw.rs];
+  const word_t rd_val = regs_[iw.rd];
+  const word_t addr = ReadImmediate(insn);
+
+  if (iw.op0 != ALUOP_STORE) {
+    word_t result = 0;
+    AluOp(result, rs_val, rd_val, iw.op0, iw.rd != REG_PC);
+    bus_.WriteWord(addr, result);
+  } else {
+    bus_.WriteWord(addr, rs_val);
+  }
+
+  return iw.rd == REG_PC ? 8 : 7;
+}
+
+int Cpu::OpAsr(const DecodedInstruction& insn) {  // register with arithmetic shift right
+  const Instruction iw{insn.raw};
+  uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
+  const int n = (iw.opn & 0x03) + 1;
+
+  const int shift = sext<20>((regs_[iw.rs] << 4) | cur_sb) >> n;
+  const word_t value = (shift >> 4) & 0xffff;
+  cur_sb = shift & 0xf;
+
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempts to store using shift mode");
+  }
+  return iw.rd == REG_PC ? 5 : 3;
+}
+
+int Cpu::OpLsl(const DecodedInstruction& insn) {  // register with logical shift left
+  const Instruction iw{insn.raw};
+  uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
+  const int n = (iw.opn & 0x03) + 1;
+
+  const unsigned shift = ((cur_sb << 16) | regs_[iw.rs]) << n;
+  const word_t value = shift & 0xffff;
+  cur_sb = (shift >> 16) & 0xf;
+
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempts to store using shift mode");
+  }
+  return iw.rd == REG_PC ? 5 : 3;
+}
+
+int Cpu::OpLsr(const DecodedInstruction& insn) {  // register with logical shift right
+  const Instruction iw{insn.raw};
+  uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
+  const int n = (iw.opn & 0x03) + 1;
+
+  const unsigned shift = ((regs_[iw.rs] << 4) | cur_sb) >> n;
+  const word_t value = (shift >> 4) & 0xffff;
+  cur_sb = shift & 0xf;
+
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempts to store using shift mode");
+  }
+  return iw.rd == REG_PC ? 5 : 3;
+}
+
+int Cpu::OpRol(const DecodedInstruction& insn) {  // register with rotate left
+  const Instruction iw{insn.raw};
+  uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
+  const int n = (iw.opn & 0x03) + 1;
+
+  const unsigned shift = rotl<20>((cur_sb << 16) | regs_[iw.rs], n);
+  const word_t value = shift & 0xffff;
+  cur_sb = (shift >> 16) & 0xf;
+
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempts to store using shift mode");
+  }
+  return iw.rd == REG_PC ? 5 : 3;
+}
+
+int Cpu::OpRor(const DecodedInstruction& insn) {  // register with rotate right
+  const Instruction iw{insn.raw};
+  uint8_t& cur_sb = sb_[fiq_ ? 2 : irq_];
+  const int n = (iw.opn & 0x03) + 1;
+
+  const unsigned shift = rotr<20>((regs_[iw.rs] << 4) | cur_sb, n);
+  const word_t value = (shift >> 4) & 0xffff;
+  cur_sb = shift & 0xf;
+
+  if (iw.op0 != ALUOP_STORE) {
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    die("Attempts to store using shift mode");
+  }
+  return iw.rd == REG_PC ? 5 : 3;
+}
+
+int Cpu::OpDirect6(const DecodedInstruction& insn) {  // [A6]
+  const Instruction iw{insn.raw};
+  if (iw.op0 != ALUOP_STORE) {
+    const word_t value = bus_.ReadWord(iw.imm6);
+    AluOp(regs_[iw.rd], regs_[iw.rd], value, iw.op0, iw.rd != REG_PC);
+  } else {
+    bus_.WriteWord(iw.imm6, regs_[iw.rd]);
+  }
+  return iw.rd == REG_PC ? 6 : 5;
 }
 
 void Cpu::SetIrq(int irq, bool val) {
@@ -4,19 +4,21 @@
 #include <bitset>
 #include <cstdint>
 
+#include "bus.h"
 #include "core/common.h"
 
-class BusInterface;
+class StateSerializer;
 
 class Cpu {
 public:
-  Cpu(BusInterface& bus);
+  Cpu(Bus& bus);
 
   int Step();
   void SetIrq(int irq, bool value);
   void SetFiq(bool value);
 
   void Reset();
+  void Serialize(StateSerializer& state);
 
   word_t GetDs();
   void SetDs(word_t val);
@@ -24,7 +26,65 @@ public:
 
   void PrintRegisterState();
 
+  // Drops cached decodings that may cover addr (either as the opcode word or as
+  // the immediate word of the preceding instruction). Must be called for every
+  // write to memory that the CPU can execute from.
+  inline void InvalidateDecodeCache(addr_t addr) {
+    DecodedInstruction& insn = decode_cache_[addr & (kDecodeCacheSize - 1)];
+    if (insn.addr == addr)
+      insn.addr = kInvalidAddr;
+    const addr_t prev_addr = (addr - 1) & 0x3fffff;
+    DecodedInstruction& prev_insn = decode_cache_[prev_addr & (kDecodeCacheSize - 1)];
+    if (prev_insn.addr == prev_addr)
+      prev_insn.addr = kInvalidAddr;
+  }
+  // Drops all cached decodings, e.g. when the external memory map changes.
+  void FlushDecodeCache();
+
 private:
+  struct DecodedInstruction;
+  using Handler = int (Cpu::*)(const DecodedInstruction& insn);
+
+  struct DecodedInstruction {
+    addr_t addr;
+    word_t raw;
+    word_t imm;
+    Handler handler;
+  };
+
+  static constexpr addr_t kInvalidAddr = ~addr_t{0};
+  static constexpr std::size_t kDecodeCacheSize = 1 << 14;
+
+  static inline bool IsCacheable(addr_t addr) { return addr < 0x2800 || addr >= 0x4000; }
+
+  void Decode(DecodedInstruction& insn, addr_t addr);
+  word_t ReadImmediate(const DecodedInstruction& insn);
+
+  int OpInvalid(const DecodedInstruction& insn);
+  int OpMulUs(const DecodedInstruction& insn);
+  int OpCall(const DecodedInstruction& insn);
+  int OpGoto(const DecodedInstruction& insn);
+  int OpMulsUs(const DecodedInstruction& insn);
+  int OpMulSs(const DecodedInstruction& insn);
+  int OpSystem(const DecodedInstruction& insn);
+  int OpMulsSs(const DecodedInstruction& insn);
+  int OpBranchForward(const DecodedInstruction& insn);
+  int OpBranchBackward(const DecodedInstruction& insn);
+  int OpBpImm6(const DecodedInstruction& insn);
+  int OpImm6(const DecodedInstruction& insn);
+  int OpPushPop(const DecodedInstruction& insn);
+  int OpIndirect(const DecodedInstruction& insn);
+  int OpRegister(const DecodedInstruction& insn);
+  int OpImm16(const DecodedInstruction& insn);
+  int OpDirect16(const DecodedInstruction& insn);
+  int OpDirect16Store(const DecodedInstruction& insn);
+  int OpAsr(const DecodedInstruction& insn);
+  int OpLsl(const DecodedInstruction& insn);
+  int OpLsr(const DecodedInstruction& insn);
+  int OpRol(const DecodedInstruction& insn);
+  int OpRor(const DecodedInstruction& insn);
+  int OpDirect6(const DecodedInstruction& insn);
+
   void AluOp(word_t& save, word_t val1, word_t val2, int alu_op, bool update_flags);
   void UpdateNz(uint32_t result);
   void UpdateNzsc(uint32_t result, int32_t result_signed);
@@ -37,7 +97,7 @@ private:
 
   void SetCsPc(addr_t val);
 
-  BusInterface& bus_;
+  Bus& bus_;
 
   std::array<uint16_t, 8> regs_;
   std::array<uint8_t, 3> sb_;  // 0 - normal, 1 - irq, 2 - fiq (fiq ? 2 : irq)
@@ -48,4 +108,6 @@ private:
   bool irq_, fiq_;
   bool irq_enable_, fiq_enable_;
   bool fir_mov_;
+
+  std::array<DecodedInstruction, kDecodeCacheSize> decode_cache_;
 };
\ No newline at end of file
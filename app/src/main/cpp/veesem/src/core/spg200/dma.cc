@@ -1,8 +1,9 @@
 #include "dma.h"
 
-#include "bus_interface.h"
+#include "core/state_serializer.h"
+#include "spg200.h"
 
-Dma::Dma(BusInterface& bus) : bus_(bus){};
+Dma::Dma(Bus& bus) : bus_(bus){};
 
 void Dma::Reset() {
   source_ = 0;
@@ -10,6 +11,15 @@ void Dma::Reset() {
   length_ = 0;
 }
 
+void Dma::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("DMA ", 1))
+    return;
+  state.Value(source_);
+  state.Value(target_);
+  state.Value(length_);
+  state.EndChunk();
+}
+
 word_t Dma::GetSourceLo() {
   return source_ & 0xffff;
 }
@@ -1,14 +1,16 @@
 #pragma once
 
+#include "bus.h"
 #include "core/common.h"
 
-class BusInterface;
+class StateSerializer;
 
 class Dma {
 public:
-  Dma(BusInterface& bus);
+  Dma(Bus& bus);
 
   void Reset();
+  void Serialize(StateSerializer& state);
 
   word_t GetSourceHi();
   void SetSourceHi(word_t value);
@@ -23,5 +25,5 @@ private:
   addr_t source_ = 0;
   word_t target_ = 0;
   word_t length_ = 0;
-  BusInterface& bus_;
+  Bus& bus_;
 };
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include "extmem.h"
 
+#include "core/state_serializer.h"
 #include "spg200_io.h"
 
 Extmem::Extmem(Spg200Io& io) : io_(io) {}
@@ -9,6 +10,13 @@ void Extmem::Reset() {
   ctrl_.bus_arbiter = 5;
 }
 
+void Extmem::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("EXTM", 1))
+    return;
+  state.Value(ctrl_.raw);
+  state.EndChunk();
+}
+
 void Extmem::SetControl(uint16_t value) {
   ctrl_.raw = value & ExternalMemControl::WriteMask;
 }
@@ -82,4 +90,71 @@ void Extmem::WriteWord(addr_t addr, word_t value) {
       }
       break;
   }
-}
\ No newline at end of file
+}
+const word_t* Extmem::GetReadPtr(addr_t addr) {
+  switch (ctrl_.address_decode) {
+    case 0:
+      return io_.GetRomCsbReadPtr(addr);
+    case 1:
+      switch (addr >> 21) {
+        case 0:
+          return io_.GetRomCsbReadPtr(addr & 0x1fffff);
+        case 1:
+          return io_.GetCsb1ReadPtr(addr & 0x1fffff);
+        default:
+          __builtin_unreachable();
+      }
+      break;
+    case 2:
+    case 3:
+      switch (addr >> 20) {
+        case 0:
+          return io_.GetRomCsbReadPtr(addr & 0x0fffff);
+        case 1:
+          return io_.GetCsb1ReadPtr(addr & 0x0fffff);
+        case 2:
+          return io_.GetCsb2ReadPtr(addr & 0x0fffff);
+        case 3:
+          return io_.GetCsb3ReadPtr(addr & 0x0fffff);
+        default:
+          __builtin_unreachable();
+      }
+    default:
+      __builtin_unreachable();
+      break;
+  }
+  return nullptr;
+}
+
+word_t* Extmem::GetWritePtr(addr_t addr) {
+  switch (ctrl_.address_decode) {
+    case 0:
+      return io_.GetRomCsbWritePtr(addr);
+    case 1:
+      switch (addr >> 21) {
+        case 0:
+          return io_.GetRomCsbWritePtr(addr & 0x1ffff);
+        case 1:
+          return io_.GetCsb1WritePtr(addr & 0x1fffff);
+        default:
+          __builtin_unreachable();
+      }
+      break;
+    case 2:
+    case 3:
+      switch (addr >> 20) {
+        case 0:
+          return io_.GetRomCsbWritePtr(addr & 0x0fffff);
+        case 1:
+          return io_.GetCsb1WritePtr(addr & 0x0fffff);
+        case 2:
+          return io_.GetCsb2WritePtr(addr & 0x0fffff);
+        case 3:
+          return io_.GetCsb3WritePtr(addr & 0x0fffff);
+        default:
+          __builtin_unreachable();
+      }
+      break;
+  }
+  return nullptr;
+}
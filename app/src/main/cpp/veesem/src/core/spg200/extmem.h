@@ -6,12 +6,14 @@
 #include "core/common.h"
 
 class Spg200Io;
+class StateSerializer;
 
 class Extmem {
 public:
   Extmem(Spg200Io& io);
 
   void Reset();
+  void Serialize(StateSerializer& state);
 
   word_t GetControl();
   void SetControl(word_t value);
@@ -19,6 +21,9 @@ public:
   word_t ReadWord(addr_t addr);
   void WriteWord(addr_t addr, word_t value);
 
+  const word_t* GetReadPtr(addr_t addr);
+  word_t* GetWritePtr(addr_t addr);
+
 private:
   union ExternalMemControl {
     word_t raw;
@@ -1,13 +1,28 @@
 #include "gpio.h"
 
+#include "core/state_serializer.h"
 #include "spg200_io.h"
 
 Gpio::Gpio(Spg200Io& io) : io_(io) {}
 
 void Gpio::Reset() {
+  mode_.raw = 0;
   ports_.fill({});
 }
 
+void Gpio::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("GPIO", 1))
+    return;
+  state.Value(mode_.raw);
+  for (auto& port : ports_) {
+    state.Value(port.buffer);
+    state.Value(port.dir);
+    state.Value(port.attrib);
+    state.Value(port.mask);
+  }
+  state.EndChunk();
+}
+
 word_t Gpio::GetMode() {
   return mode_.raw;
 }
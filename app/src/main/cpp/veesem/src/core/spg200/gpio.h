@@ -5,11 +5,13 @@
 #include "core/common.h"
 
 class Spg200Io;
+class StateSerializer;
 
 class Gpio {
 public:
   Gpio(Spg200Io& vsmile_io);
   void Reset();
+  void Serialize(StateSerializer& state);
 
   word_t GetMode();
   void SetMode(word_t value);
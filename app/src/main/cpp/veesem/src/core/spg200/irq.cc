@@ -1,5 +1,6 @@
 #include "irq.h"
 
+#include "core/state_serializer.h"
 #include "cpu.h"
 
 Irq::Irq(Cpu& cpu) : cpu_(cpu){};
@@ -12,6 +13,17 @@ void Irq::Reset() {
   spu_channel_active_ = false;
 }
 
+void Irq::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("IRQ ", 1))
+    return;
+  state.Value(io_irq_ctrl_.raw);
+  state.Value(io_irq_status_.raw);
+  state.Value(fiq_select_);
+  state.Value(ppu_active_);
+  state.Value(spu_channel_active_);
+  state.EndChunk();
+}
+
 word_t Irq::GetIoIrqControl() {
   return io_irq_ctrl_.raw;
 }
@@ -3,12 +3,14 @@
 #include "core/common.h"
 
 class Cpu;
+class StateSerializer;
 
 class Irq {
 public:
   Irq(Cpu& cpu);
 
   void Reset();
+  void Serialize(StateSerializer& state);
 
   word_t GetIoIrqControl();
   void SetIoIrqControl(word_t value);
@@ -0,0 +1,167 @@
+#include "pixel_convert.h"
+
+#include <cstring>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+inline uint16_t ClearTransparent(uint16_t pixel) {
+  return (pixel & 0x8000) ? 0 : pixel;
+}
+
+inline uint32_t Expand5To8(uint32_t value) {
+  return (value << 3) | (value >> 2);
+}
+
+inline void StoreScalar16(uint8_t* dst, uint16_t value) {
+  std::memcpy(dst, &value, sizeof(value));
+}
+
+inline void Store8888Scalar(uint8_t* dst, uint16_t pixel, bool bgra) {
+  pixel = ClearTransparent(pixel);
+  const uint8_t r = Expand5To8((pixel >> 10) & 0x1f);
+  const uint8_t g = Expand5To8((pixel >> 5) & 0x1f);
+  const uint8_t b = Expand5To8(pixel & 0x1f);
+  dst[0] = bgra ? b : r;
+  dst[1] = g;
+  dst[2] = bgra ? r : b;
+  dst[3] = 0xff;
+}
+
+// Each vector kernel handles a multiple of 8 pixels and returns how many it
+// converted; the scalar loops take care of the rest.
+#if defined(__ARM_NEON)
+inline uint16x8_t LoadOpaque(const uint16_t* src) {
+  const uint16x8_t pixels = vld1q_u16(src);
+  const uint16x8_t transparent =
+      vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(pixels), 15));
+  return vbicq_u16(pixels, transparent);
+}
+
+std::size_t ConvertRGB555Vector(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    vst1q_u8(dst + i * 2, vreinterpretq_u8_u16(LoadOpaque(src + i)));
+  return i;
+}
+
+std::size_t ConvertRGB565Vector(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint16x8_t pixels = LoadOpaque(src + i);
+    const uint16x8_t rg = vshlq_n_u16(vandq_u16(pixels, vdupq_n_u16(0x7fe0)), 1);
+    const uint16x8_t g_low = vshrq_n_u16(vandq_u16(pixels, vdupq_n_u16(0x0200)), 4);
+    const uint16x8_t b = vandq_u16(pixels, vdupq_n_u16(0x001f));
+    vst1q_u8(dst + i * 2, vreinterpretq_u8_u16(vorrq_u16(vorrq_u16(rg, g_low), b)));
+  }
+  return i;
+}
+
+inline uint8x8_t Expand5To8(uint16x8_t value) {
+  const uint16x8_t component = vandq_u16(value, vdupq_n_u16(0x1f));
+  return vmovn_u16(vorrq_u16(vshlq_n_u16(component, 3), vshrq_n_u16(component, 2)));
+}
+
+std::size_t Convert8888Vector(const uint16_t* src, uint8_t* dst, std::size_t count, bool bgra) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const uint16x8_t pixels = LoadOpaque(src + i);
+    const uint8x8_t r = Expand5To8(vshrq_n_u16(pixels, 10));
+    const uint8x8_t g = Expand5To8(vshrq_n_u16(pixels, 5));
+    const uint8x8_t b = Expand5To8(pixels);
+    uint8x8x4_t out;
+    out.val[0] = bgra ? b : r;
+    out.val[1] = g;
+    out.val[2] = bgra ? r : b;
+    out.val[3] = vdup_n_u8(0xff);
+    vst4_u8(dst + i * 4, out);
+  }
+  return i;
+}
+#elif defined(__SSE2__)
+inline __m128i LoadOpaque(const uint16_t* src) {
+  const __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+  return _mm_andnot_si128(_mm_srai_epi16(pixels, 15), pixels);
+}
+
+std::size_t ConvertRGB555Vector(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2), LoadOpaque(src + i));
+  return i;
+}
+
+std::size_t ConvertRGB565Vector(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i pixels = LoadOpaque(src + i);
+    const __m128i rg = _mm_slli_epi16(_mm_and_si128(pixels, _mm_set1_epi16(0x7fe0)), 1);
+    const __m128i g_low = _mm_srli_epi16(_mm_and_si128(pixels, _mm_set1_epi16(0x0200)), 4);
+    const __m128i b = _mm_and_si128(pixels, _mm_set1_epi16(0x001f));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 2),
+                     _mm_or_si128(_mm_or_si128(rg, g_low), b));
+  }
+  return i;
+}
+
+inline __m128i Expand5To8(__m128i value) {
+  const __m128i component = _mm_and_si128(value, _mm_set1_epi16(0x1f));
+  return _mm_or_si128(_mm_slli_epi16(component, 3), _mm_srli_epi16(component, 2));
+}
+
+std::size_t Convert8888Vector(const uint16_t* src, uint8_t* dst, std::size_t count, bool bgra) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    const __m128i pixels = LoadOpaque(src + i);
+    const __m128i r = Expand5To8(_mm_srli_epi16(pixels, 10));
+    const __m128i g = Expand5To8(_mm_srli_epi16(pixels, 5));
+    const __m128i b = Expand5To8(pixels);
+    // 16-bit lanes holding bytes 0-1 and 2-3 of each output pixel
+    const __m128i low = _mm_or_si128(bgra ? b : r, _mm_slli_epi16(g, 8));
+    const __m128i high = _mm_or_si128(bgra ? r : b, _mm_set1_epi16(static_cast<short>(0xff00)));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4), _mm_unpacklo_epi16(low, high));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i * 4 + 16), _mm_unpackhi_epi16(low, high));
+  }
+  return i;
+}
+#else
+std::size_t ConvertRGB555Vector(const uint16_t*, uint8_t*, std::size_t) {
+  return 0;
+}
+
+std::size_t ConvertRGB565Vector(const uint16_t*, uint8_t*, std::size_t) {
+  return 0;
+}
+
+std::size_t Convert8888Vector(const uint16_t*, uint8_t*, std::size_t, bool) {
+  return 0;
+}
+#endif
+}  // namespace
+
+void ConvertRGB555(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  for (std::size_t i = ConvertRGB555Vector(src, dst, count); i < count; i++)
+    StoreScalar16(dst + i * 2, ClearTransparent(src[i]));
+}
+
+void ConvertRGB555ToRGB565(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  for (std::size_t i = ConvertRGB565Vector(src, dst, count); i < count; i++) {
+    const uint16_t pixel = ClearTransparent(src[i]);
+    StoreScalar16(dst + i * 2,
+                  ((pixel & 0x7fe0) << 1) | ((pixel & 0x0200) >> 4) | (pixel & 0x001f));
+  }
+}
+
+void ConvertRGB555ToRGBA8888(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  for (std::size_t i = Convert8888Vector(src, dst, count, false); i < count; i++)
+    Store8888Scalar(dst + i * 4, src[i], false);
+}
+
+void ConvertRGB555ToBGRA8888(const uint16_t* src, uint8_t* dst, std::size_t count) {
+  for (std::size_t i = Convert8888Vector(src, dst, count, true); i < count; i++)
+    Store8888Scalar(dst + i * 4, src[i], true);
+}
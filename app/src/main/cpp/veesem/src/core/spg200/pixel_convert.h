@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Conversion of PPU scanlines from RGB555 to the host output formats. Source
+// pixels with bit 15 (transparent) set come out as opaque black. Destinations
+// need no particular alignment.
+void ConvertRGB555(const uint16_t* src, uint8_t* dst, std::size_t count);
+void ConvertRGB555ToRGB565(const uint16_t* src, uint8_t* dst, std::size_t count);
+void ConvertRGB555ToRGBA8888(const uint16_t* src, uint8_t* dst, std::size_t count);
+void ConvertRGB555ToBGRA8888(const uint16_t* src, uint8_t* dst, std::size_t count);
@@ -0,0 +1,98 @@
+// Checks every conversion against a plain per-pixel version, for all 65536
+// source pixels and for every length up to a few vectors at unaligned
+// destinations, which also catches writes past the end.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "core/testing.h"
+#include "pixel_convert.h"
+
+namespace {
+using ConvertFn = void (*)(const uint16_t*, uint8_t*, std::size_t);
+
+constexpr uint8_t kGuard = 0xa5;
+
+uint8_t Expand(unsigned component) {
+  return static_cast<uint8_t>((component << 3) | (component >> 2));
+}
+
+// Writes the expected output of one pixel, returning its size in bytes
+std::size_t Reference(ConvertFn convert, uint16_t pixel, uint8_t* dst) {
+  if (pixel & 0x8000)
+    pixel = 0;
+  const unsigned r = (pixel >> 10) & 0x1f;
+  const unsigned g = (pixel >> 5) & 0x1f;
+  const unsigned b = pixel & 0x1f;
+  if (convert == ConvertRGB555) {
+    std::memcpy(dst, &pixel, 2);
+    return 2;
+  }
+  if (convert == ConvertRGB555ToRGB565) {
+    const uint16_t rgb565 = static_cast<uint16_t>((r << 11) | (((g << 1) | (g >> 4)) << 5) | b);
+    std::memcpy(dst, &rgb565, 2);
+    return 2;
+  }
+  const bool bgra = convert == ConvertRGB555ToBGRA8888;
+  dst[0] = Expand(bgra ? b : r);
+  dst[1] = Expand(g);
+  dst[2] = Expand(bgra ? r : b);
+  dst[3] = 0xff;
+  return 4;
+}
+
+std::vector<uint8_t> Expected(ConvertFn convert, const uint16_t* src, std::size_t count) {
+  std::vector<uint8_t> expected(count * 4);
+  std::size_t size = 0;
+  for (std::size_t i = 0; i < count; i++)
+    size += Reference(convert, src[i], &expected[size]);
+  expected.resize(size);
+  return expected;
+}
+
+void TestAllPixels(ConvertFn convert) {
+  std::vector<uint16_t> src(0x10000);
+  for (std::size_t i = 0; i < src.size(); i++)
+    src[i] = static_cast<uint16_t>(i);
+
+  const std::vector<uint8_t> expected = Expected(convert, src.data(), src.size());
+  std::vector<uint8_t> dst(expected.size());
+  convert(src.data(), dst.data(), src.size());
+  EXPECT(dst == expected);
+}
+
+void TestLengths(ConvertFn convert) {
+  // Transparent, black, white and mixed pixels
+  std::array<uint16_t, 40> src;
+  for (std::size_t i = 0; i < src.size(); i++)
+    src[i] = static_cast<uint16_t>(i * 0x9e37 + (i % 3 == 0 ? 0x8000 : 0));
+  src[1] = 0x7fff;
+
+  for (std::size_t count = 0; count <= src.size(); count++) {
+    for (std::size_t offset = 0; offset < 4; offset++) {
+      const std::vector<uint8_t> expected = Expected(convert, src.data(), count);
+      std::vector<uint8_t> dst(offset + expected.size() + 16, kGuard);
+      convert(src.data(), dst.data() + offset, count);
+
+      bool guards_intact = true;
+      for (std::size_t i = 0; i < offset; i++)
+        guards_intact &= dst[i] == kGuard;
+      for (std::size_t i = offset + expected.size(); i < dst.size(); i++)
+        guards_intact &= dst[i] == kGuard;
+      EXPECT(guards_intact);
+      EXPECT(std::memcmp(dst.data() + offset, expected.data(), expected.size()) == 0);
+    }
+  }
+}
+}  // namespace
+
+int main() {
+  for (ConvertFn convert : {ConvertRGB555, ConvertRGB555ToRGB565, ConvertRGB555ToRGBA8888,
+                            ConvertRGB555ToBGRA8888}) {
+    TestAllPixels(convert);
+    TestLengths(convert);
+  }
+  return TestResult();
+}
@@ -1,7 +1,15 @@
 #include "ppu.h"
 
-#include "bus_interface.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <type_traits>
+
+#include "core/state_serializer.h"
 #include "irq.h"
+#include "pixel_convert.h"
+#include "spg200.h"
+#include "tile_plot.h"
 
 namespace {
 inline addr_t CalculateLineSegmentAddr(word_t segment_ptr, int ch, int tile_y, int tile_width,
@@ -9,30 +17,37 @@ inline addr_t CalculateLineSegmentAddr(word_t segment_ptr, int ch, int tile_y, i
   return (segment_ptr << 6) + (ch * tile_height + tile_y) * tile_width * bits_per_pixel / 16;
 }
 
-inline int BlendInterpolate(int old_value, int new_value, int blend_level) {
-  return (old_value * (4 - (blend_level + 1))) / 4 + (new_value * (blend_level + 1)) / 4;
-}
-
 inline unsigned DivideRoundUp(unsigned dividend, unsigned divisor) {
   return (dividend / divisor) + !!(dividend % divisor);
 }
+
+inline int GetCyclesPerScanline(VideoTiming video_timing) {
+  return (video_timing == VideoTiming::NTSC ? 429 : 432) * 4;
+}
+
+inline int GetScanlinesPerFrame(VideoTiming video_timing) {
+  return video_timing == VideoTiming::NTSC ? 262 : 312;
+}
 }  // namespace
 
-Ppu::Ppu(VideoTiming video_timing, BusInterface& bus, Irq& irq)
+Ppu::Ppu(VideoTiming video_timing, Bus& bus, Irq& irq)
     : video_timing_(video_timing),
       bus_(bus),
       irq_(irq),
-      scanline_clock_((video_timing == VideoTiming::NTSC ? 429 : 432) * 4, 1) {}
+      scanline_clock_(GetCyclesPerScanline(video_timing), 1) {}
 
 void Ppu::Reset() {
   cur_scanline_ = 0;
+  tile_cache_.Invalidate();
   scanline_clock_.Reset();
   frame_count_ = 0;
-  for (int scanline = 0; scanline < 240; scanline++)
-    framebuffer_[scanline].fill({0});
+  output_.fill(0);
 
   bg_data_.fill({});
   sprite_data_.fill({});
+  sprite_lines_.fill({});
+  for (int sprite_index = 0; sprite_index < 256; sprite_index++)
+    UpdateSpriteLines(sprite_index, true);
   sprite_segment_ptr_ = 0;
   blend_level_ = 0;
   vertical_compress_amount_ = 0x20;
@@ -54,9 +69,44 @@ void Ppu::Reset() {
   UpdateIrq();
 }
 
+void Ppu::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("PPU ", 1))
+    return;
+  state.Value(cur_scanline_);
+  scanline_clock_.Serialize(state);
+  state.Value(frame_count_);
+  state.Value(irq_ctrl_.raw);
+  state.Value(irq_status_.raw);
+  state.Value(bg_data_);
+  state.Value(sprite_data_);
+  state.Value(sprite_segment_ptr_);
+  state.Value(stn_lcd_control_);
+  state.Value(blend_level_);
+  state.Value(fade_level_);
+  state.Value(vertical_compress_amount_);
+  state.Value(vertical_compress_offset_);
+  state.Value(line_scroll_);
+  state.Value(line_compress_);
+  state.Value(palette_memory_);
+  state.Value(sprite_enable_);
+  state.Value(sprite_dma_source_);
+  state.Value(sprite_dma_target_);
+  state.Value(sprite_dma_length_);
+  state.Value(irq_vpos_);
+  state.Value(irq_hpos_);
+  state.EndChunk();
+
+  if (!state.IsLoading())
+    return;
+  // Tiles are only cached from external memory, which Spg200 takes care of
+  sprite_lines_.fill({});
+  for (int sprite_index = 0; sprite_index < 256; sprite_index++)
+    UpdateSpriteLines(sprite_index, true);
+}
+
 bool Ppu::RunCycles(int cycles) {
   if (scanline_clock_.Tick(cycles)) {
-    const int scanlines = video_timing_ == VideoTiming::NTSC ? 262 : 312;
+    const int scanlines = GetScanlinesPerFrame(video_timing_);
     bool frame_finished = false;
 
     if (cur_scanline_ == irq_vpos_ && irq_ctrl_.pos) {
@@ -89,6 +139,10 @@ bool Ppu::RunCycles(int cycles) {
   return false;
 }
 
+int Ppu::GetCyclesToNextEvent() const {
+  return scanline_clock_.GetCyclesToTick();
+}
+
 void Ppu::SetViewSettings(PpuViewSettings& view_settings) {
   view_settings_ = view_settings;
 }
@@ -282,14 +336,32 @@ void Ppu::WriteSpriteMemory(word_t offset, word_t value) {
       sprite_data_[index].xpos = value & 0x1ff;
       return;
     case 2:
+      UpdateSpriteLines(index, false);
       sprite_data_[index].ypos = value & 0x1ff;
+      UpdateSpriteLines(index, true);
       return;
     case 3:
+      UpdateSpriteLines(index, false);
       sprite_data_[index].attr.raw = value & SpriteAttribute::WriteMask;
+      UpdateSpriteLines(index, true);
       return;
   }
 }
 
+void Ppu::UpdateSpriteLines(int sprite_index, bool visible) {
+  const auto& sprite_data = sprite_data_[sprite_index];
+  const int tile_height = 8 << sprite_data.attr.vsize;
+  const int ypos = (128 - sext<9>(sprite_data.ypos)) - tile_height / 2;
+  const uint64_t bit = uint64_t{1} << (sprite_index % 64);
+
+  for (int y = std::max(ypos, 0); y < std::min(ypos + tile_height, 240); y++) {
+    if (visible)
+      sprite_lines_[y][sprite_index / 64] |= bit;
+    else
+      sprite_lines_[y][sprite_index / 64] &= ~bit;
+  }
+}
+
 word_t Ppu::GetSpriteControl() {
   return sprite_enable_;
 }
@@ -349,7 +421,16 @@ void Ppu::UpdateIrq() {
 void Ppu::DrawLine(int scanline) {
   Color transparent;
   transparent.transparent = 1;
-  framebuffer_[scanline].fill(transparent);
+  line_buffer_.fill(transparent);
+
+  // Visits sprites covering this scanline in index order
+  auto for_each_sprite = [&](auto&& draw) {
+    const SpriteMask& mask = sprite_lines_[scanline];
+    for (int word = 0; word < 4; word++) {
+      for (uint64_t bits = mask[word]; bits; bits &= bits - 1)
+        draw(word * 64 + std::countr_zero(bits));
+    }
+  };
 
   for (unsigned layer = 0; layer < 4; layer++) {
     for (unsigned bg = 0; bg < 2; bg++) {
@@ -362,29 +443,35 @@ void Ppu::DrawLine(int scanline) {
 
     if (sprite_enable_ && view_settings_.show_sprites &&
         view_settings_.show_sprites_in_layer[layer]) {
-      for (int sprite_index = 0; sprite_index < 256; sprite_index++) {
+      for_each_sprite([&](int sprite_index) {
         const auto& sprite = sprite_data_[sprite_index];
         if (sprite.ch && !sprite.attr.blend && sprite.attr.depth == layer) {
           DrawSpriteScanline(sprite_index, scanline);
         }
-      }
+      });
     }
   }
   // Draw blended sprites last
   if (sprite_enable_ && view_settings_.show_sprites) {
-    for (int sprite_index = 0; sprite_index < 256; sprite_index++) {
+    for_each_sprite([&](int sprite_index) {
       const auto& sprite = sprite_data_[sprite_index];
       if (sprite.ch && sprite.attr.blend) {
         DrawSpriteScanline(sprite_index, scanline);
       }
-    }
+    });
   }
 
-  // Replace all remaining transparent pixels with black
-  for (auto& pixel : framebuffer_[scanline]) {
-    if (pixel.transparent) {
-      pixel = Color{};
-    }
+  // Remaining transparent pixels are shown as black
+  const auto* line = reinterpret_cast<const uint16_t*>(line_buffer_.data());
+  switch (pixel_format_) {
+    case PixelFormat::RGB555:
+      return ConvertRGB555(line, &output_[scanline * 320 * 2], 320);
+    case PixelFormat::RGB565:
+      return ConvertRGB555ToRGB565(line, &output_[scanline * 320 * 2], 320);
+    case PixelFormat::RGBA8888:
+      return ConvertRGB555ToRGBA8888(line, &output_[scanline * 320 * 4], 320);
+    case PixelFormat::BGRA8888:
+      return ConvertRGB555ToBGRA8888(line, &output_[scanline * 320 * 4], 320);
   }
 }
 
@@ -412,8 +499,7 @@ void Ppu::DrawBgScanline(int bg_index, int screen_y) {
     const addr_t addr = addr_lo | (addr_hi << 16);
     const int bits_per_pixel = bg.ctrl.hicolor_mode ? 16 : (bg.attr.color_mode + 1) * 2;
     for (int screen_x = -scroll_x; screen_x < 320; screen_x += 512) {
-      DrawTileLine(screen_y, screen_x, addr, 512, bg.attr.palette, false, bits_per_pixel,
-                   bg.ctrl.blend);
+      DrawTileLine(screen_x, addr, 512, bg.attr.palette, false, bits_per_pixel, bg.ctrl.blend);
     }
 
     return;
@@ -460,7 +546,7 @@ void Ppu::DrawBgScanline(int bg_index, int screen_y) {
 
     const addr_t addr = CalculateLineSegmentAddr(bg.segment_ptr, ch, tile_y, tile_width,
                                                  tile_height, bits_per_pixel);
-    DrawTileLine(screen_y, screen_x, addr, tile_width, palette, hflip, bits_per_pixel, blend);
+    DrawTileLine(screen_x, addr, tile_width, palette, hflip, bits_per_pixel, blend);
   }
 }
 
@@ -480,82 +566,155 @@ void Ppu::DrawSpriteScanline(int sprite, int screen_y) {
 
   addr_t addr = CalculateLineSegmentAddr(sprite_segment_ptr_, sprite_data.ch, tile_y, tile_width,
                                          tile_height, bits_per_pixel);
-  DrawTileLine(screen_y, xpos, addr, tile_width, sprite_data.attr.palette, sprite_data.attr.hflip,
+  DrawTileLine(xpos, addr, tile_width, sprite_data.attr.palette, sprite_data.attr.hflip,
                bits_per_pixel, sprite_data.attr.blend);
 }
 
-void Ppu::DrawTileLine(int screen_y, int screen_x_start, addr_t line_addr, int tile_width,
-                       unsigned palette, bool hflip, unsigned bits_per_pixel, bool blend) {
-  int pixbuf_shift = -bits_per_pixel;
-  uint32_t pixbuf = 0;
-  addr_t addr = line_addr + (hflip ? ((tile_width * bits_per_pixel) / 16 - 1) : 0);
+void Ppu::DrawTileLine(int screen_x_start, addr_t line_addr, int tile_width, unsigned palette,
+                       bool hflip, unsigned bits_per_pixel, bool blend) {
+  switch (bits_per_pixel) {
+    case 2:
+      return DrawTileLineT<2>(screen_x_start, line_addr, tile_width, palette, hflip, blend);
+    case 4:
+      return DrawTileLineT<4>(screen_x_start, line_addr, tile_width, palette, hflip, blend);
+    case 6:
+      return DrawTileLineT<6>(screen_x_start, line_addr, tile_width, palette, hflip, blend);
+    case 8:
+      return DrawTileLineT<8>(screen_x_start, line_addr, tile_width, palette, hflip, blend);
+    case 16:
+      return DrawTileLineT<16>(screen_x_start, line_addr, tile_width, palette, hflip, blend);
+    default:
+      __builtin_unreachable();
+  }
+}
+
+template <unsigned BitsPerPixel>
+void Ppu::DrawTileLineT(int screen_x_start, addr_t line_addr, int tile_width, unsigned palette,
+                        bool hflip, bool blend) {
+  Scanline& line = line_buffer_;
+
+  const uint16_t* palette_colors = palette_memory_.data();
+  if constexpr (BitsPerPixel == 2 || BitsPerPixel == 4)
+    palette_colors += palette * 16;
+  else if constexpr (BitsPerPixel == 6)
+    palette_colors += (palette >> 2) * 64;
 
-  // skip bus reads containing entirely unused pixels
   const int left_offscreen = screen_x_start < 0 ? -screen_x_start : 0;
-  int skipped_pixels = 0;
-  if (left_offscreen > 0) {
-    int skipped_words = ((left_offscreen * bits_per_pixel) / 16);
-    if (skipped_words != 0) {
-      addr += hflip ? -skipped_words : skipped_words;
-      skipped_pixels = DivideRoundUp(skipped_words * 16, bits_per_pixel);
-      pixbuf_shift -= (skipped_pixels * bits_per_pixel) % 16;
+  const int end_pixel = std::min(tile_width, 320 - screen_x_start);
+  const addr_t line_words = (tile_width * BitsPerPixel) / 16;
+
+  // Rows in external memory are cached fully unpacked. Reading them has no side
+  // effects, so fetching the offscreen part of a row as well is invisible.
+  if (BitsPerPixel <= 8 && tile_width <= TileCache::kMaxTileWidth && line_addr >= 0x4000 &&
+      line_addr + line_words <= 0x400000) {
+    const uint32_t key = (line_addr << 5) | ((BitsPerPixel / 2 - 1) << 3) |
+                         ((std::countr_zero(unsigned(tile_width)) - 3) << 1) | hflip;
+    const TileCache::Row* row = tile_cache_.Find(key, line_addr);
+    if (!row) {
+      TileCache::Row& new_row = tile_cache_.Insert(key);
+      DecodeTileLine<BitsPerPixel>(line_addr, tile_width, hflip, 0, tile_width,
+                                   [&](int pixel, word_t pixdata) { new_row[pixel] = pixdata; });
+      row = &new_row;
     }
+    if (end_pixel > left_offscreen)
+      PlotTilePixels(row->data() + left_offscreen, palette_colors,
+                     reinterpret_cast<uint16_t*>(&line[screen_x_start + left_offscreen]),
+                     end_pixel - left_offscreen, blend, blend_level_);
+    return;
   }
 
-  for (int screen_x = screen_x_start + skipped_pixels;
-       screen_x < screen_x_start + tile_width && screen_x < 320; screen_x++) {
-    if (pixbuf_shift < 0) {
-      word_t val = bus_.ReadWord(addr);
-      addr += hflip ? -1 : 1;
-      if (bits_per_pixel != 16)
-        val = (val >> 8) | (val << 8);
-      pixbuf = hflip ? (val << 16) | (pixbuf >> 16) : (pixbuf << 16) | val;
-      pixbuf_shift += 16;
-    }
+  // Anything else is unpacked into a buffer as wide as the widest line, a
+  // bitmap's, and plotted the same way. Pixels from left_offscreen on are
+  // always unpacked, as the skipped words hold none of them.
+  using Pixel = std::conditional_t<BitsPerPixel == 16, uint16_t, uint8_t>;
+  std::array<Pixel, 512> pixels;
+  // skip bus reads containing entirely unused pixels
+  const int skipped_words = (left_offscreen * BitsPerPixel) / 16;
+  DecodeTileLine<BitsPerPixel>(line_addr, tile_width, hflip, skipped_words, end_pixel,
+                               [&](int pixel, word_t pixdata) { pixels[pixel] = pixdata; });
+  if (end_pixel <= left_offscreen)
+    return;
 
-    const int pixbuf_shift_flip =
-        hflip ? ((16 - bits_per_pixel) - pixbuf_shift) + 16 : pixbuf_shift;
-    const int pixdata = (pixbuf >> pixbuf_shift_flip) & ((1 << bits_per_pixel) - 1);
-    pixbuf_shift -= bits_per_pixel;
+  uint16_t* const dst = reinterpret_cast<uint16_t*>(&line[screen_x_start + left_offscreen]);
+  if constexpr (BitsPerPixel == 16) {
+    PlotTileColors(pixels.data() + left_offscreen, dst, end_pixel - left_offscreen, blend,
+                   blend_level_);
+  } else {
+    PlotTilePixels(pixels.data() + left_offscreen, palette_colors, dst,
+                   end_pixel - left_offscreen, blend, blend_level_);
+  }
+}
 
-    if (screen_x < 0)
-      continue;
+template <unsigned BitsPerPixel, typename F>
+void Ppu::DecodeTileLine(addr_t line_addr, int tile_width, bool hflip, int skipped_words,
+                         int end_pixel, F&& pixel_fn) {
+  constexpr word_t kPixelMask = (1 << BitsPerPixel) - 1;
+  const int skipped_pixels = DivideRoundUp(skipped_words * 16, BitsPerPixel);
 
-    Color newpixel;
-    switch (bits_per_pixel) {
-      case 2:
-      case 4:
-        newpixel.raw = palette_memory_[palette * 16 + pixdata];
-        break;
-      case 6:
-        newpixel.raw = palette_memory_[(palette >> 2) * 64 + pixdata];
-        break;
-      case 8:
-        newpixel.raw = palette_memory_[pixdata];
-        break;
-      case 16:
-        newpixel.raw = pixdata;
-        break;
-      default:
-        __builtin_unreachable();
-    }
+  if constexpr (16 % BitsPerPixel == 0) {
+    // Pixels never straddle words, so unpack each fetched word in one go
+    constexpr int kPixelsPerWord = 16 / BitsPerPixel;
+    const int last_word = (tile_width * BitsPerPixel) / 16 - 1;
 
-    if (newpixel.transparent)
-      continue;
+    for (int pixel = skipped_pixels; pixel < end_pixel; pixel += kPixelsPerWord) {
+      const int word_index = pixel / kPixelsPerWord;
+      word_t val = bus_.ReadWord(line_addr + (hflip ? last_word - word_index : word_index));
+      if constexpr (BitsPerPixel != 16)
+        val = (val >> 8) | (val << 8);
 
-    if (blend) {
-      Color oldpixel = framebuffer_[screen_y][screen_x];
-      if (!oldpixel.transparent) {
-        newpixel.r = BlendInterpolate(oldpixel.r, newpixel.r, blend_level_);
-        newpixel.g = BlendInterpolate(oldpixel.g, newpixel.g, blend_level_);
-        newpixel.b = BlendInterpolate(oldpixel.b, newpixel.b, blend_level_);
+      const int count = std::min(kPixelsPerWord, end_pixel - pixel);
+      for (int i = 0; i < count; i++) {
+        const int shift = hflip ? i * BitsPerPixel : 16 - (i + 1) * BitsPerPixel;
+        pixel_fn(pixel + i, (val >> shift) & kPixelMask);
       }
     }
+  } else {
+    int pixbuf_shift = -BitsPerPixel - (skipped_pixels * BitsPerPixel) % 16;
+    uint32_t pixbuf = 0;
+    addr_t addr = line_addr + (hflip ? ((tile_width * BitsPerPixel) / 16 - 1) : 0);
+    addr += hflip ? -skipped_words : skipped_words;
+
+    for (int pixel = skipped_pixels; pixel < end_pixel; pixel++) {
+      if (pixbuf_shift < 0) {
+        word_t val = bus_.ReadWord(addr);
+        addr += hflip ? -1 : 1;
+        val = (val >> 8) | (val << 8);
+        pixbuf = hflip ? (val << 16) | (pixbuf >> 16) : (pixbuf << 16) | val;
+        pixbuf_shift += 16;
+      }
 
-    framebuffer_[screen_y][screen_x] = newpixel;
+      const int pixbuf_shift_flip =
+          hflip ? ((16 - BitsPerPixel) - pixbuf_shift) + 16 : pixbuf_shift;
+      pixel_fn(pixel, (pixbuf >> pixbuf_shift_flip) & kPixelMask);
+      pixbuf_shift -= BitsPerPixel;
+    }
   }
 }
 
 std::span<uint8_t> Ppu::GetFramebuffer() const {
-  return {(uint8_t*)&framebuffer_, sizeof(framebuffer_)};
+  const bool rgb16 = pixel_format_ == PixelFormat::RGB555 || pixel_format_ == PixelFormat::RGB565;
+  const std::size_t bytes_per_pixel = rgb16 ? 2 : 4;
+  return {(uint8_t*)output_.data(), 320 * 240 * bytes_per_pixel};
+}
+
+void Ppu::SetPixelFormat(PixelFormat pixel_format) {
+  pixel_format_ = pixel_format;
+  output_.fill(0);
+}
+
+void Ppu::InvalidateTileCache() {
+  tile_cache_.Invalidate();
+}
+
+void Ppu::InvalidateTileCache(addr_t addr) {
+  tile_cache_.InvalidateWord(addr);
+}
+
+TileCacheStats Ppu::GetTileCacheStats() const {
+  return tile_cache_.GetStats();
+}
+
+double Ppu::GetFrameRate() const {
+  return 27000000.0 /
+         (GetCyclesPerScanline(video_timing_) * GetScanlinesPerFrame(video_timing_));
 }
\ No newline at end of file
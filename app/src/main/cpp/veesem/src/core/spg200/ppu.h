@@ -2,19 +2,23 @@
 
 #include <array>
 
+#include "bus.h"
 #include "core/common.h"
 #include "settings.h"
+#include "tile_cache.h"
 #include "types.h"
 
-class BusInterface;
 class Irq;
+class StateSerializer;
 
 class Ppu {
 public:
-  Ppu(VideoTiming video_timing, BusInterface& bus, Irq& irq);
+  Ppu(VideoTiming video_timing, Bus& bus, Irq& irq);
 
   bool RunCycles(int cycles);
+  int GetCyclesToNextEvent() const;
   void Reset();
+  void Serialize(StateSerializer& state);
   void SetViewSettings(PpuViewSettings& view_settings);
 
   word_t GetBgXScroll(int bg_index);
@@ -70,14 +74,29 @@ public:
   word_t GetLineCounter();
   int64_t GetFrameCounter();
   std::span<uint8_t> GetFramebuffer() const;
+  void SetPixelFormat(PixelFormat pixel_format);
+  // Frames per second of emulated time, about 50.08 (PAL) or 60.05 (NTSC)
+  double GetFrameRate() const;
+
+  void InvalidateTileCache();
+  // Drops the cached rows a write to addr may have changed
+  void InvalidateTileCache(addr_t addr);
+  TileCacheStats GetTileCacheStats() const;
 
 private:
   void UpdateIrq();
   void DrawLine(int y);
   void DrawBgScanline(int bg_index, int y);
   void DrawSpriteScanline(int sprite_index, int y);
-  void DrawTileLine(int screen_y, int screen_x_start, addr_t addr, int tile_width, unsigned palette,
-                    bool hflip, unsigned bits_per_pixel, bool blend);
+  void UpdateSpriteLines(int sprite_index, bool visible);
+  void DrawTileLine(int screen_x_start, addr_t addr, int tile_width, unsigned palette, bool hflip,
+                    unsigned bits_per_pixel, bool blend);
+  template <unsigned BitsPerPixel>
+  void DrawTileLineT(int screen_x_start, addr_t addr, int tile_width, unsigned palette, bool hflip,
+                     bool blend);
+  template <unsigned BitsPerPixel, typename F>
+  void DecodeTileLine(addr_t addr, int tile_width, bool hflip, int skipped_words, int end_pixel,
+                      F&& pixel_fn);
   union Color {
     uint16_t raw = 0;
     Bitfield<15, 1> transparent;
@@ -87,11 +106,14 @@ private:
   };
 
   using Scanline = std::array<Color, 320>;
-  using Framebuffer = std::array<Scanline, 240>;
 
-  Framebuffer framebuffer_;
+  // Scanline being composited, in the PPU's own format so that blending sees
+  // the exact 5-bit components. Finished lines are stored to output_.
+  Scanline line_buffer_;
+  std::array<uint8_t, 320 * 240 * 4> output_ = {};
+  PixelFormat pixel_format_ = PixelFormat::RGB555;
   const VideoTiming video_timing_;
-  BusInterface& bus_;
+  Bus& bus_;
   Irq& irq_;
   int cur_scanline_ = 0;
   SimpleConfigurableClock scanline_clock_;
@@ -177,6 +199,9 @@ private:
 
   std::array<BgData, 2> bg_data_;
   std::array<SpriteData, 256> sprite_data_;
+  // One bit per sprite whose vertical extent covers the scanline
+  using SpriteMask = std::array<uint64_t, 4>;
+  std::array<SpriteMask, 240> sprite_lines_;
   uint16_t sprite_segment_ptr_ = 0;
   uint8_t stn_lcd_control_ = 0;  // TODO: document and create union
   uint8_t blend_level_ = 0;
@@ -195,4 +220,5 @@ private:
   uint16_t irq_hpos_ = 0x1ff;
 
   PpuViewSettings view_settings_;
+  TileCache tile_cache_;
 };
\ No newline at end of file
@@ -1,15 +1,18 @@
 #include "random.h"
 
-#include <cstdlib>
+#include "core/state_serializer.h"
 
 void Random::Set(word_t value) {
   seed_ = value;
 }
 word_t Random::Get() {
-  return rand() & 0x7fff;
-  // word_t value = seed;
-  // update_seed();
-  // return value;
+  const word_t value = seed_ & 0x7fff;
+  UpdateSeed();
+  return value;
+}
+
+void Random::Serialize(StateSerializer& state) {
+  state.Value(seed_);
 }
 
 void Random::UpdateSeed() {
@@ -2,10 +2,13 @@
 
 #include "core/common.h"
 
+class StateSerializer;
+
 class Random {
 public:
   void Set(word_t value);
   word_t Get();
+  void Serialize(StateSerializer& state);
 
 private:
   void UpdateSeed();
@@ -0,0 +1,49 @@
+#include "rate_controller.h"
+
+#include <algorithm>
+
+// Weight of a new reading in the running average of the fill level
+static constexpr double kSmoothing = 1.0 / 16;
+
+RateController::RateController(std::size_t target_fill, double max_adjustment)
+    : max_adjustment_(max_adjustment) {
+  SetTarget(target_fill);
+  ResetStats();
+}
+
+void RateController::SetTarget(std::size_t target_fill) {
+  target_fill_ = std::max<std::size_t>(target_fill, 1);
+  average_fill_ = static_cast<double>(target_fill_);
+}
+
+std::size_t RateController::GetTarget() const {
+  return target_fill_;
+}
+
+double RateController::Update(std::size_t fill_level) {
+  // Readings are taken at bursty points, right before or after a block of
+  // samples is queued, so steer by their running average instead
+  average_fill_ += (static_cast<double>(fill_level) - average_fill_) * kSmoothing;
+
+  const double target = static_cast<double>(target_fill_);
+  const double error = std::clamp((average_fill_ - target) / target, -1.0, 1.0);
+  const double adjustment = 1.0 - max_adjustment_ * error;
+
+  stats_.min_fill = stats_.updates ? std::min(stats_.min_fill, fill_level) : fill_level;
+  stats_.max_fill = std::max(stats_.max_fill, fill_level);
+  stats_.updates++;
+  if (fill_level == 0)
+    stats_.empty_updates++;
+  stats_.adjustment = adjustment;
+  return adjustment;
+}
+
+RateControlStats RateController::GetStats() const {
+  RateControlStats stats = stats_;
+  stats.average_fill = average_fill_;
+  return stats;
+}
+
+void RateController::ResetStats() {
+  stats_ = {};
+}
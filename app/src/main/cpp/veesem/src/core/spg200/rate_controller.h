@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+struct RateControlStats {
+  double adjustment = 1.0;    // last factor returned by Update()
+  double average_fill = 0.0;  // smoothed fill level, in frames
+  std::size_t min_fill = 0;
+  std::size_t max_fill = 0;
+  uint64_t updates = 0;
+  uint64_t empty_updates = 0;  // updates that found the buffer empty
+};
+
+// Dynamic rate control for audio output. The emulation and the host audio
+// device run off different clocks, so a buffer between them slowly fills up or
+// runs dry. Given the buffer's fill level, Update() returns a factor close to
+// 1.0 for the resampler's output rate that steers the level back to the
+// target, small enough that the pitch change can not be heard.
+//
+// The factor is below 1.0 when the buffer holds more than the target, which is
+// right whether the buffer sits before the resampler (input is consumed
+// faster) or after it (less output is produced).
+class RateController {
+public:
+  explicit RateController(std::size_t target_fill, double max_adjustment = 0.005);
+
+  void SetTarget(std::size_t target_fill);
+  std::size_t GetTarget() const;
+
+  double Update(std::size_t fill_level);
+
+  RateControlStats GetStats() const;
+  void ResetStats();
+
+private:
+  std::size_t target_fill_;
+  const double max_adjustment_;
+  double average_fill_;
+  RateControlStats stats_;
+};
@@ -0,0 +1,260 @@
+#include "resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <type_traits>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "core/common.h"
+
+namespace {
+struct QualityParams {
+  int zero_crossings;
+  double passband;  // fraction of the output Nyquist frequency kept
+  double beta;      // Kaiser window shape
+};
+
+QualityParams GetQualityParams(Resampler::Quality quality) {
+  switch (quality) {
+    case Resampler::Quality::LOW:
+      return {4, 0.80, 5.0};
+    case Resampler::Quality::MEDIUM:
+      return {8, 0.88, 7.0};
+    case Resampler::Quality::HIGH:
+      return {16, 0.94, 9.0};
+  }
+  die("Invalid resampler quality");
+}
+
+// Zeroth order modified Bessel function of the first kind
+double BesselI0(double x) {
+  double sum = 1.0;
+  double term = 1.0;
+  for (int k = 1; term > sum * 1e-12; k++) {
+    term *= (x / (2 * k)) * (x / (2 * k));
+    sum += term;
+  }
+  return sum;
+}
+
+struct StereoSum {
+  float left;
+  float right;
+};
+
+// Dot product of both channels with the coefficients interpolated between
+// phases c0 and c1. taps is a multiple of 4.
+#if defined(__ARM_NEON)
+inline float HorizontalSum(float32x4_t v) {
+  const float32x2_t sum = vadd_f32(vget_low_f32(v), vget_high_f32(v));
+  return vget_lane_f32(vpadd_f32(sum, sum), 0);
+}
+
+StereoSum Convolve(const float* left, const float* right, const float* c0, const float* c1,
+                   float frac, int taps) {
+  const float32x4_t f = vdupq_n_f32(frac);
+  float32x4_t acc_l = vdupq_n_f32(0.0f);
+  float32x4_t acc_r = vdupq_n_f32(0.0f);
+  for (int i = 0; i < taps; i += 4) {
+    const float32x4_t a = vld1q_f32(c0 + i);
+    const float32x4_t c = vmlaq_f32(a, vsubq_f32(vld1q_f32(c1 + i), a), f);
+    acc_l = vmlaq_f32(acc_l, vld1q_f32(left + i), c);
+    acc_r = vmlaq_f32(acc_r, vld1q_f32(right + i), c);
+  }
+  return {HorizontalSum(acc_l), HorizontalSum(acc_r)};
+}
+#elif defined(__SSE2__)
+inline float HorizontalSum(__m128 v) {
+  const __m128 sum = _mm_add_ps(v, _mm_movehl_ps(v, v));
+  return _mm_cvtss_f32(_mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1)));
+}
+
+StereoSum Convolve(const float* left, const float* right, const float* c0, const float* c1,
+                   float frac, int taps) {
+  const __m128 f = _mm_set1_ps(frac);
+  __m128 acc_l = _mm_setzero_ps();
+  __m128 acc_r = _mm_setzero_ps();
+  for (int i = 0; i < taps; i += 4) {
+    const __m128 a = _mm_loadu_ps(c0 + i);
+    const __m128 c = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(c1 + i), a), f));
+    acc_l = _mm_add_ps(acc_l, _mm_mul_ps(_mm_loadu_ps(left + i), c));
+    acc_r = _mm_add_ps(acc_r, _mm_mul_ps(_mm_loadu_ps(right + i), c));
+  }
+  return {HorizontalSum(acc_l), HorizontalSum(acc_r)};
+}
+#else
+StereoSum Convolve(const float* left, const float* right, const float* c0, const float* c1,
+                   float frac, int taps) {
+  StereoSum sum = {0.0f, 0.0f};
+  for (int i = 0; i < taps; i++) {
+    const float c = c0[i] + (c1[i] - c0[i]) * frac;
+    sum.left += left[i] * c;
+    sum.right += right[i] * c;
+  }
+  return sum;
+}
+#endif
+
+template <typename T>
+inline T ConvertSample(float value) {
+  if constexpr (std::is_same_v<T, float>)
+    return value * (1.0f / 32768.0f);
+  else
+    return static_cast<int16_t>(std::clamp(std::lrint(value), -32768L, 32767L));
+}
+}  // namespace
+
+Resampler::Resampler(int output_rate, Quality quality) {
+  Configure(output_rate, quality);
+}
+
+void Resampler::Reset() {
+  // Start with enough silence for the first output frame to be centered on
+  // the first input frame
+  const int center = taps_ / 2 - 1;
+  left_.assign(center, 0.0f);
+  right_.assign(center, 0.0f);
+  position_ = static_cast<uint64_t>(center) << 32;
+}
+
+void Resampler::Configure(int output_rate, Quality quality) {
+  if (output_rate <= 0)
+    die("Invalid resampler output rate");
+
+  output_rate_ = output_rate;
+  quality_ = quality;
+  rate_adjustment_ = 1.0;
+  UpdateStep();
+  BuildFilter();
+  Reset();
+}
+
+int Resampler::GetOutputRate() const {
+  return output_rate_;
+}
+
+Resampler::Quality Resampler::GetQuality() const {
+  return quality_;
+}
+
+void Resampler::SetRateAdjustment(double adjustment) {
+  rate_adjustment_ = adjustment;
+  UpdateStep();
+}
+
+void Resampler::UpdateStep() {
+  step_ = std::llround(std::ldexp(kInputRate / (output_rate_ * rate_adjustment_), 32));
+}
+
+void Resampler::BuildFilter() {
+  const QualityParams params = GetQualityParams(quality_);
+
+  // Cutoff relative to the input Nyquist frequency. When upsampling the input
+  // band is already within the output band.
+  const double cutoff =
+      std::min(1.0, static_cast<double>(output_rate_) / kInputRate) * params.passband;
+  const int half = static_cast<int>(std::ceil(params.zero_crossings / cutoff));
+  taps_ = (2 * half + 3) & ~3;
+
+  // Row p holds the coefficients for an output frame p / kPhases of the way
+  // from input frame center to the next one
+  const int center = taps_ / 2 - 1;
+  const double window_scale = 1.0 / BesselI0(params.beta);
+  filter_.assign((kPhases + 1) * taps_, 0.0f);
+  for (int phase = 0; phase <= kPhases; phase++) {
+    float* row = &filter_[phase * taps_];
+    double sum = 0.0;
+    for (int i = 0; i < taps_; i++) {
+      const double x = i - center - static_cast<double>(phase) / kPhases;
+      if (std::abs(x) >= half)
+        continue;
+
+      const double t = std::numbers::pi * cutoff * x;
+      const double sinc = x == 0 ? 1.0 : std::sin(t) / t;
+      const double r = x / half;
+      const double window = BesselI0(params.beta * std::sqrt(1.0 - r * r)) * window_scale;
+      row[i] = static_cast<float>(sinc * window);
+      sum += row[i];
+    }
+    // Unity gain at DC for every phase
+    for (int i = 0; i < taps_; i++)
+      row[i] = static_cast<float>(row[i] / sum);
+  }
+}
+
+void Resampler::Push(std::span<const uint16_t> input) {
+  const std::size_t frames = input.size() / 2;
+  const std::size_t start = left_.size();
+  left_.resize(start + frames);
+  right_.resize(start + frames);
+  for (std::size_t i = 0; i < frames; i++) {
+    left_[start + i] = static_cast<int16_t>(input[i * 2] ^ 0x8000);
+    right_[start + i] = static_cast<int16_t>(input[i * 2 + 1] ^ 0x8000);
+  }
+}
+
+std::size_t Resampler::GetAvailableFrames() const {
+  // An output frame at position t needs input frames up to floor(t) + taps / 2
+  const std::size_t lookahead = taps_ / 2;
+  if (left_.size() <= lookahead)
+    return 0;
+
+  const uint64_t end = static_cast<uint64_t>(left_.size() - lookahead) << 32;
+  if (position_ >= end)
+    return 0;
+  return (end - position_ + step_ - 1) / step_;
+}
+
+std::size_t Resampler::GetInputFramesNeeded(std::size_t output_frames) const {
+  if (output_frames == 0)
+    return 0;
+
+  const std::size_t last = (position_ + (output_frames - 1) * step_) >> 32;
+  const std::size_t needed = last + taps_ / 2 + 1;
+  return needed > left_.size() ? needed - left_.size() : 0;
+}
+
+std::size_t Resampler::Read(int16_t* output, std::size_t max_frames) {
+  return ReadFrames(output, max_frames);
+}
+
+std::size_t Resampler::Read(float* output, std::size_t max_frames) {
+  return ReadFrames(output, max_frames);
+}
+
+template <typename T>
+std::size_t Resampler::ReadFrames(T* output, std::size_t max_frames) {
+  const std::size_t frames = std::min(max_frames, GetAvailableFrames());
+  const int center = taps_ / 2 - 1;
+
+  for (std::size_t i = 0; i < frames; i++) {
+    const std::size_t base = (position_ >> 32) - center;
+    const uint32_t frac = static_cast<uint32_t>(position_);
+    const uint32_t phase = frac >> (32 - kPhaseBits);
+    const float phase_frac = static_cast<float>(frac << kPhaseBits) * 0x1p-32f;
+
+    const float* c0 = &filter_[phase * taps_];
+    const StereoSum sum =
+        Convolve(&left_[base], &right_[base], c0, c0 + taps_, phase_frac, taps_);
+    output[i * 2] = ConvertSample<T>(sum.left);
+    output[i * 2 + 1] = ConvertSample<T>(sum.right);
+
+    position_ += step_;
+  }
+
+  // Drop input frames that no later output frame reaches
+  const std::size_t consumed = (position_ >> 32) - center;
+  if (consumed) {
+    left_.erase(left_.begin(), left_.begin() + consumed);
+    right_.erase(right_.begin(), right_.begin() + consumed);
+    position_ -= static_cast<uint64_t>(consumed) << 32;
+  }
+
+  return frames;
+}
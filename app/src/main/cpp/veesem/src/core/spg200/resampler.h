@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Converts SPU output (unsigned 16-bit stereo at 27 MHz / 96) to a host sample
+// rate. Each output frame is a dot product of the surrounding input frames
+// with a Kaiser-windowed sinc filter, whose coefficients are interpolated from
+// a table of phases so that any output rate works.
+class Resampler {
+public:
+  enum class Quality {
+    LOW,     // 4 zero crossings per side
+    MEDIUM,  // 8 zero crossings per side
+    HIGH,    // 16 zero crossings per side
+  };
+
+  static constexpr int kInputRate = 281250;
+
+  explicit Resampler(int output_rate = 48000, Quality quality = Quality::MEDIUM);
+
+  // Drops queued input. The output restarts from silence.
+  void Reset();
+  void Configure(int output_rate, Quality quality);
+
+  int GetOutputRate() const;
+  Quality GetQuality() const;
+
+  // Scales the output rate by a factor close to 1.0, as returned by
+  // RateController::Update(). Configure() sets it back to 1.0.
+  void SetRateAdjustment(double adjustment);
+
+  // Queues SPU output, interleaved left/right as it comes out of the SPU's
+  // AudioRingBuffer
+  void Push(std::span<const uint16_t> input);
+
+  // Number of output frames that can be read from the queued input
+  std::size_t GetAvailableFrames() const;
+  // Number of input frames still to be pushed before that many output frames
+  // can be read
+  std::size_t GetInputFramesNeeded(std::size_t output_frames) const;
+
+  // Write up to max_frames interleaved stereo frames and return how many were
+  // written. Float output is scaled so that 1.0 is full scale.
+  std::size_t Read(int16_t* output, std::size_t max_frames);
+  std::size_t Read(float* output, std::size_t max_frames);
+
+private:
+  static constexpr int kPhaseBits = 6;
+  static constexpr int kPhases = 1 << kPhaseBits;
+
+  void BuildFilter();
+  void UpdateStep();
+  template <typename T>
+  std::size_t ReadFrames(T* output, std::size_t max_frames);
+
+  int output_rate_;
+  Quality quality_;
+  double rate_adjustment_ = 1.0;
+
+  int taps_ = 0;
+  std::vector<float> filter_;  // kPhases + 1 rows of taps_ coefficients
+
+  // Input frames per output frame and position of the next output frame in
+  // the queued input, both in 32.32 fixed point
+  uint64_t step_ = 0;
+  uint64_t position_ = 0;
+
+  std::vector<float> left_;
+  std::vector<float> right_;
+};
@@ -0,0 +1,174 @@
+// Checks that the resampler produces as many frames as the input and output
+// rates call for, that GetAvailableFrames() and GetInputFramesNeeded() agree
+// with what Read() returns, and how much it lets through of tones inside and
+// outside the output band.
+
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <numbers>
+#include <vector>
+
+#include "core/testing.h"
+#include "resampler.h"
+
+namespace {
+constexpr Resampler::Quality kQualities[] = {Resampler::Quality::LOW, Resampler::Quality::MEDIUM,
+                                             Resampler::Quality::HIGH};
+constexpr int kOutputRates[] = {44100, 48000};
+constexpr double kRateAdjustments[] = {1.0, 0.98, 0.995, 1.005, 1.02};
+// One PAL video frame of SPU output
+constexpr std::size_t kFrameInput = Resampler::kInputRate / 50;
+
+std::vector<uint16_t> MakeTone(double frequency, double amplitude, std::size_t frames,
+                               std::size_t first = 0) {
+  std::vector<uint16_t> samples;
+  for (std::size_t i = first; i < first + frames; i++) {
+    const double t = static_cast<double>(i) / Resampler::kInputRate;
+    const auto value = static_cast<int16_t>(
+        std::lround(amplitude * std::sin(2 * std::numbers::pi * frequency * t)));
+    samples.push_back(static_cast<uint16_t>(value) ^ 0x8000);
+    samples.push_back(static_cast<uint16_t>(-value) ^ 0x8000);
+  }
+  return samples;
+}
+
+// Pushes frame-sized chunks of varying length, as the frontends do, and reads
+// everything available after each one
+void TestOutputCount(int output_rate, Resampler::Quality quality, double adjustment) {
+  Resampler resampler(output_rate, quality);
+  resampler.SetRateAdjustment(adjustment);
+
+  std::size_t input_frames = 0;
+  std::size_t output_frames = 0;
+  bool reads_match = true;
+  std::vector<int16_t> output;
+  for (int frame = 0; frame < 200; frame++) {
+    const std::size_t chunk = kFrameInput - 40 + (frame * 37) % 80;
+    resampler.Push(MakeTone(440, 1000, chunk, input_frames));
+    input_frames += chunk;
+
+    const std::size_t available = resampler.GetAvailableFrames();
+    output.resize(available * 2 + 8);
+    const std::size_t read = resampler.Read(output.data(), available + 4);
+    reads_match &= read == available && resampler.GetAvailableFrames() == 0;
+    output_frames += read;
+  }
+  EXPECT(reads_match);
+
+  // The output lags the input by half the filter, a few dozen frames at most
+  const double expected = input_frames * output_rate * adjustment / Resampler::kInputRate;
+  const double difference = expected - static_cast<double>(output_frames);
+  if (difference < 0 || difference > 64)
+    std::fprintf(stderr, "%d Hz, quality %d, adjustment %.3f: %zu frames for %.1f\n",
+                 output_rate, static_cast<int>(quality), adjustment, output_frames, expected);
+  EXPECT(difference >= 0 && difference <= 64);
+}
+
+// Pushing exactly the input GetInputFramesNeeded() asks for makes that many
+// output frames available, and one frame less does not
+void TestInputFramesNeeded(int output_rate, Resampler::Quality quality, double adjustment) {
+  Resampler resampler(output_rate, quality);
+  resampler.SetRateAdjustment(adjustment);
+  EXPECT(resampler.GetInputFramesNeeded(0) == 0);
+
+  std::size_t input_frames = 0;
+  bool exact = true;
+  std::vector<float> output;
+  for (std::size_t wanted : {1, 2, 7, 160, 800, 801, 1024, 3}) {
+    const std::size_t needed = resampler.GetInputFramesNeeded(wanted);
+    if (needed > 1) {
+      resampler.Push(MakeTone(440, 1000, needed - 1, input_frames));
+      input_frames += needed - 1;
+      exact &= resampler.GetAvailableFrames() < wanted;
+      resampler.Push(MakeTone(440, 1000, 1, input_frames));
+      input_frames += 1;
+    } else {
+      resampler.Push(MakeTone(440, 1000, needed, input_frames));
+      input_frames += needed;
+    }
+    exact &= resampler.GetAvailableFrames() >= wanted;
+    exact &= resampler.GetInputFramesNeeded(wanted) == 0;
+
+    output.resize(wanted * 2);
+    exact &= resampler.Read(output.data(), wanted) == wanted;
+  }
+  EXPECT(exact);
+}
+
+// RMS level in dB relative to full scale of a tone after resampling, measured
+// once the filter has settled
+double ToneLevel(int output_rate, Resampler::Quality quality, double frequency) {
+  constexpr double kAmplitude = 16384;
+  constexpr std::size_t kInputFrames = Resampler::kInputRate / 2;
+
+  Resampler resampler(output_rate, quality);
+  resampler.Push(MakeTone(frequency, kAmplitude, kInputFrames));
+  std::vector<float> output(resampler.GetAvailableFrames() * 2);
+  const std::size_t frames = resampler.Read(output.data(), output.size() / 2);
+
+  double sum = 0;
+  const std::size_t settled = frames / 4;
+  for (std::size_t i = settled; i < frames; i++)
+    sum += output[i * 2] * output[i * 2];
+  const double rms = std::sqrt(sum / (frames - settled)) * 32768;
+  return 20 * std::log10(rms / (kAmplitude / std::numbers::sqrt2));
+}
+
+// Tones in the passband come out at their level. Tones above the output
+// Nyquist frequency, which would alias, are attenuated more the higher the
+// quality.
+void TestTones() {
+  const double stopband_attenuation[] = {55, 80, 95};
+  for (int output_rate : kOutputRates) {
+    for (int q = 0; q < 3; q++) {
+      const Resampler::Quality quality = kQualities[q];
+      for (double frequency : {100.0, 1000.0, 10000.0}) {
+        const double level = ToneLevel(output_rate, quality, frequency);
+        if (std::abs(level) > 0.1)
+          std::fprintf(stderr, "%d Hz, quality %d: %.0f Hz tone at %.2f dB\n", output_rate, q,
+                       frequency, level);
+        EXPECT(std::abs(level) <= 0.1);
+      }
+      for (double frequency : {30000.0, 40000.0, 100000.0}) {
+        const double level = ToneLevel(output_rate, quality, frequency);
+        if (level > -stopband_attenuation[q])
+          std::fprintf(stderr, "%d Hz, quality %d: %.0f Hz tone at %.1f dB\n", output_rate, q,
+                       frequency, level);
+        EXPECT(level <= -stopband_attenuation[q]);
+      }
+    }
+  }
+}
+
+// Reset() drops queued input and starts again from silence
+void TestReset() {
+  Resampler resampler(48000, Resampler::Quality::MEDIUM);
+  resampler.Push(MakeTone(1000, 16384, kFrameInput));
+  EXPECT(resampler.GetAvailableFrames() > 0);
+  resampler.Reset();
+  EXPECT(resampler.GetAvailableFrames() == 0);
+
+  resampler.Push(MakeTone(0, 0, kFrameInput));
+  std::vector<int16_t> output(resampler.GetAvailableFrames() * 2);
+  resampler.Read(output.data(), output.size() / 2);
+  bool silent = true;
+  for (int16_t sample : output)
+    silent &= sample == 0;
+  EXPECT(silent);
+}
+}  // namespace
+
+int main() {
+  for (int output_rate : kOutputRates) {
+    for (Resampler::Quality quality : kQualities) {
+      for (double adjustment : kRateAdjustments) {
+        TestOutputCount(output_rate, quality, adjustment);
+        TestInputFramesNeeded(output_rate, quality, adjustment);
+      }
+    }
+  }
+  TestTones();
+  TestReset();
+  return TestResult();
+}
@@ -1,5 +1,8 @@
 #include "spg200.h"
 
+#include <algorithm>
+
+#include "core/state_serializer.h"
 #include "spg200_io.h"
 
 Spg200::Spg200(VideoTiming video_timing, Spg200Io& io)
@@ -24,44 +27,187 @@ void Spg200::Reset() {
   irq_.Reset();
   timer_.Reset();
   extmem_.Reset();
+  UpdatePageTable();
   gpio_.Reset();
   adc_.Reset();
   uart_.Reset();
   dma_.Reset();
   random1_.Set(0x1418);
   random2_.Set(0x1658);
+  devices_synced_ = cycle_count_;
+  next_event_ = cycle_count_;
+}
+
+void Spg200::Serialize(StateSerializer& state) {
+  const word_t old_extmem_control = extmem_.GetControl();
+
+  if (!state.BeginChunk("SPG2", 1))
+    return;
+  state.Value(cycle_count_);
+  state.Value(devices_synced_);
+  state.Value(next_event_);
+  state.Value(ram_);
+  random1_.Serialize(state);
+  random2_.Serialize(state);
+  state.EndChunk();
+
+  cpu_.Serialize(state);
+  ppu_.Serialize(state);
+  spu_.Serialize(state);
+  irq_.Serialize(state);
+  timer_.Serialize(state);
+  extmem_.Serialize(state);
+  gpio_.Serialize(state);
+  adc_.Serialize(state);
+  uart_.Serialize(state);
+  dma_.Serialize(state);
+
+  if (!state.IsLoading())
+    return;
+  UpdatePageTable();
+  // The components drop what they cached from RAM. What they cached from
+  // external memory stays good unless it is mapped differently now; the
+  // machine's owner reports changes to what is in it.
+  if (extmem_.GetControl() != old_extmem_control)
+    InvalidateExternalMemoryCaches();
 }
 
 void Spg200::Step() {}
 
 void Spg200::RunFrame() {
+  // Joystick input may have changed since the last frame
+  UpdateNextEvent();
+
   for (;;) {
     int cycles = cpu_.Step();
     cycle_count_ += cycles;
     // cpu_.PrintRegisterState();
 
-    io_.RunCycles(cycles);
-    adc_.RunCycles(cycles);
-    uart_.RunCycles(cycles);
-    timer_.RunCycles(cycles);
-    spu_.RunCycles(cycles);
-    if (ppu_.RunCycles(cycles))
+    if (cycle_count_ >= next_event_ && ProcessEvents(cycles))
       break;
   }
+
+  // Finish the frame's audio
+  spu_.Sync();
+}
+
+bool Spg200::RunDevices(int cycles) {
+  io_.RunCycles(cycles);
+  adc_.RunCycles(cycles);
+  uart_.RunCycles(cycles);
+  timer_.RunCycles(cycles);
+  spu_.RunCycles(cycles);
+  return ppu_.RunCycles(cycles);
+}
+
+bool Spg200::ProcessEvents(int cycles) {
+  // No device changes state before the instruction that reaches next_event_,
+  // so the cycles up to it can be run in one batch. The instruction itself is
+  // run separately so that every clock sees the same deltas as it would have
+  // when stepped after each instruction.
+  SyncDevices(cycle_count_ - cycles);
+  devices_synced_ = cycle_count_;
+  const bool frame_finished = RunDevices(cycles);
+  UpdateNextEvent();
+  return frame_finished;
+}
+
+void Spg200::SyncDevices(uint64_t cycle) {
+  // Nothing is due before next_event_, so this never finishes a frame.
+  // devices_synced_ is updated first, as devices reading SPU registers through
+  // the bus end up back here.
+  if (cycle > devices_synced_) {
+    const int cycles = cycle - devices_synced_;
+    devices_synced_ = cycle;
+    RunDevices(cycles);
+  }
+}
+
+void Spg200::SyncSpu() {
+  // The SPU generates samples lazily and is usually behind the CPU
+  SyncDevices(cycle_count_);
+  spu_.Sync();
+}
+
+void Spg200::UpdateNextEvent() {
+  int cycles = io_.GetCyclesToNextEvent();
+  cycles = std::min(cycles, adc_.GetCyclesToNextEvent());
+  cycles = std::min(cycles, uart_.GetCyclesToNextEvent());
+  cycles = std::min(cycles, timer_.GetCyclesToNextEvent());
+  cycles = std::min(cycles, spu_.GetCyclesToNextEvent());
+  cycles = std::min(cycles, ppu_.GetCyclesToNextEvent());
+  next_event_ = devices_synced_ + cycles;
+}
+
+void Spg200::UpdatePageTable() {
+  for (addr_t page = 0; page < kNumPages; page++) {
+    const addr_t addr = page << kPageBits;
+    if (addr < ram_.size()) {
+      read_pages_[page] = &ram_[addr];
+      write_pages_[page] = &ram_[addr];
+    } else if (addr >= 0x4000) {
+      read_pages_[page] = extmem_.GetReadPtr(addr);
+      write_pages_[page] = extmem_.GetWritePtr(addr);
+    } else {
+      read_pages_[page] = nullptr;
+      write_pages_[page] = nullptr;
+    }
+  }
 }
 
 std::span<uint8_t> Spg200::GetPicture() const {
   return ppu_.GetFramebuffer();
 }
 
-std::span<uint16_t> Spg200::GetAudio() {
-  return spu_.GetAudio();
+AudioRingBuffer& Spg200::GetAudioBuffer() {
+  return spu_.GetAudioBuffer();
+}
+
+void Spg200::SetPixelFormat(PixelFormat pixel_format) {
+  ppu_.SetPixelFormat(pixel_format);
 }
 
 void Spg200::SetPpuViewSettings(PpuViewSettings& ppu_view_settings) {
   ppu_.SetViewSettings(ppu_view_settings);
 }
 
+TileCacheStats Spg200::GetTileCacheStats() const {
+  return ppu_.GetTileCacheStats();
+}
+
+WaveCacheStats Spg200::GetWaveCacheStats() const {
+  return spu_.GetWaveCacheStats();
+}
+
+bool Spg200::StartStemCapture(const std::string& path_prefix) {
+  // Samples still pending belong before the capture
+  SyncSpu();
+  return spu_.StartStemCapture(path_prefix);
+}
+
+void Spg200::StopStemCapture() {
+  SyncSpu();
+  spu_.StopStemCapture();
+}
+
+bool Spg200::IsCapturingStems() const {
+  return spu_.IsCapturingStems();
+}
+
+void Spg200::SetAudioMuted(bool muted) {
+  spu_.SetOutputMuted(muted);
+}
+
+double Spg200::GetFrameRate() const {
+  return ppu_.GetFrameRate();
+}
+
+void Spg200::InvalidateExternalMemoryCaches() {
+  cpu_.FlushDecodeCache();
+  ppu_.InvalidateTileCache();
+  spu_.InvalidateWaveCache();
+}
+
 void Spg200::UartTx(uint8_t value) {
   uart_.RxStart(value);
 }
@@ -74,8 +220,7 @@ void Spg200::SetExt2Irq(bool value) {
   irq_.SetExt2Irq(value);
 }
 
-word_t Spg200::ReadWord(addr_t addr) {
-  addr = addr & 0x3fffff;
+word_t Spg200::ReadIoWord(addr_t addr) {
   switch (addr) {
     case 0 ... 0x27ff:
       return ram_[addr];
@@ -152,6 +297,108 @@ word_t Spg200::ReadWord(addr_t addr) {
       return ppu_.GetPaletteColor(addr & 0xff);
     case 0x2c00 ... 0x2fff:
       return ppu_.ReadSpriteMemory(addr & 0x3ff);
+    case 0x3000 ... 0x34ff:
+      SyncSpu();
+      return ReadSpuWord(addr);
+    case 0x3d00:
+      return gpio_.GetMode();
+    case 0x3d01:
+    case 0x3d06:
+    case 0x3d0b: {
+      int port_index = (addr - 0x3d01) / 5;
+      return gpio_.GetData(port_index);
+    }
+    case 0x3d02:
+    case 0x3d07:
+    case 0x3d0c: {
+      int port_index = (addr - 0x3d01) / 5;
+      return gpio_.GetBuffer(port_index);
+    }
+    case 0x3d03:
+    case 0x3d08:
+    case 0x3d0d: {
+      int port_index = (addr - 0x3d01) / 5;
+      return gpio_.GetDir(port_index);
+    }
+    case 0x3d04:
+    case 0x3d09:
+    case 0x3d0e: {
+      int port_index = (addr - 0x3d01) / 5;
+      return gpio_.GetAttrib(port_index);
+    }
+    case 0x3d05:
+    case 0x3d0a:
+    case 0x3d0f: {
+      int port_index = (addr - 0x3d01) / 5;
+      return gpio_.GetMask(port_index);
+    }
+    case 0x3d10:
+      return timer_.GetTimebaseSetup();
+    case 0x3d12:
+      return timer_.GetTimerAData();
+    case 0x3d13:
+      return timer_.GetTimerAControl();
+    case 0x3d14:
+      return timer_.GetTimerAEnabled();
+    case 0x3d16:
+      return timer_.GetTimerBData();
+    case 0x3d17:
+      return timer_.GetTimerBControl();
+    case 0x3d18:
+      return timer_.GetTimerBEnabled();
+    case 0x3d1c:
+      return ppu_.GetLineCounter();
+    /* 0x3d20 - System control */
+    case 0x3d21:
+      return irq_.GetIoIrqControl();
+    case 0x3d22:
+      return irq_.GetIoIrqStatus();
+    case 0x3d23:
+      return extmem_.GetControl();
+      /* 0x3d24 - Watchdog clear */
+    case 0x3d25:
+      return adc_.GetControl();
+    case 0x3d27:
+      return adc_.GetData();
+    case 0x3d2b:
+      return video_timing_ == VideoTiming::PAL;
+    case 0x3d2c:
+      return random1_.Get();
+    case 0x3d2d:
+      return random2_.Get();
+    case 0x3d2e:
+      return irq_.GetFiqSelect();
+    case 0x3d2f:
+      return cpu_.GetDs();
+    case 0x3d30:
+      return uart_.GetControl();
+    case 0x3d31:
+      return uart_.GetStatus();
+    case 0x3d33:
+      return uart_.GetBaudLo();
+    case 0x3d34:
+      return uart_.GetBaudHi();
+    case 0x3d35:
+      return uart_.GetTx();
+    case 0x3d36:
+      return uart_.Rx();
+    case 0x3e00:
+      return dma_.GetSourceLo();
+    case 0x3e01:
+      return dma_.GetSourceHi();
+    case 0x3e02:
+      return dma_.GetLength();
+    case 0x3e03:
+      return dma_.GetTarget();
+    case 0x4000 ... 0x3fffff:
+      return extmem_.ReadWord(addr);
+    default:
+      return 0;
+  }
+};
+
+word_t Spg200::ReadSpuWord(addr_t addr) {
+  switch (addr) {
     case 0x3000 ... 0x30ff: {
       int channel_index = (addr >> 4) & 0xf;
       switch (addr & 0xf) {
@@ -248,108 +495,16 @@ word_t Spg200::ReadWord(addr_t addr) {
       return spu_.GetChannelEnvIrq();
     case 0x3418:
       return spu_.GetChannelPitchBend();
-    case 0x3d00:
-      return gpio_.GetMode();
-    case 0x3d01:
-    case 0x3d06:
-    case 0x3d0b: {
-      int port_index = (addr - 0x3d01) / 5;
-      return gpio_.GetData(port_index);
-    }
-    case 0x3d02:
-    case 0x3d07:
-    case 0x3d0c: {
-      int port_index = (addr - 0x3d01) / 5;
-      return gpio_.GetBuffer(port_index);
-    }
-    case 0x3d03:
-    case 0x3d08:
-    case 0x3d0d: {
-      int port_index = (addr - 0x3d01) / 5;
-      return gpio_.GetDir(port_index);
-    }
-    case 0x3d04:
-    case 0x3d09:
-    case 0x3d0e: {
-      int port_index = (addr - 0x3d01) / 5;
-      return gpio_.GetAttrib(port_index);
-    }
-    case 0x3d05:
-    case 0x3d0a:
-    case 0x3d0f: {
-      int port_index = (addr - 0x3d01) / 5;
-      return gpio_.GetMask(port_index);
-    }
-    case 0x3d10:
-      return timer_.GetTimebaseSetup();
-    case 0x3d12:
-      return timer_.GetTimerAData();
-    case 0x3d13:
-      return timer_.GetTimerAControl();
-    case 0x3d14:
-      return timer_.GetTimerAEnabled();
-    case 0x3d16:
-      return timer_.GetTimerBData();
-    case 0x3d17:
-      return timer_.GetTimerBControl();
-    case 0x3d18:
-      return timer_.GetTimerBEnabled();
-    case 0x3d1c:
-      return ppu_.GetLineCounter();
-    /* 0x3d20 - System control */
-    case 0x3d21:
-      return irq_.GetIoIrqControl();
-    case 0x3d22:
-      return irq_.GetIoIrqStatus();
-    case 0x3d23:
-      return extmem_.GetControl();
-      /* 0x3d24 - Watchdog clear */
-    case 0x3d25:
-      return adc_.GetControl();
-    case 0x3d27:
-      return adc_.GetData();
-    case 0x3d2b:
-      return video_timing_ == VideoTiming::PAL;
-    case 0x3d2c:
-      return random1_.Get();
-    case 0x3d2d:
-      return random2_.Get();
-    case 0x3d2e:
-      return irq_.GetFiqSelect();
-    case 0x3d2f:
-      return cpu_.GetDs();
-    case 0x3d30:
-      return uart_.GetControl();
-    case 0x3d31:
-      return uart_.GetStatus();
-    case 0x3d33:
-      return uart_.GetBaudLo();
-    case 0x3d34:
-      return uart_.GetBaudHi();
-    case 0x3d35:
-      return uart_.GetTx();
-    case 0x3d36:
-      return uart_.Rx();
-    case 0x3e00:
-      return dma_.GetSourceLo();
-    case 0x3e01:
-      return dma_.GetSourceHi();
-    case 0x3e02:
-      return dma_.GetLength();
-    case 0x3e03:
-      return dma_.GetTarget();
-    case 0x4000 ... 0x3fffff:
-      return extmem_.ReadWord(addr);
     default:
       return 0;
   }
-};
+}
 
-void Spg200::WriteWord(addr_t addr, word_t value) {
-  addr = addr & 0x3fffff;
+void Spg200::WriteIoWord(addr_t addr, word_t value) {
   switch (addr) {
     case 0 ... 0x27ff:
       ram_[addr] = value;
+      cpu_.InvalidateDecodeCache(addr);
       return;
     case 0x2810:
     case 0x2816: {
@@ -447,6 +602,168 @@ void Spg200::WriteWord(addr_t addr, word_t value) {
     case 0x2c00 ... 0x2fff:
       ppu_.WriteSpriteMemory(addr & 0x3ff, value);
       return;
+    case 0x3000 ... 0x34ff:
+      // Register writes can change when the SPU next has to run
+      SyncSpu();
+      WriteSpuWord(addr, value);
+      UpdateNextEvent();
+      return;
+    case 0x3d00:
+      gpio_.SetMode(value);
+      return;
+    case 0x3d01:
+    case 0x3d02:
+    case 0x3d06:
+    case 0x3d07:
+    case 0x3d0b:
+    case 0x3d0c: {
+      int port_index = (addr - 0x3d01) / 5;
+      SyncDevices(cycle_count_);
+      gpio_.SetBuffer(port_index, value);
+      UpdateNextEvent();
+      return;
+    }
+    case 0x3d03:
+    case 0x3d08:
+    case 0x3d0d: {
+      int port_index = (addr - 0x3d01) / 5;
+      SyncDevices(cycle_count_);
+      gpio_.SetDir(port_index, value);
+      UpdateNextEvent();
+      return;
+    }
+    case 0x3d04:
+    case 0x3d09:
+    case 0x3d0e: {
+      int port_index = (addr - 0x3d01) / 5;
+      SyncDevices(cycle_count_);
+      gpio_.SetAttrib(port_index, value);
+      UpdateNextEvent();
+      return;
+    }
+    case 0x3d05:
+    case 0x3d0a:
+    case 0x3d0f: {
+      int port_index = (addr - 0x3d01) / 5;
+      SyncDevices(cycle_count_);
+      gpio_.SetMask(port_index, value);
+      UpdateNextEvent();
+      return;
+    }
+    case 0x3d10:
+      timer_.SetTimebaseSetup(value);
+      return;
+    case 0x3d11:
+      timer_.ClearTimebaseCounter();
+      return;
+    case 0x3d12:
+      timer_.SetTimerAData(value);
+      return;
+    case 0x3d13:
+      timer_.SetTimerAControl(value);
+      return;
+    case 0x3d14:
+      timer_.SetTimerAEnabled(value);
+      return;
+    case 0x3d15:
+      timer_.ClearTimerAIrq();
+      return;
+    case 0x3d16:
+      timer_.SetTimerBData(value);
+      return;
+    case 0x3d17:
+      timer_.SetTimerBControl(value);
+      return;
+    case 0x3d18:
+      timer_.SetTimerBEnabled(value);
+      return;
+    case 0x3d19:
+      timer_.ClearTimerBIrq();
+      return;
+    /* 0x3d20 - System control */
+    case 0x3d21:
+      irq_.SetIoIrqControl(value);
+      return;
+    case 0x3d22:
+      irq_.ClearIoIrqStatus(value);
+      return;
+    case 0x3d23: {
+      // Samples the SPU has yet to generate read through the old memory map
+      SyncSpu();
+      const word_t old_control = extmem_.GetControl();
+      extmem_.SetControl(value);
+      if (extmem_.GetControl() != old_control) {
+        UpdatePageTable();
+        InvalidateExternalMemoryCaches();
+      }
+      return;
+    }
+    /* 0x3d24 - Watchdog clear */
+    case 0x3d25:
+      SyncDevices(cycle_count_);
+      adc_.SetControl(value);
+      UpdateNextEvent();
+      return;
+    /* 0x3d28...0x3d2a - Sleep/wakeup */
+    case 0x3d2c:
+      random1_.Set(value);
+      return;
+    case 0x3d2d:
+      random2_.Set(value);
+      return;
+    case 0x3d2e:
+      irq_.SetFiqSelect(value);
+      return;
+    case 0x3d2f:
+      cpu_.SetDs(value);
+      return;
+    case 0x3d30:
+      SyncDevices(cycle_count_);
+      uart_.SetControl(value);
+      UpdateNextEvent();
+      return;
+    case 0x3d31:
+      uart_.SetStatus(value);
+      return;
+    case 0x3d32:
+      uart_.SoftReset();
+      return;
+    case 0x3d33:
+      uart_.SetBaudLo(value);
+      return;
+    case 0x3d34:
+      uart_.SetBaudHi(value);
+      return;
+    case 0x3d35:
+      SyncDevices(cycle_count_);
+      uart_.Tx(value);
+      UpdateNextEvent();
+      return;
+    case 0x3e00:
+      dma_.SetSourceLo(value);
+      return;
+    case 0x3e01:
+      dma_.SetSourceHi(value);
+      return;
+    case 0x3e02:
+      dma_.StartDma(value);
+      return;
+    case 0x3e03:
+      dma_.SetTarget(value);
+      return;
+    case 0x4000 ... 0x3fffff:
+      SyncSpu();
+      extmem_.WriteWord(addr, value);
+      cpu_.InvalidateDecodeCache(addr);
+      ppu_.InvalidateTileCache(addr);
+      return;
+    default:
+      return;  // ignore writes
+  }
+};
+
+void Spg200::WriteSpuWord(addr_t addr, word_t value) {
+  switch (addr) {
     case 0x3000 ... 0x30ff: {
       int channel = (addr >> 4) & 0xf;
       switch (addr & 0xf) {
@@ -582,130 +899,7 @@ void Spg200::WriteWord(addr_t addr, word_t value) {
     case 0x3418:
       spu_.SetChannelPitchBend(value);
       return;
-    case 0x3d00:
-      gpio_.SetMode(value);
-      return;
-    case 0x3d01:
-    case 0x3d02:
-    case 0x3d06:
-    case 0x3d07:
-    case 0x3d0b:
-    case 0x3d0c: {
-      int port_index = (addr - 0x3d01) / 5;
-      gpio_.SetBuffer(port_index, value);
-      return;
-    }
-    case 0x3d03:
-    case 0x3d08:
-    case 0x3d0d: {
-      int port_index = (addr - 0x3d01) / 5;
-      gpio_.SetDir(port_index, value);
-      return;
-    }
-    case 0x3d04:
-    case 0x3d09:
-    case 0x3d0e: {
-      int port_index = (addr - 0x3d01) / 5;
-      gpio_.SetAttrib(port_index, value);
-      return;
-    }
-    case 0x3d05:
-    case 0x3d0a:
-    case 0x3d0f: {
-      int port_index = (addr - 0x3d01) / 5;
-      gpio_.SetMask(port_index, value);
-      return;
-    }
-    case 0x3d10:
-      timer_.SetTimebaseSetup(value);
-      return;
-    case 0x3d11:
-      timer_.ClearTimebaseCounter();
-      return;
-    case 0x3d12:
-      timer_.SetTimerAData(value);
-      return;
-    case 0x3d13:
-      timer_.SetTimerAControl(value);
-      return;
-    case 0x3d14:
-      timer_.SetTimerAEnabled(value);
-      return;
-    case 0x3d15:
-      timer_.ClearTimerAIrq();
-      return;
-    case 0x3d16:
-      timer_.SetTimerBData(value);
-      return;
-    case 0x3d17:
-      timer_.SetTimerBControl(value);
-      return;
-    case 0x3d18:
-      timer_.SetTimerBEnabled(value);
-      return;
-    case 0x3d19:
-      timer_.ClearTimerBIrq();
-      return;
-    /* 0x3d20 - System control */
-    case 0x3d21:
-      irq_.SetIoIrqControl(value);
-      return;
-    case 0x3d22:
-      irq_.ClearIoIrqStatus(value);
-      return;
-    case 0x3d23:
-      extmem_.SetControl(value);
-      return;
-    /* 0x3d24 - Watchdog clear */
-    case 0x3d25:
-      adc_.SetControl(value);
-      return;
-    /* 0x3d28...0x3d2a - Sleep/wakeup */
-    case 0x3d2c:
-      random1_.Set(value);
-      return;
-    case 0x3d2d:
-      random2_.Set(value);
-      return;
-    case 0x3d2e:
-      irq_.SetFiqSelect(value);
-      return;
-    case 0x3d2f:
-      cpu_.SetDs(value);
-      return;
-    case 0x3d30:
-      uart_.SetControl(value);
-      return;
-    case 0x3d31:
-      uart_.SetStatus(value);
-      return;
-    case 0x3d32:
-      uart_.SoftReset();
-      return;
-    case 0x3d33:
-      uart_.SetBaudLo(value);
-      return;
-    case 0x3d34:
-      uart_.SetBaudHi(value);
-      return;
-    case 0x3d35:
-      uart_.Tx(value);
-      return;
-    case 0x3e00:
-      dma_.SetSourceLo(value);
-      return;
-    case 0x3e01:
-      dma_.SetSourceHi(value);
-      return;
-    case 0x3e02:
-      dma_.StartDma(value);
-      return;
-    case 0x3e03:
-      dma_.SetTarget(value);
-      return;
-    case 0x4000 ... 0x3fffff:
-      extmem_.WriteWord(addr, value);
     default:
       return;  // ignore writes
   }
-};
+}
@@ -17,8 +17,9 @@
 #include "uart.h"
 
 class Spg200Io;
+class StateSerializer;
 
-class Spg200 : public BusInterface {
+class Spg200 final : public BusInterface {
 public:
   Spg200(VideoTiming video_timing, Spg200Io& io);
   ~Spg200() = default;
@@ -26,27 +27,66 @@ public:
   void RunFrame();
   void Step();
   void Reset();
+  void Serialize(StateSerializer& state);
 
   void UartTx(uint8_t value);
   void SetExt1Irq(bool value);
   void SetExt2Irq(bool value);
 
   std::span<uint8_t> GetPicture() const;
-  std::span<uint16_t> GetAudio();
+  AudioRingBuffer& GetAudioBuffer();
 
+  void SetPixelFormat(PixelFormat pixel_format);
   void SetPpuViewSettings(PpuViewSettings& ppu_view_settings);
+  TileCacheStats GetTileCacheStats() const;
+  WaveCacheStats GetWaveCacheStats() const;
+  bool StartStemCapture(const std::string& path_prefix);
+  void StopStemCapture();
+  bool IsCapturingStems() const;
+  void SetAudioMuted(bool muted);
+  double GetFrameRate() const;
+  // Drops what the CPU, PPU and SPU cache from external memory, for when it
+  // changes other than through the bus
+  void InvalidateExternalMemoryCaches();
 
   // BusInterface
   word_t ReadWord(addr_t addr) override;
-  void WriteWord(addr_t addr, word_t val) override;
+  void WriteWord(addr_t addr, word_t value) override;
+  bool IsReadOnly(addr_t addr) const override;
 
 private:
+  static constexpr int kPageBits = 10;
+  static constexpr addr_t kPageMask = (1 << kPageBits) - 1;
+  static constexpr std::size_t kNumPages = 0x400000 >> kPageBits;
+
+  void UpdatePageTable();
+  word_t ReadIoWord(addr_t addr);
+  void WriteIoWord(addr_t addr, word_t value);
+  word_t ReadSpuWord(addr_t addr);
+  void WriteSpuWord(addr_t addr, word_t value);
+
+  bool RunDevices(int cycles);
+  bool ProcessEvents(int cycles);
+  void SyncDevices(uint64_t cycle);
+  void SyncSpu();
+  void UpdateNextEvent();
+
   uint64_t cycle_count_ = 0;
+  // Peripherals only run when one of them may change state. devices_synced_
+  // is the cycle they have been run up to, next_event_ the earliest cycle at
+  // which any of them needs to run again.
+  uint64_t devices_synced_ = 0;
+  uint64_t next_event_ = 0;
 
   const VideoTiming video_timing_;
   Spg200Io& io_;
 
   std::array<uint16_t, 0x2800> ram_ = {0};
+
+  // Host memory for each 1K-word page of the address space, or nullptr where
+  // accesses have to go through the I/O register switch.
+  std::array<const word_t*, kNumPages> read_pages_ = {};
+  std::array<word_t*, kNumPages> write_pages_ = {};
   Cpu cpu_;
   Ppu ppu_;
   Spu spu_;
@@ -59,4 +99,33 @@ private:
   Dma dma_;
   Random random1_;
   Random random2_;
-};
\ No newline at end of file
+};
+
+// Defined here so that RAM and ROM accesses inline into the CPU, PPU and SPU.
+inline word_t Spg200::ReadWord(addr_t addr) {
+  addr = addr & 0x3fffff;
+  if (const word_t* page = read_pages_[addr >> kPageBits])
+    return page[addr & kPageMask];
+  return ReadIoWord(addr);
+}
+
+inline void Spg200::WriteWord(addr_t addr, word_t value) {
+  addr = addr & 0x3fffff;
+  if (word_t* page = write_pages_[addr >> kPageBits]) {
+    // Samples the SPU has yet to generate may read the old value
+    if (addr >= 0x4000)
+      SyncSpu();
+    page[addr & kPageMask] = value;
+    cpu_.InvalidateDecodeCache(addr);
+    if (addr >= 0x4000)
+      ppu_.InvalidateTileCache(addr);
+    return;
+  }
+  WriteIoWord(addr, value);
+}
+
+inline bool Spg200::IsReadOnly(addr_t addr) const {
+  // External memory without a write pointer is ROM; writes to it are ignored
+  addr = addr & 0x3fffff;
+  return addr >= 0x4000 && read_pages_[addr >> kPageBits] && !write_pages_[addr >> kPageBits];
+}
@@ -7,6 +7,8 @@ public:
   virtual ~Spg200Io() = default;
 
   virtual void RunCycles(int cycles) = 0;
+  // Cycles until RunCycles() may next change state, or kNoEvent.
+  virtual int GetCyclesToNextEvent() = 0;
 
   virtual unsigned GetAdc0() = 0;
   virtual unsigned GetAdc1() = 0;
@@ -29,6 +31,17 @@ public:
   virtual word_t ReadCsb3(addr_t addr) = 0;
   virtual void WriteCsb3(addr_t addr, word_t value) = 0;
 
+  // Host memory backing the chip select at addr, used to map whole pages
+  // directly. Returning nullptr routes accesses through the functions above.
+  virtual const word_t* GetRomCsbReadPtr(addr_t addr) = 0;
+  virtual word_t* GetRomCsbWritePtr(addr_t addr) = 0;
+  virtual const word_t* GetCsb1ReadPtr(addr_t addr) = 0;
+  virtual word_t* GetCsb1WritePtr(addr_t addr) = 0;
+  virtual const word_t* GetCsb2ReadPtr(addr_t addr) = 0;
+  virtual word_t* GetCsb2WritePtr(addr_t addr) = 0;
+  virtual const word_t* GetCsb3ReadPtr(addr_t addr) = 0;
+  virtual word_t* GetCsb3WritePtr(addr_t addr) = 0;
+
   virtual void TxUart(uint8_t value) = 0;
   virtual void RxUartDone() = 0;
 };
\ No newline at end of file
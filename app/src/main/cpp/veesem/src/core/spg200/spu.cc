@@ -1,10 +1,13 @@
 #include "spu.h"
 
-#include "bus_interface.h"
+#include "core/state_serializer.h"
 #include "cpu.h"
 #include "irq.h"
+#include "spg200.h"
+#include "spu_mix.h"
 
 #include <algorithm>
+#include <bit>
 
 static const int kEnvelopeFrameDivides[] = {2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 13, 13, 13, 13};
 
@@ -12,15 +15,19 @@ static const int kRampdownFrameDivides[] = {2, 4, 6, 8, 10, 12, 13, 13};
 
 static const int kPitchbendFrameDivides[] = {3, 4, 5, 6, 7, 8, 9, 10};
 
-Spu::Spu(BusInterface& bus, Irq& irq) : bus_(bus), irq_(irq) {}
+Spu::Spu(Bus& bus, Irq& irq) : bus_(bus), irq_(irq) {}
 
 void Spu::Reset() {
-  audio_buffer_pos_ = 0;
+  pending_cycles_ = 0;
+  syncing_ = false;
   sample_clock_.Reset();
   envelope_clock_.Reset();
   rampdown_clock_.Reset();
 
   channel_data_.fill({});
+  wave_cache_.Invalidate();
+  left_gain_.fill(0);
+  right_gain_.fill(0);
   channel_enable_.reset();
   channel_fiq_enable_.reset();
   channel_fiq_status_.reset();
@@ -44,7 +51,114 @@ void Spu::Reset() {
   control_.raw = 0;
 }
 
+void Spu::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("SPU ", 1))
+    return;
+
+  // Cached runs are not saved, only where the channels are in them. Channels
+  // keep playing from theirs after a save, and after a load if the state has
+  // them somewhere else in the same run.
+  std::array<WavePosition, 16> old_positions;
+  for (int channel_index = 0; channel_index < 16; channel_index++) {
+    if (!state.IsLoading())
+      SyncWaveRunDecoder(channel_index);
+    const auto& channel = channel_data_[channel_index];
+    old_positions[channel_index] = {channel.wave_address, channel.wave_shift,
+                                    GetWaveFormat(channel_index)};
+  }
+
+  state.Value(pending_cycles_);
+  sample_clock_.Serialize(state);
+  envelope_clock_.Serialize(state);
+  rampdown_clock_.Serialize(state);
+
+  for (auto& channel : channel_data_) {
+    state.Value(channel.wave_address);
+    state.Value(channel.loop_address);
+    state.Value(channel.wave_shift);
+    state.Value(channel.envelope_address);
+    state.Value(channel.mode.raw);
+    state.Value(channel.pan.raw);
+    state.Value(channel.envelope0.raw);
+    state.Value(channel.envelope1.raw);
+    state.Value(channel.envelope_irq.raw);
+    state.Value(channel.envelope_data.raw);
+    state.Value(channel.envelope_loop_control.raw);
+    state.Value(channel.wave_data_0);
+    state.Value(channel.wave_data);
+    state.Value(channel.phase);
+    state.Value(channel.phase_acc);
+    state.Value(channel.target_phase);
+    state.Value(channel.env_clk);
+    state.Value(channel.rampdown_clk);
+    state.Value(channel.pitch_bend_control.raw);
+    channel.adpcm.Serialize(state);
+  }
+
+  state.Value(channel_enable_);
+  state.Value(channel_fiq_enable_);
+  state.Value(channel_fiq_status_);
+  state.Value(channel_env_rampdown_);
+  state.Value(channel_stop_);
+  state.Value(channel_zero_cross_);
+  state.Value(channel_repeat_);
+  state.Value(channel_env_mode_);
+  state.Value(channel_tone_release_);
+  state.Value(channel_env_irq_);
+  state.Value(channel_pitch_bend_);
+
+  state.Value(wave_out_l_);
+  state.Value(wave_out_r_);
+  state.Value(wave_in_l_);
+  state.Value(wave_in_r_);
+  state.Value(main_volume_);
+  state.Value(beat_base_count_);
+  state.Value(current_beat_base_count_);
+  state.Value(beat_count_.raw);
+  state.Value(control_.raw);
+  state.EndChunk();
+
+  if (state.IsLoading()) {
+    for (int channel_index = 0; channel_index < 16; channel_index++) {
+      UpdateGains(channel_index);
+      if (!state.IsOk() || !SeekWaveRun(channel_index, old_positions[channel_index]))
+        channel_data_[channel_index].wave_run.reset();
+    }
+  }
+}
+
 void Spu::RunCycles(int cycles) {
+  pending_cycles_ += cycles;
+  if (pending_cycles_ >= GetCyclesToSync())
+    Sync();
+}
+
+void Spu::Sync() {
+  // Wave data may be read from the SPU's own registers, which syncs again
+  if (syncing_)
+    return;
+
+  // Step from tick to tick, so that every tick is handled at its own cycle
+  // even when a long instruction covers two of them
+  syncing_ = true;
+  while (pending_cycles_ > 0) {
+    // With no channel playing and the beat counter stopped, ticks change
+    // nothing but the clocks, and every sample comes out the same
+    if (!GetActiveChannels() && !current_beat_base_count_ && !stem_capture_) {
+      GenerateIdleSamples(pending_cycles_);
+      pending_cycles_ = 0;
+      break;
+    }
+
+    const int cycles = std::min({pending_cycles_, sample_clock_.GetCyclesToTick(),
+                                 envelope_clock_.GetCyclesToTick()});
+    pending_cycles_ -= cycles;
+    Tick(cycles);
+  }
+  syncing_ = false;
+}
+
+void Spu::Tick(int cycles) {
   if (sample_clock_.Tick(cycles)) {
     GenerateSample();
   }
@@ -74,13 +188,66 @@ void Spu::RunCycles(int cycles) {
   }
 }
 
+int Spu::GetCyclesToNextEvent() const {
+  const int cycles = GetCyclesToSync();
+  return cycles == kNoEvent ? kNoEvent : cycles - pending_cycles_;
+}
+
+int Spu::GetCyclesToSync() const {
+  // Counted from the last Sync(). The CPU only sees the SPU through its
+  // registers, which are synced on access, and through interrupts, which have
+  // to be raised on time.
+  const int to_sample = sample_clock_.GetCyclesToTick();
+  const int to_envelope_tick = envelope_clock_.GetCyclesToTick();
+  int cycles = kNoEvent;
+
+  if (beat_count_.irq_enable && current_beat_base_count_) {
+    cycles = to_envelope_tick + (current_beat_base_count_ - 1) * kCyclesPerEnvelopeTick;
+  }
+
+  for (unsigned active = GetActiveChannels(); active; active &= active - 1) {
+    const int channel_index = std::countr_zero(active);
+    const auto& channel = channel_data_[channel_index];
+
+    // Wave or envelope data in RAM or I/O space may be changed by the CPU at
+    // any time, so such channels have to be run sample by sample.
+    const bool wave_in_ram =
+        channel.mode.tone_mode != 0 &&
+        (channel.wave_address < 0x4000 ||
+         (channel.mode.tone_mode == 2 && channel.loop_address < 0x4000));
+    const bool envelope_in_ram =
+        !channel_env_mode_[channel_index] && channel.envelope_address < 0x4000;
+    if (wave_in_ram || envelope_in_ram)
+      return to_sample;
+
+    if (channel.envelope_irq.irq_enable)
+      cycles = std::min(cycles, to_envelope_tick);
+
+    if (channel_fiq_enable_[channel_index]) {
+      // Pitch bends only change the phase on envelope ticks
+      if (channel_pitch_bend_[channel_index])
+        cycles = std::min(cycles, to_envelope_tick);
+      if (channel.phase) {
+        const int samples = (0x80000 - channel.phase_acc + channel.phase - 1) / channel.phase;
+        cycles = std::min(cycles, to_sample + (samples - 1) * kCyclesPerSample);
+      }
+    }
+  }
+
+  return cycles;
+}
+
+unsigned Spu::GetActiveChannels() const {
+  return (channel_enable_ & ~channel_stop_).to_ulong();
+}
+
 void Spu::GenerateSample() {
-  int32_t left_out = 0;
-  int32_t right_out = 0;
-  for (int channel_index = 0; channel_index < 16; channel_index++) {
+  // Channels are ticked and interpolated one by one, then panned and summed in
+  // parallel by MixChannels(). Lanes of idle channels hold zero and add nothing.
+  alignas(16) std::array<int32_t, 16> samples = {};
+  for (unsigned active = GetActiveChannels(); active; active &= active - 1) {
+    const int channel_index = std::countr_zero(active);
     const auto& channel = channel_data_[channel_index];
-    if (!channel_enable_[channel_index] || channel_stop_[channel_index])
-      continue;
     TickChannel(channel_index);
 
     uint16_t prev_sample_part =
@@ -88,16 +255,34 @@ void Spu::GenerateSample() {
     uint16_t cur_sample_part = (static_cast<uint64_t>(channel.wave_data) * channel.phase_acc) >> 19;
     int16_t sample = (prev_sample_part + cur_sample_part) - 0x8000;
 
-    const auto& pan = channel.pan;
-    int left_pan = std::clamp((0x80 - static_cast<int>(pan.pan)) * 2, 0x0, 0x7f);
-    int right_pan = std::clamp(static_cast<int>(pan.pan) * 2, 0x0, 0x7f);
+    samples[channel_index] = (sample * static_cast<int>(channel.envelope_data.edd)) >> 7;
+  }
+
+  int32_t left_out;
+  int32_t right_out;
+  MixChannels(samples, left_gain_, right_gain_, left_out, right_out);
 
-    sample = (sample * static_cast<int>(channel.envelope_data.edd)) >> 7;
+  MixOutput(left_out, right_out);
+  if (output_muted_)
+    return;
+  audio_buffer_.WriteFrame(wave_out_l_, wave_out_r_);
 
-    left_out += (sample * left_pan * static_cast<int>(pan.volume)) >> 14;
-    right_out += (sample * right_pan * static_cast<int>(pan.volume)) >> 14;
-  }
+  if (stem_capture_)
+    stem_capture_->AddFrame(samples, wave_out_l_, wave_out_r_);
+}
+
+void Spu::GenerateIdleSamples(int cycles) {
+  const int samples = sample_clock_.TickMultiple(cycles);
+  rampdown_clock_.TickMultiple(envelope_clock_.TickMultiple(cycles));
+  if (samples == 0)
+    return;
+
+  MixOutput(0, 0);
+  if (!output_muted_)
+    audio_buffer_.WriteRepeated(wave_out_l_, wave_out_r_, samples);
+}
 
+void Spu::MixOutput(int32_t left_out, int32_t right_out) {
   left_out += (wave_in_l_ - 0x8000);
   right_out += (wave_in_r_ - 0x8000);
 
@@ -106,26 +291,19 @@ void Spu::GenerateSample() {
 
   wave_out_l_ = left_final ^ 0x8000;
   wave_out_r_ = right_final ^ 0x8000;
-
-  audio_buffer_[audio_buffer_pos_++] = wave_out_l_;
-  audio_buffer_[audio_buffer_pos_++] = wave_out_r_;
-  if (audio_buffer_pos_ == audio_buffer_.size() + 1)
-    audio_buffer_pos_ = 0;
 }
 
 void Spu::UpdateEnvelopes() {
-  for (int channel_index = 0; channel_index < 16; channel_index++) {
-    if (!channel_enable_[channel_index] || channel_stop_[channel_index])
-      continue;
+  for (unsigned active = GetActiveChannels(); active; active &= active - 1) {
+    const int channel_index = std::countr_zero(active);
     TickChannelEnvelope(channel_index);
     TickChannelPitchbend(channel_index);
   }
 }
 
 void Spu::UpdateRampdowns() {
-  for (int channel_index = 0; channel_index < 16; channel_index++) {
-    if (!channel_enable_[channel_index] || channel_stop_[channel_index])
-      continue;
+  for (unsigned active = GetActiveChannels(); active; active &= active - 1) {
+    const int channel_index = std::countr_zero(active);
     TickChannelRampdown(channel_index);
   }
 }
@@ -145,43 +323,159 @@ void Spu::TickChannel(int channel_index) {
     if (channel.mode.tone_mode == 0)
       return;  // TODO
 
-    word_t word = bus_.ReadWord(channel.wave_address);
+    const WaveFormat format = GetWaveFormat(channel_index);
 
-    if (channel.mode.adpcm) {
-      if (word == 0xffff) {
-        HandleEndMarker(channel_index);
-      } else {
-        const uint8_t adpcm_value = (word >> channel.wave_shift) & 0xf;
-        channel.wave_data = channel.adpcm.Decode(adpcm_value) ^ 0x8000;
-      }
-
-      channel.wave_shift += 4;
-      if (channel.wave_shift >= 16) {
-        channel.wave_shift = 0;
-        channel.wave_address++;
-      }
-    } else if (!channel.mode.tone_color) {
-      const uint8_t pcm_value = (word >> channel.wave_shift) & 0xff;
-      if (pcm_value == 0xff) {
-        HandleEndMarker(channel_index);
-      } else {
-        channel.wave_data = (pcm_value << 8) | pcm_value;
+    if (!channel.wave_run && bus_.IsReadOnly(channel.wave_address))
+      StartWaveRun(channel_index);
+    if (channel.wave_run) {
+      if (channel.wave_run_pos < channel.wave_run->samples.size()) {
+        channel.wave_data = channel.wave_run->samples[channel.wave_run_pos++];
+        StepWaveAddress(channel.wave_address, channel.wave_shift, format);
+        return;
       }
+      // At the end marker, or as far as the run could be decoded
+      LeaveWaveRun(channel_index);
+    }
 
-      channel.wave_shift += 8;
-      if (channel.wave_shift >= 16) {
-        channel.wave_shift = 0;
-        channel.wave_address++;
-      }
+    const word_t word = bus_.ReadWord(channel.wave_address);
+    uint16_t sample;
+    if (DecodeWaveSample(word, channel.wave_shift, format, channel.adpcm, sample)) {
+      channel.wave_data = sample;
     } else {
-      if (word == 0xffff) {
-        HandleEndMarker(channel_index);
-      } else {
-        channel.wave_data = word;
-      }
+      HandleEndMarker(channel_index);
+    }
+    // Stepped in the format the sample was read in, even if the end marker
+    // changed it
+    StepWaveAddress(channel.wave_address, channel.wave_shift, format);
+  }
+}
+
+Spu::WaveFormat Spu::GetWaveFormat(int channel_index) const {
+  const auto& mode = channel_data_[channel_index].mode;
+  if (mode.adpcm)
+    return WaveFormat::ADPCM;
+  return mode.tone_color ? WaveFormat::PCM16 : WaveFormat::PCM8;
+}
+
+void Spu::StartWaveRun(int channel_index) {
+  auto& channel = channel_data_[channel_index];
+  const WaveFormat format = GetWaveFormat(channel_index);
+
+  // The same data decodes the same way from the same position, except that
+  // ADPCM also depends on the decoder state
+  uint64_t key = (static_cast<uint64_t>(channel.wave_address & 0x3fffff) << 6) |
+                 (channel.wave_shift << 2) | static_cast<uint64_t>(format);
+  if (format == WaveFormat::ADPCM) {
+    key |= static_cast<uint64_t>(channel.adpcm.GetStepIndex()) << 28;
+    key |= static_cast<uint64_t>(static_cast<uint16_t>(channel.adpcm.GetLastSample())) << 35;
+  }
+
+  std::shared_ptr<const WaveRun> run = wave_cache_.Find(key);
+  if (!run) {
+    auto new_run = std::make_shared<WaveRun>();
+    addr_t address = channel.wave_address;
+    uint8_t shift = channel.wave_shift;
+    Adpcm adpcm = channel.adpcm;
+    uint16_t sample;
+    while (new_run->samples.size() < kMaxWaveRunLength && bus_.IsReadOnly(address) &&
+           DecodeWaveSample(bus_.ReadWord(address), shift, format, adpcm, sample)) {
+      new_run->samples.push_back(sample);
+      if (format == WaveFormat::ADPCM)
+        new_run->adpcm_step_indices.push_back(adpcm.GetStepIndex());
+      StepWaveAddress(address, shift, format);
+    }
+    new_run->samples.shrink_to_fit();
+    new_run->adpcm_step_indices.shrink_to_fit();
+
+    wave_cache_.Insert(key, new_run);
+    run = std::move(new_run);
+  }
+
+  channel.wave_run = std::move(run);
+  channel.wave_run_pos = 0;
+}
+
+void Spu::LeaveWaveRun(int channel_index) {
+  SyncWaveRunDecoder(channel_index);
+  channel_data_[channel_index].wave_run.reset();
+}
+
+void Spu::SyncWaveRunDecoder(int channel_index) {
+  auto& channel = channel_data_[channel_index];
+  if (!channel.wave_run)
+    return;
+
+  // The decoder is bypassed while playing from the run, so bring it up to the
+  // last sample played
+  const WaveRun& run = *channel.wave_run;
+  if (channel.wave_run_pos > 0 && !run.adpcm_step_indices.empty()) {
+    const uint32_t last = channel.wave_run_pos - 1;
+    channel.adpcm.SetState(run.adpcm_step_indices[last], run.samples[last] ^ 0x8000);
+  }
+}
 
-      channel.wave_address++;
+bool Spu::SeekWaveRun(int channel_index, const WavePosition& old_position) {
+  auto& channel = channel_data_[channel_index];
+  if (!channel.wave_run || GetWaveFormat(channel_index) != old_position.format)
+    return false;
+
+  const int bits_per_sample = old_position.format == WaveFormat::PCM16   ? 16
+                              : old_position.format == WaveFormat::ADPCM ? 4
+                                                                         : 8;
+  const int64_t bit_distance =
+      (static_cast<int64_t>(channel.wave_address) - old_position.address) * 16 +
+      (static_cast<int>(channel.wave_shift) - old_position.shift);
+  if (bit_distance % bits_per_sample != 0)
+    return false;
+  const int64_t pos = channel.wave_run_pos + bit_distance / bits_per_sample;
+  const WaveRun& run = *channel.wave_run;
+  if (pos < 0 || pos > static_cast<int64_t>(run.samples.size()))
+    return false;
+
+  // ADPCM samples also depend on the decoder state, which has to be the one
+  // the run had there
+  if (!run.adpcm_step_indices.empty()) {
+    if (pos == 0 || channel.adpcm.GetStepIndex() != run.adpcm_step_indices[pos - 1] ||
+        static_cast<uint16_t>(channel.adpcm.GetLastSample()) != (run.samples[pos - 1] ^ 0x8000))
+      return false;
+  }
+  channel.wave_run_pos = static_cast<uint32_t>(pos);
+  return true;
+}
+
+bool Spu::DecodeWaveSample(word_t word, uint8_t shift, WaveFormat format, Adpcm& adpcm,
+                           uint16_t& sample) {
+  switch (format) {
+    case WaveFormat::ADPCM:
+      if (word == 0xffff)
+        return false;
+      sample = adpcm.Decode((word >> shift) & 0xf) ^ 0x8000;
+      return true;
+    case WaveFormat::PCM8: {
+      const uint8_t pcm_value = (word >> shift) & 0xff;
+      if (pcm_value == 0xff)
+        return false;
+      sample = (pcm_value << 8) | pcm_value;
+      return true;
     }
+    case WaveFormat::PCM16:
+      if (word == 0xffff)
+        return false;
+      sample = word;
+      return true;
+  }
+  return false;
+}
+
+void Spu::StepWaveAddress(addr_t& address, uint8_t& shift, WaveFormat format) {
+  if (format == WaveFormat::PCM16) {
+    address++;
+    return;
+  }
+  shift += format == WaveFormat::ADPCM ? 4 : 8;
+  if (shift >= 16) {
+    shift = 0;
+    address++;
   }
 }
 
@@ -296,14 +590,23 @@ void Spu::TickChannelRampdown(int channel_index) {
 void Spu::StartChannel(int channel_index) {
   auto& channel = channel_data_[channel_index];
 
+  LeaveWaveRun(channel_index);
   channel.wave_shift = 0;
   channel.adpcm.Reset();
+  // Run-ahead frames are muted and played again later, so they are not captured
+  if (stem_capture_ && !output_muted_)
+    stem_capture_->AddEvent(StemCapture::EventType::START, channel_index, channel.wave_address);
   if (!channel_env_mode_[channel_index]) {
     channel.envelope_data.count = static_cast<int>(channel.envelope1.load);
   }
 }
 
 void Spu::StopChannel(int channel_index) {
+  LeaveWaveRun(channel_index);
+  if (stem_capture_ && !output_muted_) {
+    stem_capture_->AddEvent(StemCapture::EventType::STOP, channel_index,
+                            channel_data_[channel_index].wave_address);
+  }
   channel_stop_[channel_index] = true;
 
   channel_tone_release_[channel_index] = false;
@@ -322,10 +625,40 @@ void Spu::UpdateBeatIrq() {
   irq_.SetSpuBeatIrq(beat_enabled || envirq_enabled);
 }
 
-std::span<uint16_t> Spu::GetAudio() {
-  auto size = audio_buffer_pos_;
-  audio_buffer_pos_ = 0;
-  return {audio_buffer_.data(), size};
+AudioRingBuffer& Spu::GetAudioBuffer() {
+  return audio_buffer_;
+}
+
+void Spu::InvalidateWaveCache() {
+  for (int channel_index = 0; channel_index < 16; channel_index++) {
+    LeaveWaveRun(channel_index);
+  }
+  wave_cache_.Invalidate();
+}
+
+WaveCacheStats Spu::GetWaveCacheStats() const {
+  return wave_cache_.GetStats();
+}
+
+bool Spu::StartStemCapture(const std::string& path_prefix) {
+  stem_capture_.reset();
+  auto stem_capture = std::make_unique<StemCapture>(path_prefix);
+  if (!stem_capture->IsOpen())
+    return false;
+  stem_capture_ = std::move(stem_capture);
+  return true;
+}
+
+void Spu::StopStemCapture() {
+  stem_capture_.reset();
+}
+
+bool Spu::IsCapturingStems() const {
+  return stem_capture_ != nullptr;
+}
+
+void Spu::SetOutputMuted(bool muted) {
+  output_muted_ = muted;
 }
 
 word_t Spu::GetWaveAddressLo(int channel_index) {
@@ -333,6 +666,7 @@ word_t Spu::GetWaveAddressLo(int channel_index) {
 }
 
 void Spu::SetWaveAddressLo(int channel_index, word_t value) {
+  LeaveWaveRun(channel_index);
   auto& wave_address = channel_data_[channel_index].wave_address;
   wave_address = (wave_address & ~0xffff) | value;
   channel_data_[channel_index].wave_shift = 0;
@@ -345,6 +679,7 @@ word_t Spu::GetMode(int channel_index) {
 }
 
 void Spu::SetMode(int channel_index, word_t value) {
+  LeaveWaveRun(channel_index);
   channel_data_[channel_index].mode.raw = value & ChannelData::Mode::WriteMask;
   auto& wave_address = channel_data_[channel_index].wave_address;
   auto& loop_address = channel_data_[channel_index].loop_address;
@@ -366,7 +701,17 @@ word_t Spu::GetPan(int channel_index) {
 }
 
 void Spu::SetPan(int channel_index, word_t value) {
-  channel_data_[channel_index].pan.raw = value & ChannelData::Pan::WriteMask;
+  auto& pan = channel_data_[channel_index].pan;
+  pan.raw = value & ChannelData::Pan::WriteMask;
+  UpdateGains(channel_index);
+}
+
+void Spu::UpdateGains(int channel_index) {
+  const auto& pan = channel_data_[channel_index].pan;
+  const int left_pan = std::clamp((0x80 - static_cast<int>(pan.pan)) * 2, 0x0, 0x7f);
+  const int right_pan = std::clamp(static_cast<int>(pan.pan) * 2, 0x0, 0x7f);
+  left_gain_[channel_index] = left_pan * static_cast<int>(pan.volume);
+  right_gain_[channel_index] = right_pan * static_cast<int>(pan.volume);
 }
 
 word_t Spu::GetEnvelope0(int channel_index) {
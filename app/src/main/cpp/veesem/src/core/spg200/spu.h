@@ -1,23 +1,50 @@
 #pragma once
 
 #include "adpcm.h"
+#include "audio_ring_buffer.h"
+#include "bus.h"
 #include "core/common.h"
+#include "stem_capture.h"
+#include "wave_cache.h"
 
 #include <array>
 #include <bitset>
 #include <fstream>
+#include <memory>
+#include <string>
 
-class BusInterface;
 class Irq;
+class StateSerializer;
 
 class Spu {
 public:
-  Spu(BusInterface& bus, Irq& irq_);
+  Spu(Bus& bus, Irq& irq_);
 
   void Reset();
+  void Serialize(StateSerializer& state);
+  // The SPU runs behind the CPU: cycles are only accumulated here, and samples
+  // are generated in one go by Sync() when the CPU could observe the result.
   void RunCycles(int cycles);
+  void Sync();
+  int GetCyclesToNextEvent() const;
 
-  std::span<uint16_t> GetAudio();
+  // Samples are queued as they are generated, unsigned 16-bit stereo at
+  // 281,250 Hz. The frontend may drain the buffer from another thread.
+  AudioRingBuffer& GetAudioBuffer();
+
+  // Wave data in ROM is decoded once per run and then played from the cache.
+  // Called when the memory map changes.
+  void InvalidateWaveCache();
+  WaveCacheStats GetWaveCacheStats() const;
+
+  // Records every channel and the mix to WAV files, see StemCapture. Returns
+  // false if the files could not be created.
+  bool StartStemCapture(const std::string& path_prefix);
+  void StopStemCapture();
+  bool IsCapturingStems() const;
+  // While muted, samples are generated as usual but neither queued nor
+  // captured. Not part of the machine state.
+  void SetOutputMuted(bool muted);
 
   /* 30xx values */
   word_t GetWaveAddressLo(int channel_index);
@@ -113,24 +140,66 @@ public:
   void SetChannelPitchBend(word_t value);
 
 private:
+  static constexpr int kCyclesPerSample = 96;
+  static constexpr int kCyclesPerEnvelopeTick = 384;
+  // About a quarter of a second
+  static constexpr std::size_t kAudioBufferFrames = 1 << 16;
+  // Longer runs are cached in pieces
+  static constexpr std::size_t kMaxWaveRunLength = 1 << 15;
+
+  enum class WaveFormat {
+    PCM8,
+    PCM16,
+    ADPCM,
+  };
+
+  struct WavePosition {
+    addr_t address;
+    uint8_t shift;
+    WaveFormat format;
+  };
+
+  void Tick(int cycles);
+  int GetCyclesToSync() const;
+  // Enabled channels that have not stopped, one bit per channel
+  unsigned GetActiveChannels() const;
   void GenerateSample();
+  void GenerateIdleSamples(int cycles);
+  void MixOutput(int32_t left_out, int32_t right_out);
   void UpdateEnvelopes();
   void UpdateRampdowns();
   void TickChannel(int channel_index);
   void HandleEndMarker(int channel_index);
+  WaveFormat GetWaveFormat(int channel_index) const;
+  void StartWaveRun(int channel_index);
+  void LeaveWaveRun(int channel_index);
+  // Gives the channel's ADPCM decoder the state it would have after decoding
+  // what was played from the run, which stays
+  void SyncWaveRunDecoder(int channel_index);
+  // Moves the channel's run along to where the channel is now, having been at
+  // old_position. Returns false if that is outside the run.
+  bool SeekWaveRun(int channel_index, const WavePosition& old_position);
+  static bool DecodeWaveSample(word_t word, uint8_t shift, WaveFormat format, Adpcm& adpcm,
+                               uint16_t& sample);
+  static void StepWaveAddress(addr_t& address, uint8_t& shift, WaveFormat format);
   void TickChannelEnvelope(int channel_index);
   void TickChannelPitchbend(int channel_index);
   void TickChannelRampdown(int channel_index);
   void StartChannel(int channel_index);
   void StopChannel(int channel_index);
+  void UpdateGains(int channel_index);
 
   void UpdateChannelIrq();
   void UpdateBeatIrq();
 
-  std::array<uint16_t, 6144 * 2> audio_buffer_;
-  size_t audio_buffer_pos_;
-  SimpleClock<96> sample_clock_;
-  DivisibleClock<384> envelope_clock_;
+  AudioRingBuffer audio_buffer_{kAudioBufferFrames};
+  WaveCache wave_cache_;
+  std::unique_ptr<StemCapture> stem_capture_;
+  bool output_muted_ = false;
+  int pending_cycles_;
+  bool syncing_;
+  SimpleClock<kCyclesPerSample> sample_clock_;
+  DivisibleClock<kCyclesPerEnvelopeTick> envelope_clock_;
   DivisibleClock<13> rampdown_clock_;
 
   struct ChannelData {
@@ -199,6 +268,9 @@ private:
       Bitfield<0, 12> offset;
     } pitch_bend_control;
     Adpcm adpcm;
+    // Cached run the channel is playing from instead of the bus, if any
+    std::shared_ptr<const WaveRun> wave_run;
+    uint32_t wave_run_pos = 0;
   };
 
   std::array<ChannelData, 16> channel_data_;
@@ -215,6 +287,12 @@ private:
   std::bitset<16> channel_env_irq_;
   std::bitset<16> channel_pitch_bend_;
 
+  // Pan times volume for each side, derived from the pan registers by
+  // UpdateGains() and kept in one lane per channel so that GenerateSample() can
+  // sum all channels in parallel
+  std::array<int32_t, 16> left_gain_;
+  std::array<int32_t, 16> right_gain_;
+
   uint16_t wave_out_l_;
   uint16_t wave_out_r_;
   uint16_t wave_in_l_;
@@ -241,6 +319,6 @@ private:
     static const word_t WriteMask = 0x388;
   } control_;
 
-  BusInterface& bus_;
+  Bus& bus_;
   Irq& irq_;
 };
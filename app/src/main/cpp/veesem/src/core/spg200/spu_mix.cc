@@ -0,0 +1,74 @@
+#include "spu_mix.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if defined(__ARM_NEON)
+void MixChannels(const std::array<int32_t, 16>& samples, const std::array<int32_t, 16>& left_gain,
+                 const std::array<int32_t, 16>& right_gain, int32_t& left_out,
+                 int32_t& right_out) {
+  int32x4_t left = vdupq_n_s32(0);
+  int32x4_t right = vdupq_n_s32(0);
+  for (int lane = 0; lane < 16; lane += 4) {
+    const int32x4_t sample = vld1q_s32(&samples[lane]);
+    left = vaddq_s32(left, vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&left_gain[lane])), 14));
+    right = vaddq_s32(right, vshrq_n_s32(vmulq_s32(sample, vld1q_s32(&right_gain[lane])), 14));
+  }
+  // Pairwise adds, which ARMv7 has as well
+  const int32x2_t left_pair = vadd_s32(vget_low_s32(left), vget_high_s32(left));
+  const int32x2_t right_pair = vadd_s32(vget_low_s32(right), vget_high_s32(right));
+  const int32x2_t sums = vpadd_s32(left_pair, right_pair);
+  left_out = vget_lane_s32(sums, 0);
+  right_out = vget_lane_s32(sums, 1);
+}
+#elif defined(__SSE2__)
+namespace {
+// SSE2 has no 32-bit multiply, so lanes are narrowed to 16 bits and the full
+// products put together from their low and high halves
+inline __m128i Load16(const std::array<int32_t, 16>& lanes, int lane) {
+  const auto* src = reinterpret_cast<const __m128i*>(&lanes[lane]);
+  return _mm_packs_epi32(_mm_loadu_si128(src), _mm_loadu_si128(src + 1));
+}
+
+inline __m128i MulShiftAdd(__m128i sum, __m128i samples, __m128i gains) {
+  const __m128i low = _mm_mullo_epi16(samples, gains);
+  const __m128i high = _mm_mulhi_epi16(samples, gains);
+  sum = _mm_add_epi32(sum, _mm_srai_epi32(_mm_unpacklo_epi16(low, high), 14));
+  return _mm_add_epi32(sum, _mm_srai_epi32(_mm_unpackhi_epi16(low, high), 14));
+}
+
+inline int32_t HorizontalSum(__m128i sum) {
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+}  // namespace
+
+void MixChannels(const std::array<int32_t, 16>& samples, const std::array<int32_t, 16>& left_gain,
+                 const std::array<int32_t, 16>& right_gain, int32_t& left_out,
+                 int32_t& right_out) {
+  __m128i left = _mm_setzero_si128();
+  __m128i right = _mm_setzero_si128();
+  for (int lane = 0; lane < 16; lane += 8) {
+    const __m128i sample = Load16(samples, lane);
+    left = MulShiftAdd(left, sample, Load16(left_gain, lane));
+    right = MulShiftAdd(right, sample, Load16(right_gain, lane));
+  }
+  left_out = HorizontalSum(left);
+  right_out = HorizontalSum(right);
+}
+#else
+void MixChannels(const std::array<int32_t, 16>& samples, const std::array<int32_t, 16>& left_gain,
+                 const std::array<int32_t, 16>& right_gain, int32_t& left_out,
+                 int32_t& right_out) {
+  left_out = 0;
+  right_out = 0;
+  for (int lane = 0; lane < 16; lane++) {
+    left_out += (samples[lane] * left_gain[lane]) >> 14;
+    right_out += (samples[lane] * right_gain[lane]) >> 14;
+  }
+}
+#endif
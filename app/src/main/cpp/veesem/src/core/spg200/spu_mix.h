@@ -0,0 +1,12 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+// Pans and sums the SPU channels: each channel's sample is multiplied by its
+// gain for a side, shifted down by 14 and added to that side. Samples after the
+// envelope and gains (pan times volume) both fit in 16 bits, which the vector
+// versions rely on.
+void MixChannels(const std::array<int32_t, 16>& samples, const std::array<int32_t, 16>& left_gain,
+                 const std::array<int32_t, 16>& right_gain, int32_t& left_out,
+                 int32_t& right_out);
@@ -0,0 +1,252 @@
+// Checks the vectorized channel mixer against a plain per-channel loop, on
+// random lanes and on whole SPU runs: register streams such as a music driver
+// writes are replayed into the chip, and the left and right output has to match
+// what the scalar mixer produced for them.
+
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "core/testing.h"
+#include "spg200.h"
+#include "spg200_io.h"
+#include "spu_mix.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+constexpr addr_t kWaves = 0x20000;
+constexpr addr_t kEnvelopes = 0x50000;
+constexpr int kWaveWords = 0x30000;
+constexpr int kFrames = 60;
+
+void TestRandomLanes() {
+  std::mt19937 rng(1);
+  std::array<int32_t, 16> samples;
+  std::array<int32_t, 16> left_gain;
+  std::array<int32_t, 16> right_gain;
+
+  bool all_equal = true;
+  for (int round = 0; round < 100000; round++) {
+    for (int lane = 0; lane < 16; lane++) {
+      // As GenerateSample() and SetPan() make them, with the extremes thrown in
+      const int sample = round < 16 ? (lane & 1 ? -0x8000 : 0x7fff) : int16_t(rng());
+      samples[lane] = (sample * static_cast<int>(rng() % 0x80)) >> 7;
+      left_gain[lane] = round < 16 ? 0x7f * 0x7f : (rng() % 0x80) * (rng() % 0x80);
+      right_gain[lane] = (rng() % 0x80) * (rng() % 0x80);
+      if (rng() % 4 == 0)
+        samples[lane] = 0;
+    }
+
+    int32_t expected_left = 0;
+    int32_t expected_right = 0;
+    for (int lane = 0; lane < 16; lane++) {
+      expected_left += (samples[lane] * left_gain[lane]) >> 14;
+      expected_right += (samples[lane] * right_gain[lane]) >> 14;
+    }
+
+    int32_t left;
+    int32_t right;
+    MixChannels(samples, left_gain, right_gain, left, right);
+    all_equal &= left == expected_left && right == expected_right;
+  }
+  EXPECT(all_equal);
+}
+
+// A bare board: one ROM holding the program, the waves and the envelopes
+class TestIo : public Spg200Io {
+public:
+  explicit TestIo(std::vector<word_t> rom) : rom_(std::move(rom)) {}
+
+  void RunCycles(int) override {}
+  int GetCyclesToNextEvent() override { return kNoEvent; }
+
+  unsigned GetAdc0() override { return 0; }
+  unsigned GetAdc1() override { return 0; }
+  unsigned GetAdc2() override { return 0; }
+  unsigned GetAdc3() override { return 0; }
+
+  word_t GetPortA() override { return 0; }
+  void SetPortA(word_t, word_t) override {}
+  word_t GetPortB() override { return 0; }
+  void SetPortB(word_t, word_t) override {}
+  word_t GetPortC() override { return 0; }
+  void SetPortC(word_t, word_t) override {}
+
+  word_t ReadRomCsb(addr_t addr) override { return rom_[addr]; }
+  void WriteRomCsb(addr_t, word_t) override {}
+  word_t ReadCsb1(addr_t) override { return 0; }
+  void WriteCsb1(addr_t, word_t) override {}
+  word_t ReadCsb2(addr_t) override { return 0; }
+  void WriteCsb2(addr_t, word_t) override {}
+  word_t ReadCsb3(addr_t) override { return 0; }
+  void WriteCsb3(addr_t, word_t) override {}
+
+  const word_t* GetRomCsbReadPtr(addr_t addr) override { return &rom_[addr]; }
+  word_t* GetRomCsbWritePtr(addr_t) override { return nullptr; }
+  const word_t* GetCsb1ReadPtr(addr_t) override { return nullptr; }
+  word_t* GetCsb1WritePtr(addr_t) override { return nullptr; }
+  const word_t* GetCsb2ReadPtr(addr_t) override { return nullptr; }
+  word_t* GetCsb2WritePtr(addr_t) override { return nullptr; }
+  const word_t* GetCsb3ReadPtr(addr_t) override { return nullptr; }
+  word_t* GetCsb3WritePtr(addr_t) override { return nullptr; }
+
+  void TxUart(uint8_t) override {}
+  void RxUartDone() override {}
+
+private:
+  std::vector<word_t> rom_;
+};
+
+std::vector<word_t> MakeRom() {
+  std::vector<word_t> rom(0x400000);
+  std::mt19937 rng(2);
+  // Keeps clear of the end of sample markers
+  for (addr_t addr = kWaves; addr < kWaves + kWaveWords; addr++)
+    rom[addr] = rng() & 0x7f7f;
+  for (addr_t addr = kEnvelopes; addr < kEnvelopes + 0x1000; addr++)
+    rom[addr] = rng();
+
+  rom[0xfff7] = kProgram;  // reset vector
+  // The CPU only spins, the test writes the registers
+  rom[kProgram] = 0xfe80;
+  rom[kProgram + 1] = kProgram;
+  return rom;
+}
+
+struct RegisterWrite {
+  int frame;
+  addr_t addr;
+  word_t value;
+};
+
+// What a music driver writes at the start of each frame: notes starting on any
+// channel in all three formats, looped or not, with manual or ROM envelopes,
+// notes released, and pan, volume and envelope changes
+std::vector<RegisterWrite> MakeStream(unsigned seed) {
+  std::mt19937 rng(seed);
+  std::vector<RegisterWrite> writes;
+  word_t channel_enable = 0;
+
+  writes.push_back({0, 0x3401, static_cast<word_t>(0x40 + rng() % 0x40)});
+  writes.push_back({0, 0x340d, static_cast<word_t>(rng() & 0x00c0)});
+  writes.push_back({0, 0x3415, static_cast<word_t>(rng())});
+
+  for (int frame = 0; frame < kFrames; frame++) {
+    const int events = rng() % 6;
+    for (int event = 0; event < events; event++) {
+      const int channel = rng() % 16;
+      const addr_t regs = 0x3000 + channel * 16;
+      const addr_t phase_regs = 0x3200 + channel * 16;
+      switch (rng() % 8) {
+        case 0:
+        case 1:
+        case 2: {
+          const addr_t wave = kWaves + rng() % (kWaveWords / 2);
+          const addr_t loop = wave + rng() % 0x400;
+          const word_t format = (rng() % 3 == 0) ? 0x8000 : (rng() % 2) ? 0x4000 : 0;
+          const word_t tone_mode = (rng() % 2 + 1) << 12;
+          const uint32_t phase = 0x800 + rng() % 0xf800;
+          const addr_t envelope = kEnvelopes + rng() % 0x800;
+          writes.push_back({frame, regs + 0, static_cast<word_t>(wave & 0xffff)});
+          writes.push_back({frame, regs + 1,
+                            static_cast<word_t>(format | tone_mode | ((loop >> 16) << 6) |
+                                                (wave >> 16))});
+          writes.push_back({frame, regs + 2, static_cast<word_t>(loop & 0xffff)});
+          writes.push_back({frame, regs + 3, static_cast<word_t>(rng() & 0x7f7f)});
+          writes.push_back({frame, regs + 4, static_cast<word_t>(rng() & 0x7fff)});
+          writes.push_back({frame, regs + 5, static_cast<word_t>(rng() & 0xff7f)});
+          writes.push_back({frame, regs + 7, static_cast<word_t>(envelope >> 16)});
+          writes.push_back({frame, regs + 8, static_cast<word_t>(envelope & 0xffff)});
+          writes.push_back({frame, phase_regs + 0, static_cast<word_t>(phase >> 16)});
+          writes.push_back({frame, phase_regs + 4, static_cast<word_t>(phase & 0xffff)});
+          writes.push_back({frame, 0x340b, static_cast<word_t>(1 << channel)});
+          channel_enable |= 1 << channel;
+          writes.push_back({frame, 0x3400, channel_enable});
+          break;
+        }
+        case 3:
+          channel_enable &= ~(1 << channel);
+          writes.push_back({frame, 0x3400, channel_enable});
+          break;
+        case 4:
+        case 5:
+          writes.push_back({frame, regs + 3, static_cast<word_t>(rng() & 0x7f7f)});
+          break;
+        case 6:
+          writes.push_back({frame, regs + 5, static_cast<word_t>(rng() & 0xff7f)});
+          break;
+        case 7:
+          writes.push_back({frame, 0x3401, static_cast<word_t>(rng() % 0x80)});
+          break;
+      }
+    }
+  }
+  return writes;
+}
+
+uint64_t Hash(uint64_t hash, uint16_t value) {
+  return (hash ^ value) * 0x100000001b3;
+}
+
+struct Output {
+  std::size_t frames = 0;
+  uint64_t left_hash = 0xcbf29ce484222325;
+  uint64_t right_hash = 0xcbf29ce484222325;
+};
+
+Output Replay(const std::vector<word_t>& rom, const std::vector<RegisterWrite>& writes) {
+  TestIo io(rom);
+  Spg200 spg200(VideoTiming::PAL, io);
+  spg200.Reset();
+
+  Output output;
+  std::vector<uint16_t> samples;
+  auto write = writes.begin();
+  for (int frame = 0; frame < kFrames; frame++) {
+    for (; write != writes.end() && write->frame == frame; ++write)
+      spg200.WriteWord(write->addr, write->value);
+    spg200.RunFrame();
+
+    AudioRingBuffer& audio = spg200.GetAudioBuffer();
+    samples.resize(audio.GetFillLevel() * 2);
+    audio.Read(samples.data(), samples.size() / 2);
+    for (std::size_t i = 0; i < samples.size(); i += 2) {
+      output.left_hash = Hash(output.left_hash, samples[i]);
+      output.right_hash = Hash(output.right_hash, samples[i + 1]);
+    }
+    output.frames += samples.size() / 2;
+  }
+  return output;
+}
+
+// FNV-1a hashes of the left and right output for each stream, as the plain
+// per-channel mixer the SPU had before MixChannels() produced it. Any other
+// change to what the SPU plays changes them too, to be checked against a
+// scalar mixer before they are updated.
+const struct {
+  unsigned seed;
+  Output output;
+} kExpected[] = {
+    {1, {335664, 0x7c200199c3137e9a, 0x5641fdad872fb372}},
+    {2, {335664, 0x8f90ffa9399ead7f, 0x488215e746bd6199}},
+    {3, {335664, 0x5ea6e320b9fd200a, 0xab204f270f30d972}},
+    {4, {335664, 0x65b578878510def6, 0xbf8e1e3add1c9f0d}},
+};
+
+void TestReplay() {
+  const std::vector<word_t> rom = MakeRom();
+  for (const auto& expected : kExpected) {
+    const Output output = Replay(rom, MakeStream(expected.seed));
+    EXPECT(output.frames == expected.output.frames);
+    EXPECT(output.left_hash == expected.output.left_hash);
+    EXPECT(output.right_hash == expected.output.right_hash);
+  }
+}
+}  // namespace
+
+int main() {
+  TestRandomLanes();
+  TestReplay();
+  return TestResult();
+}
@@ -0,0 +1,185 @@
+#include "stem_capture.h"
+
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+constexpr uint32_t kSampleRate = 281250;  // 27 MHz / 96
+
+// Sample data is written as is, so this assumes a little-endian host
+void WriteWavHeader(std::ofstream& file, int channels, uint64_t frames) {
+  const uint32_t data_bytes =
+      static_cast<uint32_t>(std::min<uint64_t>(frames * channels * 2, UINT32_MAX - 36));
+  const auto put16 = [&](uint16_t value) {
+    file.put(value & 0xff);
+    file.put(value >> 8);
+  };
+  const auto put32 = [&](uint32_t value) {
+    put16(value & 0xffff);
+    put16(value >> 16);
+  };
+
+  file.write("RIFF", 4);
+  put32(36 + data_bytes);
+  file.write("WAVE", 4);
+  file.write("fmt ", 4);
+  put32(16);
+  put16(1);  // PCM
+  put16(channels);
+  put32(kSampleRate);
+  put32(kSampleRate * channels * 2);
+  put16(channels * 2);
+  put16(16);
+  file.write("data", 4);
+  put32(data_bytes);
+}
+}  // namespace
+
+StemCapture::StemCapture(const std::string& path_prefix) {
+  open_ = true;
+  for (int channel_index = 0; channel_index < 16; channel_index++) {
+    char suffix[16];
+    std::snprintf(suffix, sizeof(suffix), "_ch%02d.wav", channel_index);
+    auto& file = channel_files_[channel_index];
+    file.open(path_prefix + suffix, std::ios::binary | std::ios::trunc);
+    WriteWavHeader(file, 1, 0);
+    open_ &= file.good();
+  }
+  mix_file_.open(path_prefix + "_mix.wav", std::ios::binary | std::ios::trunc);
+  WriteWavHeader(mix_file_, 2, 0);
+  index_file_.open(path_prefix + "_index.txt", std::ios::trunc);
+  index_file_ << "# sample event channel wave_address\n";
+  open_ &= mix_file_.good() && index_file_.good();
+  if (!open_)
+    return;
+
+  for (auto& block : blocks_) {
+    for (auto& samples : block.channels) {
+      samples.resize(kBlockFrames);
+    }
+    block.mix.resize(kBlockFrames * 2);
+    block.events.reserve(256);
+  }
+  writer_ = std::thread(&StemCapture::RunWriter, this);
+}
+
+StemCapture::~StemCapture() {
+  if (!writer_.joinable())
+    return;
+
+  {
+    std::unique_lock lock(mutex_);
+    writer_idle_.wait(lock, [this] { return !pending_; });
+    if (filling_->frames || !filling_->events.empty())
+      pending_ = filling_;
+    stopping_ = true;
+  }
+  wake_writer_.notify_one();
+  writer_.join();
+
+  // Fill in the sizes left open in the headers
+  for (auto& file : channel_files_) {
+    file.seekp(0);
+    WriteWavHeader(file, 1, written_frames_);
+  }
+  mix_file_.seekp(0);
+  WriteWavHeader(mix_file_, 2, written_frames_);
+}
+
+bool StemCapture::IsOpen() const {
+  return open_;
+}
+
+void StemCapture::AddFrame(const std::array<int32_t, 16>& channels, uint16_t left,
+                           uint16_t right) {
+  Block& block = *filling_;
+  for (int channel_index = 0; channel_index < 16; channel_index++) {
+    block.channels[channel_index][block.frames] = static_cast<int16_t>(channels[channel_index]);
+  }
+  block.mix[block.frames * 2] = left ^ 0x8000;
+  block.mix[block.frames * 2 + 1] = right ^ 0x8000;
+
+  frame_count_++;
+  if (++block.frames == kBlockFrames)
+    SubmitBlock();
+}
+
+void StemCapture::AddEvent(EventType type, int channel_index, addr_t wave_address) {
+  filling_->events.push_back({frame_count_, type, channel_index, wave_address});
+}
+
+uint64_t StemCapture::GetDroppedFrames() const {
+  return dropped_frames_;
+}
+
+void StemCapture::SubmitBlock() {
+  bool dropped = false;
+  {
+    std::lock_guard lock(mutex_);
+    if (!pending_) {
+      pending_ = filling_;
+      filling_ = filling_ == &blocks_[0] ? &blocks_[1] : &blocks_[0];
+    } else {
+      // Events are kept, to be listed with the next block
+      dropped = true;
+      dropped_frames_ += filling_->frames;
+    }
+  }
+  if (!dropped) {
+    wake_writer_.notify_one();
+    filling_->events.clear();
+  }
+  filling_->first_frame = frame_count_;
+  filling_->frames = 0;
+}
+
+void StemCapture::RunWriter() {
+  std::unique_lock lock(mutex_);
+  while (true) {
+    wake_writer_.wait(lock, [this] { return pending_ || stopping_; });
+    if (!pending_)
+      return;
+
+    const Block* block = pending_;
+    lock.unlock();
+    WriteBlock(*block);
+    lock.lock();
+    pending_ = nullptr;
+    writer_idle_.notify_all();
+  }
+}
+
+void StemCapture::WriteBlock(const Block& block) {
+  char line[64];
+
+  if (block.first_frame > written_frames_) {
+    const std::size_t gap = block.first_frame - written_frames_;
+    std::snprintf(line, sizeof(line), "%llu dropped %zu\n",
+                  static_cast<unsigned long long>(written_frames_), gap);
+    index_file_ << line;
+
+    const std::vector<int16_t> silence(gap * 2);
+    for (auto& file : channel_files_) {
+      file.write(reinterpret_cast<const char*>(silence.data()), gap * sizeof(int16_t));
+    }
+    mix_file_.write(reinterpret_cast<const char*>(silence.data()), gap * 2 * sizeof(int16_t));
+    written_frames_ = block.first_frame;
+  }
+
+  for (const Event& event : block.events) {
+    std::snprintf(line, sizeof(line), "%llu %s %d 0x%06x\n",
+                  static_cast<unsigned long long>(event.frame),
+                  event.type == EventType::START ? "start" : "stop", event.channel_index,
+                  static_cast<unsigned>(event.wave_address));
+    index_file_ << line;
+  }
+
+  for (int channel_index = 0; channel_index < 16; channel_index++) {
+    channel_files_[channel_index].write(
+        reinterpret_cast<const char*>(block.channels[channel_index].data()),
+        block.frames * sizeof(int16_t));
+  }
+  mix_file_.write(reinterpret_cast<const char*>(block.mix.data()),
+                  block.frames * 2 * sizeof(int16_t));
+  written_frames_ += block.frames;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/common.h"
+
+// Records what each SPU channel contributes. Every channel's samples after the
+// envelope and before panning go to a mono WAV file of their own and the final
+// mix to a stereo one, all at the SPU rate of 281,250 Hz. Channel starts and
+// stops are listed in a text index with the sample they happened at and the
+// channel's wave address.
+//
+// A background thread writes the files: the SPU fills one block while the
+// thread writes the other. Should the thread fall a whole block behind, the
+// block is dropped instead of stalling emulation. The gap is written as
+// silence, to keep the files aligned, and noted in the index.
+class StemCapture {
+public:
+  enum class EventType {
+    START,
+    STOP,
+  };
+
+  // Creates <prefix>_ch00.wav to <prefix>_ch15.wav, <prefix>_mix.wav and
+  // <prefix>_index.txt. Check IsOpen() afterwards.
+  explicit StemCapture(const std::string& path_prefix);
+  // Writes what is left and finishes the files
+  ~StemCapture();
+
+  StemCapture(const StemCapture&) = delete;
+  StemCapture& operator=(const StemCapture&) = delete;
+
+  bool IsOpen() const;
+
+  void AddFrame(const std::array<int32_t, 16>& channels, uint16_t left, uint16_t right);
+  void AddEvent(EventType type, int channel_index, addr_t wave_address);
+
+  uint64_t GetDroppedFrames() const;
+
+private:
+  static constexpr std::size_t kBlockFrames = 1 << 15;
+
+  struct Event {
+    uint64_t frame;
+    EventType type;
+    int channel_index;
+    addr_t wave_address;
+  };
+
+  struct Block {
+    uint64_t first_frame = 0;
+    std::size_t frames = 0;
+    std::array<std::vector<int16_t>, 16> channels;
+    std::vector<int16_t> mix;  // interleaved stereo
+    std::vector<Event> events;
+  };
+
+  void SubmitBlock();
+  void RunWriter();
+  void WriteBlock(const Block& block);
+
+  std::array<std::ofstream, 16> channel_files_;
+  std::ofstream mix_file_;
+  std::ofstream index_file_;
+  bool open_ = false;
+
+  std::array<Block, 2> blocks_;
+  Block* filling_ = &blocks_[0];  // owned by the emulation thread
+  uint64_t frame_count_ = 0;
+  uint64_t dropped_frames_ = 0;
+
+  // Written by the writer thread only
+  uint64_t written_frames_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable wake_writer_;
+  std::condition_variable writer_idle_;
+  Block* pending_ = nullptr;  // handed to the writer, nullptr once written
+  bool stopping_ = false;
+  std::thread writer_;
+};
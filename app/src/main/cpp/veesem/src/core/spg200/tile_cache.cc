@@ -0,0 +1,80 @@
+#include "tile_cache.h"
+
+unsigned TileCache::SetIndex(uint32_t key) {
+  return (key * 0x9e3779b1u) >> (32 - kSetBits);
+}
+
+bool TileCache::IsValid(const Entry& entry, addr_t addr) const {
+  return entry.generation >= flush_generation_ &&
+         entry.generation >= (*block_generations_)[addr >> kBlockBits];
+}
+
+const TileCache::Row* TileCache::Find(uint32_t key, addr_t addr) {
+  if (!sets_) {
+    stats_.misses++;
+    return nullptr;
+  }
+  for (auto& entry : (*sets_)[SetIndex(key)]) {
+    if (entry.key == key && IsValid(entry, addr)) {
+      entry.last_used = ++use_counter_;
+      stats_.hits++;
+      return &entry.row;
+    }
+  }
+  stats_.misses++;
+  return nullptr;
+}
+
+TileCache::Row& TileCache::Insert(uint32_t key) {
+  if (!sets_) {
+    sets_ = std::make_unique<std::array<Set, 1 << kSetBits>>();
+    block_generations_ = std::make_unique<std::array<uint32_t, kNumBlocks>>();
+  }
+  Set& set = (*sets_)[SetIndex(key)];
+  Entry* victim = &set[0];
+  for (auto& entry : set) {
+    // An old row for the same key is replaced, so that it cannot be found again
+    if (entry.key == key || entry.generation < flush_generation_) {
+      victim = &entry;
+      break;
+    }
+    if (entry.last_used < victim->last_used)
+      victim = &entry;
+  }
+
+  victim->key = key;
+  victim->generation = generation_;
+  victim->last_used = ++use_counter_;
+  return victim->row;
+}
+
+void TileCache::Invalidate() {
+  flush_generation_ = NextGeneration();
+}
+
+void TileCache::InvalidateWord(addr_t addr) {
+  if (!sets_)
+    return;
+  // A row of up to kMaxRowWords words holding addr starts in addr's block or
+  // in the one before
+  const uint32_t generation = NextGeneration();
+  (*block_generations_)[(addr & 0x3fffff) >> kBlockBits] = generation;
+  (*block_generations_)[((addr - (kMaxRowWords - 1)) & 0x3fffff) >> kBlockBits] = generation;
+}
+
+// Rows inserted from now on get a generation that no invalidation so far covers
+uint32_t TileCache::NextGeneration() {
+  if (++generation_ == 0) {
+    // Stale entries could match again once the generation wraps around
+    if (sets_) {
+      sets_->fill({});
+      block_generations_->fill(0);
+    }
+    generation_ = 1;
+  }
+  return generation_;
+}
+
+TileCacheStats TileCache::GetStats() const {
+  return stats_;
+}
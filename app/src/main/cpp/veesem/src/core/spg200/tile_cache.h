@@ -0,0 +1,63 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+
+#include "core/common.h"
+
+struct TileCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+};
+
+// Set-associative cache of tile rows already unpacked to pixel data, for rows
+// read from external memory. Rows are looked up by a key and the address of
+// their first word. Entries are dropped in bulk by Invalidate(), or by
+// InvalidateWord() for the rows a write to writable external memory may touch.
+// The storage is only allocated by the first Insert(), so that machines which do
+// not draw anything, or not yet, do not pay for it.
+class TileCache {
+public:
+  static constexpr int kMaxTileWidth = 64;
+  // At most 8 bits per pixel are cached
+  static constexpr int kMaxRowWords = kMaxTileWidth * 8 / 16;
+  using Row = std::array<uint8_t, kMaxTileWidth>;
+
+  TileCache() = default;
+
+  const Row* Find(uint32_t key, addr_t addr);
+  Row& Insert(uint32_t key);
+  void Invalidate();
+  void InvalidateWord(addr_t addr);
+
+  TileCacheStats GetStats() const;
+
+private:
+  static constexpr int kSetBits = 12;
+  static constexpr int kWays = 4;
+  // Rows are invalidated by the block of external memory they start in
+  static constexpr int kBlockBits = 8;
+  static constexpr int kNumBlocks = 0x400000 >> kBlockBits;
+
+  struct Entry {
+    uint32_t key = 0;
+    uint32_t generation = 0;
+    uint32_t last_used = 0;
+    Row row;
+  };
+  using Set = std::array<Entry, kWays>;
+
+  static unsigned SetIndex(uint32_t key);
+  bool IsValid(const Entry& entry, addr_t addr) const;
+  uint32_t NextGeneration();
+
+  std::unique_ptr<std::array<Set, 1 << kSetBits>> sets_;
+  // Generation of the last write to each block; rows inserted before it are stale
+  std::unique_ptr<std::array<uint32_t, kNumBlocks>> block_generations_;
+  // Generation of the last Invalidate(); rows inserted before it are stale
+  uint32_t flush_generation_ = 1;
+  uint32_t generation_ = 1;
+  uint32_t use_counter_ = 0;
+  TileCacheStats stats_;
+};
@@ -0,0 +1,99 @@
+// Checks that a write drops every cached row that holds the written word and
+// keeps rows elsewhere, so that writes to NVRAM do not flush the whole cache.
+
+#include <cstdint>
+#include <vector>
+
+#include "core/testing.h"
+#include "tile_cache.h"
+
+namespace {
+constexpr addr_t kFirstRow = 0x10000;
+constexpr addr_t kRowStride = 8;
+constexpr int kRows = 512;
+
+uint32_t Key(addr_t addr) {
+  return addr << 5;
+}
+
+void InsertRows(TileCache& cache) {
+  for (int i = 0; i < kRows; i++) {
+    const addr_t addr = kFirstRow + i * kRowStride;
+    cache.Insert(Key(addr)).fill(static_cast<uint8_t>(i));
+  }
+}
+
+bool Cached(TileCache& cache, addr_t addr) {
+  const TileCache::Row* row = cache.Find(Key(addr), addr);
+  return row && (*row)[0] == static_cast<uint8_t>((addr - kFirstRow) / kRowStride);
+}
+
+void TestFindInserted() {
+  TileCache cache;
+  EXPECT(!cache.Find(Key(kFirstRow), kFirstRow));
+  InsertRows(cache);
+  bool all_cached = true;
+  for (int i = 0; i < kRows; i++)
+    all_cached &= Cached(cache, kFirstRow + i * kRowStride);
+  EXPECT(all_cached);
+}
+
+// Every row of the widest kind overlapping a written word has to go; rows two
+// blocks away or more stay
+void TestInvalidateWord() {
+  for (const addr_t written : {kFirstRow, kFirstRow + 0x7ff, kFirstRow + 0x800,
+                               kFirstRow + 0x81f, kFirstRow + 0xfff}) {
+    TileCache cache;
+    InsertRows(cache);
+    cache.InvalidateWord(written);
+
+    bool overlapping_dropped = true;
+    bool distant_kept = true;
+    for (int i = 0; i < kRows; i++) {
+      const addr_t addr = kFirstRow + i * kRowStride;
+      if (written >= addr && written < addr + TileCache::kMaxRowWords)
+        overlapping_dropped &= !Cached(cache, addr);
+      if (addr > written + 0x200 || addr + 0x200 + TileCache::kMaxRowWords < written)
+        distant_kept &= Cached(cache, addr);
+    }
+    EXPECT(overlapping_dropped);
+    EXPECT(distant_kept);
+
+    // Rows inserted after the write are found again
+    const addr_t addr = written & ~(kRowStride - 1);
+    cache.Insert(Key(addr)).fill(static_cast<uint8_t>((addr - kFirstRow) / kRowStride));
+    EXPECT(Cached(cache, addr));
+  }
+}
+
+void TestInvalidate() {
+  TileCache cache;
+  InsertRows(cache);
+  cache.InvalidateWord(kFirstRow);
+  cache.Invalidate();
+  bool none_cached = true;
+  for (int i = 0; i < kRows; i++)
+    none_cached &= !Cached(cache, kFirstRow + i * kRowStride);
+  EXPECT(none_cached);
+
+  InsertRows(cache);
+  EXPECT(Cached(cache, kFirstRow));
+  EXPECT(Cached(cache, kFirstRow + (kRows - 1) * kRowStride));
+}
+
+// A write before anything is cached is ignored
+void TestInvalidateEmpty() {
+  TileCache cache;
+  cache.InvalidateWord(kFirstRow);
+  InsertRows(cache);
+  EXPECT(Cached(cache, kFirstRow));
+}
+}  // namespace
+
+int main() {
+  TestFindInserted();
+  TestInvalidateWord();
+  TestInvalidate();
+  TestInvalidateEmpty();
+  return TestResult();
+}
@@ -0,0 +1,382 @@
+// Checks the per-depth tile line drawing against the scalar DrawTileLine the
+// PPU had before, kept here as the reference. Random scenes of sprites and a
+// bitmap background are drawn by the chip and by the reference, and every
+// scanline has to match: all depths, flipped or not, partly offscreen on
+// either side, blended or not, from RAM, which is never cached, and from ROM,
+// whose rows go through the tile cache. Each scene is drawn twice, so that ROM
+// rows come once from decoding and once from the cache.
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include "core/testing.h"
+#include "pixel_convert.h"
+#include "spg200.h"
+#include "spg200_io.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+constexpr addr_t kRamSize = 0x2800;
+// Line tables of the bitmap background, in RAM above the RAM tiles
+constexpr addr_t kBitmapLines = 0x2000;
+constexpr addr_t kBitmapLinesHigh = 0x2100;
+constexpr int kScenes = 60;
+constexpr int kSprites = 48;
+
+// A bare board: one ROM holding the program and the tiles
+class TestIo : public Spg200Io {
+public:
+  explicit TestIo(const std::vector<word_t>& rom) : rom_(rom) {}
+
+  void RunCycles(int) override {}
+  int GetCyclesToNextEvent() override { return kNoEvent; }
+
+  unsigned GetAdc0() override { return 0; }
+  unsigned GetAdc1() override { return 0; }
+  unsigned GetAdc2() override { return 0; }
+  unsigned GetAdc3() override { return 0; }
+
+  word_t GetPortA() override { return 0; }
+  void SetPortA(word_t, word_t) override {}
+  word_t GetPortB() override { return 0; }
+  void SetPortB(word_t, word_t) override {}
+  word_t GetPortC() override { return 0; }
+  void SetPortC(word_t, word_t) override {}
+
+  word_t ReadRomCsb(addr_t addr) override { return rom_[addr]; }
+  void WriteRomCsb(addr_t, word_t) override {}
+  word_t ReadCsb1(addr_t) override { return 0; }
+  void WriteCsb1(addr_t, word_t) override {}
+  word_t ReadCsb2(addr_t) override { return 0; }
+  void WriteCsb2(addr_t, word_t) override {}
+  word_t ReadCsb3(addr_t) override { return 0; }
+  void WriteCsb3(addr_t, word_t) override {}
+
+  const word_t* GetRomCsbReadPtr(addr_t addr) override { return &rom_[addr]; }
+  word_t* GetRomCsbWritePtr(addr_t) override { return nullptr; }
+  const word_t* GetCsb1ReadPtr(addr_t) override { return nullptr; }
+  word_t* GetCsb1WritePtr(addr_t) override { return nullptr; }
+  const word_t* GetCsb2ReadPtr(addr_t) override { return nullptr; }
+  word_t* GetCsb2WritePtr(addr_t) override { return nullptr; }
+  const word_t* GetCsb3ReadPtr(addr_t) override { return nullptr; }
+  word_t* GetCsb3WritePtr(addr_t) override { return nullptr; }
+
+  void TxUart(uint8_t) override {}
+  void RxUartDone() override {}
+
+private:
+  const std::vector<word_t>& rom_;
+};
+
+std::vector<word_t> MakeRom() {
+  std::vector<word_t> rom(0x400000);
+  std::mt19937 rng(1);
+  for (addr_t addr = 0x10000; addr < rom.size(); addr++)
+    rom[addr] = static_cast<word_t>(rng());
+
+  rom[0xfff7] = kProgram;  // reset vector
+  // The CPU only spins, the test writes the registers
+  rom[kProgram] = 0xfe80;
+  rom[kProgram + 1] = kProgram;
+  return rom;
+}
+
+struct Sprite {
+  word_t ch = 0;
+  word_t xpos = 0;
+  word_t ypos = 0;
+  word_t attr = 0;
+};
+
+struct Scene {
+  std::vector<word_t> ram;
+  std::array<uint16_t, 256> palette;
+  word_t blend_level = 0;
+  word_t sprite_segment = 0;
+  std::vector<Sprite> sprites;
+  // Bitmap background, when enabled in bg_control
+  word_t bg_attribute = 0;
+  word_t bg_control = 0;
+  word_t bg_xscroll = 0;
+  word_t bg_yscroll = 0;
+};
+
+int SignExtend9(word_t value) {
+  return (value & 0x100) ? static_cast<int>(value) - 0x200 : value;
+}
+
+// Sprites drawn from RAM or from ROM. A quarter go partly past the left edge
+// and as many past the right one.
+Scene MakeScene(std::mt19937& rng, bool from_ram) {
+  Scene scene;
+  scene.ram.resize(kRamSize);
+  for (auto& word : scene.ram)
+    word = static_cast<word_t>(rng());
+  for (auto& color : scene.palette) {
+    const auto value = static_cast<uint16_t>(rng());
+    color = rng() % 4 ? (value & 0x7fff) : (value | 0x8000);
+  }
+  scene.blend_level = rng() % 4;
+  scene.sprite_segment = from_ram ? 0 : static_cast<word_t>(0x100 + rng() % 0x7f00);
+  const addr_t segment_base = scene.sprite_segment << 6;
+  const addr_t segment_end = from_ram ? kBitmapLines : 0x400000;
+
+  for (int i = 0; i < kSprites; i++) {
+    Sprite sprite;
+    const int hsize = rng() % 4;
+    const int vsize = rng() % 4;
+    const int bits_per_pixel = (rng() % 4 + 1) * 2;
+    const int width = 8 << hsize;
+    const int height = 8 << vsize;
+    sprite.attr = static_cast<word_t>(((rng() % 8 == 0) << 14) | ((rng() % 4) << 12) |
+                                      ((rng() % 16) << 8) | (vsize << 6) | (hsize << 4) |
+                                      ((rng() % 2) << 3) | ((rng() % 2) << 2) |
+                                      (bits_per_pixel / 2 - 1));
+
+    // Every row of the character has to stay inside the segment
+    const addr_t char_words = static_cast<addr_t>(height * width * bits_per_pixel / 16);
+    const addr_t max_ch = std::min<addr_t>((segment_end - segment_base) / char_words - 1, 0xffff);
+    sprite.ch = static_cast<word_t>(1 + rng() % max_ch);
+
+    int screen_x;
+    switch (rng() % 4) {
+      case 0:
+        screen_x = -static_cast<int>(rng() % width);
+        break;
+      case 1:
+        screen_x = 320 - static_cast<int>(rng() % width);
+        break;
+      default:
+        screen_x = static_cast<int>(rng() % 320);
+        break;
+    }
+    const int screen_y = static_cast<int>(rng() % (240 + height)) - height;
+    sprite.xpos = static_cast<word_t>((screen_x + width / 2 - 160) & 0x1ff);
+    sprite.ypos = static_cast<word_t>((128 - height / 2 - screen_y) & 0x1ff);
+    scene.sprites.push_back(sprite);
+  }
+
+  // Lines of the bitmap lie in one 64K page of ROM, whichever byte of the
+  // high table a line takes its page from
+  if (rng() % 4) {
+    const bool hicolor = rng() % 3 == 0;
+    scene.bg_attribute = static_cast<word_t>(((rng() % 4) << 12) | ((rng() % 16) << 8) |
+                                             (rng() % 4));
+    scene.bg_control = static_cast<word_t>(((rng() % 4 == 0) << 8) | (hicolor << 7) | 0x0009);
+    scene.bg_xscroll = static_cast<word_t>(rng() % 0x200);
+    scene.bg_yscroll = static_cast<word_t>(rng() % 0x100);
+    for (addr_t line = 0; line < 256; line++)
+      scene.ram[kBitmapLines + line] = static_cast<word_t>(rng() % 0xfc00);
+    for (addr_t line = 0; line < 128; line++)
+      scene.ram[kBitmapLinesHigh + line] = static_cast<word_t>(((1 + rng() % 0x3f) << 8) |
+                                                               (1 + rng() % 0x3f));
+  }
+  return scene;
+}
+
+void WriteScene(Spg200& spg200, const Scene& scene) {
+  for (addr_t addr = 0; addr < kRamSize; addr++)
+    spg200.WriteWord(addr, scene.ram[addr]);
+  for (addr_t i = 0; i < 256; i++)
+    spg200.WriteWord(0x2b00 + i, scene.palette[i]);
+  for (addr_t i = 0; i < 256; i++) {
+    const Sprite sprite = i < scene.sprites.size() ? scene.sprites[i] : Sprite{};
+    spg200.WriteWord(0x2c00 + i * 4, sprite.ch);
+    spg200.WriteWord(0x2c01 + i * 4, sprite.xpos);
+    spg200.WriteWord(0x2c02 + i * 4, sprite.ypos);
+    spg200.WriteWord(0x2c03 + i * 4, sprite.attr);
+  }
+  spg200.WriteWord(0x2810, scene.bg_xscroll);
+  spg200.WriteWord(0x2811, scene.bg_yscroll);
+  spg200.WriteWord(0x2812, scene.bg_attribute);
+  spg200.WriteWord(0x2813, scene.bg_control);
+  spg200.WriteWord(0x2814, kBitmapLines);
+  spg200.WriteWord(0x2815, kBitmapLinesHigh);
+  spg200.WriteWord(0x2822, scene.sprite_segment);
+  spg200.WriteWord(0x282a, scene.blend_level);
+  spg200.WriteWord(0x2842, 1);
+}
+
+int BlendInterpolate(int old_value, int new_value, int blend_level) {
+  return (old_value * (4 - (blend_level + 1))) / 4 + (new_value * (blend_level + 1)) / 4;
+}
+
+unsigned DivideRoundUp(unsigned dividend, unsigned divisor) {
+  return (dividend / divisor) + !!(dividend % divisor);
+}
+
+// Draws scanlines as the PPU did before it was specialized per depth
+class Reference {
+public:
+  Reference(const std::vector<word_t>& rom, const Scene& scene) : rom_(rom), scene_(scene) {}
+
+  void DrawLine(int screen_y, uint16_t* line) {
+    std::fill(line, line + 320, 0x8000);
+    for (int layer = 0; layer < 4; layer++) {
+      if ((scene_.bg_control & 0x0008) && (scene_.bg_attribute >> 12) == layer)
+        DrawBitmapLine(screen_y, line);
+      for (const auto& sprite : scene_.sprites) {
+        if (sprite.ch && !(sprite.attr & 0x4000) && ((sprite.attr >> 12) & 3) == layer)
+          DrawSpriteLine(sprite, screen_y, line);
+      }
+    }
+    for (const auto& sprite : scene_.sprites) {
+      if (sprite.ch && (sprite.attr & 0x4000))
+        DrawSpriteLine(sprite, screen_y, line);
+    }
+  }
+
+private:
+  word_t ReadWord(addr_t addr) const {
+    addr &= 0x3fffff;
+    return addr < kRamSize ? scene_.ram[addr] : rom_[addr];
+  }
+
+  void DrawBitmapLine(int screen_y, uint16_t* line) {
+    const int tilemap_y = (screen_y + scene_.bg_yscroll) & 0xff;
+    const word_t addr_lo = ReadWord(kBitmapLines + tilemap_y);
+    const word_t addr_hi =
+        ReadWord(kBitmapLinesHigh + tilemap_y / 2) >> word_t((tilemap_y & 1) ? 8 : 0);
+    const addr_t addr = addr_lo | (addr_hi << 16);
+    const unsigned bits_per_pixel =
+        (scene_.bg_control & 0x0080) ? 16 : ((scene_.bg_attribute & 3) + 1) * 2;
+    const unsigned palette = (scene_.bg_attribute >> 8) & 0xf;
+    for (int screen_x = -(scene_.bg_xscroll & 0x1ff); screen_x < 320; screen_x += 512)
+      DrawTileLine(line, screen_x, addr, 512, palette, false, bits_per_pixel,
+                   scene_.bg_control & 0x0100);
+  }
+
+  void DrawSpriteLine(const Sprite& sprite, int screen_y, uint16_t* line) {
+    const int tile_width = 8 << ((sprite.attr >> 4) & 3);
+    const int tile_height = 8 << ((sprite.attr >> 6) & 3);
+    const int xpos = (160 + SignExtend9(sprite.xpos)) - tile_width / 2;
+    const int ypos = (128 - SignExtend9(sprite.ypos)) - tile_height / 2;
+    const unsigned bits_per_pixel = ((sprite.attr & 3) + 1) * 2;
+    const bool vflip = sprite.attr & 0x0008;
+    const int tile_y = !vflip ? (screen_y - ypos) : (tile_height - 1) - (screen_y - ypos);
+    if (tile_y < 0 || tile_y >= tile_height)
+      return;
+
+    const addr_t addr = (scene_.sprite_segment << 6) +
+                        (sprite.ch * tile_height + tile_y) * tile_width * bits_per_pixel / 16;
+    DrawTileLine(line, xpos, addr, tile_width, (sprite.attr >> 8) & 0xf, sprite.attr & 0x0004,
+                 bits_per_pixel, sprite.attr & 0x4000);
+  }
+
+  void DrawTileLine(uint16_t* line, int screen_x_start, addr_t line_addr, int tile_width,
+                    unsigned palette, bool hflip, unsigned bits_per_pixel, bool blend) {
+    int pixbuf_shift = -bits_per_pixel;
+    uint32_t pixbuf = 0;
+    addr_t addr = line_addr + (hflip ? ((tile_width * bits_per_pixel) / 16 - 1) : 0);
+
+    // skip bus reads containing entirely unused pixels
+    const int left_offscreen = screen_x_start < 0 ? -screen_x_start : 0;
+    int skipped_pixels = 0;
+    if (left_offscreen > 0) {
+      int skipped_words = ((left_offscreen * bits_per_pixel) / 16);
+      if (skipped_words != 0) {
+        addr += hflip ? -skipped_words : skipped_words;
+        skipped_pixels = DivideRoundUp(skipped_words * 16, bits_per_pixel);
+        pixbuf_shift -= (skipped_pixels * bits_per_pixel) % 16;
+      }
+    }
+
+    for (int screen_x = screen_x_start + skipped_pixels;
+         screen_x < screen_x_start + tile_width && screen_x < 320; screen_x++) {
+      if (pixbuf_shift < 0) {
+        word_t val = ReadWord(addr);
+        addr += hflip ? -1 : 1;
+        if (bits_per_pixel != 16)
+          val = (val >> 8) | (val << 8);
+        pixbuf = hflip ? (val << 16) | (pixbuf >> 16) : (pixbuf << 16) | val;
+        pixbuf_shift += 16;
+      }
+
+      const int pixbuf_shift_flip =
+          hflip ? ((16 - bits_per_pixel) - pixbuf_shift) + 16 : pixbuf_shift;
+      const int pixdata = (pixbuf >> pixbuf_shift_flip) & ((1 << bits_per_pixel) - 1);
+      pixbuf_shift -= bits_per_pixel;
+
+      if (screen_x < 0)
+        continue;
+
+      uint16_t color;
+      switch (bits_per_pixel) {
+        case 2:
+        case 4:
+          color = scene_.palette[palette * 16 + pixdata];
+          break;
+        case 6:
+          color = scene_.palette[(palette >> 2) * 64 + pixdata];
+          break;
+        case 8:
+          color = scene_.palette[pixdata];
+          break;
+        default:
+          color = static_cast<uint16_t>(pixdata);
+          break;
+      }
+
+      if (color & 0x8000)
+        continue;
+
+      const uint16_t old_color = line[screen_x];
+      if (blend && !(old_color & 0x8000)) {
+        const int r = BlendInterpolate((old_color >> 10) & 0x1f, (color >> 10) & 0x1f,
+                                       scene_.blend_level);
+        const int g = BlendInterpolate((old_color >> 5) & 0x1f, (color >> 5) & 0x1f,
+                                       scene_.blend_level);
+        const int b = BlendInterpolate(old_color & 0x1f, color & 0x1f, scene_.blend_level);
+        color = static_cast<uint16_t>((r << 10) | (g << 5) | b);
+      }
+      line[screen_x] = color;
+    }
+  }
+
+  const std::vector<word_t>& rom_;
+  const Scene& scene_;
+};
+
+void TestScenes() {
+  const std::vector<word_t> rom = MakeRom();
+  TestIo io(rom);
+  Spg200 spg200(VideoTiming::PAL, io);
+  spg200.Reset();
+
+  std::mt19937 rng(2);
+  int lines_matching = 0;
+  int lines_drawn = 0;
+  for (int i = 0; i < kScenes; i++) {
+    const Scene scene = MakeScene(rng, i % 2 == 0);
+    WriteScene(spg200, scene);
+    Reference reference(rom, scene);
+
+    std::array<uint16_t, 320> line;
+    std::array<uint8_t, 320 * 2> expected;
+    for (int frame = 0; frame < 2; frame++) {
+      spg200.RunFrame();
+      const auto picture = spg200.GetPicture();
+      for (int y = 0; y < 240; y++) {
+        reference.DrawLine(y, line.data());
+        ConvertRGB555(line.data(), expected.data(), 320);
+        lines_matching += std::equal(expected.begin(), expected.end(), &picture[y * 320 * 2]);
+        lines_drawn += std::any_of(line.begin(), line.end(), [](uint16_t c) { return c != 0x8000; });
+      }
+    }
+  }
+  EXPECT(lines_matching == kScenes * 2 * 240);
+  // Most lines show something, or the comparison says little
+  EXPECT(lines_drawn > kScenes * 2 * 240 * 3 / 4);
+
+  // Rows from ROM were found in the cache the second time
+  EXPECT(spg200.GetTileCacheStats().hits > 0);
+}
+}  // namespace
+
+int main() {
+  TestScenes();
+  return TestResult();
+}
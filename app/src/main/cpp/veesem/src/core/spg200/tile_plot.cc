@@ -0,0 +1,153 @@
+#include "tile_plot.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace {
+inline unsigned BlendInterpolate(unsigned old_value, unsigned new_value, unsigned blend_level) {
+  return (old_value * (3 - blend_level)) / 4 + (new_value * (blend_level + 1)) / 4;
+}
+
+inline void PlotScalar(uint16_t& dst, uint16_t color, bool blend, unsigned blend_level) {
+  if (color & 0x8000)
+    return;
+
+  if (blend && !(dst & 0x8000)) {
+    const unsigned r = BlendInterpolate((dst >> 10) & 0x1f, (color >> 10) & 0x1f, blend_level);
+    const unsigned g = BlendInterpolate((dst >> 5) & 0x1f, (color >> 5) & 0x1f, blend_level);
+    const unsigned b = BlendInterpolate(dst & 0x1f, color & 0x1f, blend_level);
+    color = static_cast<uint16_t>((r << 10) | (g << 5) | b);
+  }
+  dst = color;
+}
+
+// The vector kernels handle a multiple of 8 pixels and return how many they
+// drew; the scalar loop takes care of the rest. There is no gather before AVX2,
+// so the palette lookups stay scalar and everything after them is vectorized.
+#if defined(__ARM_NEON)
+inline uint16x8_t Component(uint16x8_t pixels, int shift) {
+  return vandq_u16(vshlq_u16(pixels, vdupq_n_s16(-shift)), vdupq_n_u16(0x1f));
+}
+
+inline uint16x8_t BlendComponent(uint16x8_t old_value, uint16x8_t new_value,
+                                 unsigned blend_level) {
+  return vaddq_u16(vshrq_n_u16(vmulq_n_u16(old_value, 3 - blend_level), 2),
+                   vshrq_n_u16(vmulq_n_u16(new_value, blend_level + 1), 2));
+}
+
+// Draws 8 colors onto the line
+inline void Plot8(uint16x8_t color, uint16_t* line, bool blend, unsigned blend_level) {
+  const uint16x8_t old = vld1q_u16(line);
+  const uint16x8_t transparent =
+      vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(color), 15));
+
+  if (blend) {
+    const uint16x8_t r = BlendComponent(Component(old, 10), Component(color, 10), blend_level);
+    const uint16x8_t g = BlendComponent(Component(old, 5), Component(color, 5), blend_level);
+    const uint16x8_t b = BlendComponent(Component(old, 0), Component(color, 0), blend_level);
+    const uint16x8_t blended = vorrq_u16(vorrq_u16(vshlq_n_u16(r, 10), vshlq_n_u16(g, 5)), b);
+    const uint16x8_t old_transparent =
+        vreinterpretq_u16_s16(vshrq_n_s16(vreinterpretq_s16_u16(old), 15));
+    color = vbslq_u16(old_transparent, color, blended);
+  }
+  vst1q_u16(line, vbslq_u16(transparent, old, color));
+}
+
+std::size_t PlotVector(const uint8_t* pixels, const uint16_t* palette, uint16_t* line,
+                       std::size_t count, bool blend, unsigned blend_level) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    alignas(16) uint16_t colors[8];
+    for (int j = 0; j < 8; j++)
+      colors[j] = palette[pixels[i + j]];
+    Plot8(vld1q_u16(colors), line + i, blend, blend_level);
+  }
+  return i;
+}
+
+std::size_t PlotColorsVector(const uint16_t* colors, uint16_t* line, std::size_t count,
+                             bool blend, unsigned blend_level) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    Plot8(vld1q_u16(colors + i), line + i, blend, blend_level);
+  return i;
+}
+#elif defined(__SSE2__)
+inline __m128i Component(__m128i pixels, int shift) {
+  return _mm_and_si128(_mm_srli_epi16(pixels, shift), _mm_set1_epi16(0x1f));
+}
+
+inline __m128i BlendComponent(__m128i old_value, __m128i new_value, unsigned blend_level) {
+  const __m128i old_weight = _mm_set1_epi16(static_cast<short>(3 - blend_level));
+  const __m128i new_weight = _mm_set1_epi16(static_cast<short>(blend_level + 1));
+  return _mm_add_epi16(_mm_srli_epi16(_mm_mullo_epi16(old_value, old_weight), 2),
+                       _mm_srli_epi16(_mm_mullo_epi16(new_value, new_weight), 2));
+}
+
+// Draws 8 colors onto the line
+inline void Plot8(__m128i color, uint16_t* line, bool blend, unsigned blend_level) {
+  const __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i*>(line));
+  const __m128i transparent = _mm_srai_epi16(color, 15);
+
+  if (blend) {
+    const __m128i r = BlendComponent(Component(old, 10), Component(color, 10), blend_level);
+    const __m128i g = BlendComponent(Component(old, 5), Component(color, 5), blend_level);
+    const __m128i b = BlendComponent(Component(old, 0), Component(color, 0), blend_level);
+    const __m128i blended =
+        _mm_or_si128(_mm_or_si128(_mm_slli_epi16(r, 10), _mm_slli_epi16(g, 5)), b);
+    const __m128i old_transparent = _mm_srai_epi16(old, 15);
+    color = _mm_or_si128(_mm_and_si128(old_transparent, color),
+                         _mm_andnot_si128(old_transparent, blended));
+  }
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(line),
+                   _mm_or_si128(_mm_and_si128(transparent, old),
+                                _mm_andnot_si128(transparent, color)));
+}
+
+std::size_t PlotVector(const uint8_t* pixels, const uint16_t* palette, uint16_t* line,
+                       std::size_t count, bool blend, unsigned blend_level) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8) {
+    alignas(16) uint16_t colors[8];
+    for (int j = 0; j < 8; j++)
+      colors[j] = palette[pixels[i + j]];
+    Plot8(_mm_load_si128(reinterpret_cast<const __m128i*>(colors)), line + i, blend,
+          blend_level);
+  }
+  return i;
+}
+
+std::size_t PlotColorsVector(const uint16_t* colors, uint16_t* line, std::size_t count,
+                             bool blend, unsigned blend_level) {
+  std::size_t i = 0;
+  for (; i + 8 <= count; i += 8)
+    Plot8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(colors + i)), line + i, blend,
+          blend_level);
+  return i;
+}
+#else
+std::size_t PlotVector(const uint8_t*, const uint16_t*, uint16_t*, std::size_t, bool, unsigned) {
+  return 0;
+}
+
+std::size_t PlotColorsVector(const uint16_t*, uint16_t*, std::size_t, bool, unsigned) {
+  return 0;
+}
+#endif
+}  // namespace
+
+void PlotTilePixels(const uint8_t* pixels, const uint16_t* palette, uint16_t* line,
+                    std::size_t count, bool blend, unsigned blend_level) {
+  for (std::size_t i = PlotVector(pixels, palette, line, count, blend, blend_level); i < count;
+       i++)
+    PlotScalar(line[i], palette[pixels[i]], blend, blend_level);
+}
+
+void PlotTileColors(const uint16_t* colors, uint16_t* line, std::size_t count, bool blend,
+                    unsigned blend_level) {
+  for (std::size_t i = PlotColorsVector(colors, line, count, blend, blend_level); i < count; i++)
+    PlotScalar(line[i], colors[i], blend, blend_level);
+}
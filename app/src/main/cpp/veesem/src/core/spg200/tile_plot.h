@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Draws a run of unpacked tile pixels onto an RGB555 scanline, looking each one
+// up in the palette. Pixels whose color has bit 15 (transparent) set leave the
+// line as it is. With blending, the others are mixed into opaque pixels already
+// on the line at the given blend level (0-3), as the PPU does.
+void PlotTilePixels(const uint8_t* pixels, const uint16_t* palette, uint16_t* line,
+                    std::size_t count, bool blend, unsigned blend_level);
+// The same for pixels that are colors already, as in the 16 bpp modes
+void PlotTileColors(const uint16_t* colors, uint16_t* line, std::size_t count, bool blend,
+                    unsigned blend_level);
@@ -0,0 +1,80 @@
+// Time to plot a full screen of 8 pixel wide tiles, with and without blending,
+// against a plain per-pixel loop that the compiler is kept from vectorizing.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+#include "tile_plot.h"
+
+namespace {
+using PlotFn = void (*)(const uint8_t*, const uint16_t*, uint16_t*, std::size_t, bool, unsigned);
+
+constexpr int kFrames = 2000;
+
+using Clock = std::chrono::steady_clock;
+
+__attribute__((optimize("no-tree-vectorize"))) void PlainPlot(const uint8_t* pixels,
+                                                              const uint16_t* palette,
+                                                              uint16_t* line, std::size_t count,
+                                                              bool blend, unsigned blend_level) {
+  for (std::size_t i = 0; i < count; i++) {
+    uint16_t color = palette[pixels[i]];
+    if (color & 0x8000)
+      continue;
+    if (blend && !(line[i] & 0x8000)) {
+      unsigned out = 0;
+      for (int shift = 0; shift <= 10; shift += 5) {
+        const unsigned old_value = (line[i] >> shift) & 0x1f;
+        const unsigned new_value = (color >> shift) & 0x1f;
+        out |= ((old_value * (3 - blend_level)) / 4 + (new_value * (blend_level + 1)) / 4)
+               << shift;
+      }
+      color = static_cast<uint16_t>(out);
+    }
+    line[i] = color;
+  }
+}
+
+double MicrosecondsPerFrame(PlotFn plot, const std::vector<uint8_t>& rows,
+                            const std::vector<uint16_t>& palette, bool blend) {
+  std::vector<uint16_t> line(320);
+  uint64_t checksum = 0;
+  const auto start = Clock::now();
+  for (int frame = 0; frame < kFrames; frame++) {
+    // 240 scanlines of 40 tiles each
+    for (int y = 0; y < 240; y++) {
+      for (int tile = 0; tile < 40; tile++)
+        plot(&rows[(y * 40 + tile) % (rows.size() / 8) * 8], palette.data(), &line[tile * 8], 8,
+             blend, 2);
+      checksum += line[y];
+    }
+  }
+  const double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+  if (checksum == 1)
+    std::printf("\n");
+  return elapsed / kFrames;
+}
+}  // namespace
+
+int main() {
+  std::vector<uint16_t> palette(256);
+  std::vector<uint8_t> rows(8 * 1024);
+  uint32_t seed = 1;
+  for (auto& color : palette) {
+    seed = seed * 1664525 + 1013904223;
+    color = static_cast<uint16_t>(seed >> 16);
+  }
+  for (auto& pixel : rows) {
+    seed = seed * 1664525 + 1013904223;
+    pixel = static_cast<uint8_t>(seed >> 24);
+  }
+
+  for (bool blend : {false, true}) {
+    std::printf("%-10s %7.2f us/frame, plain loop %7.2f us/frame\n", blend ? "blend" : "no blend",
+                MicrosecondsPerFrame(PlotTilePixels, rows, palette, blend),
+                MicrosecondsPerFrame(PlainPlot, rows, palette, blend));
+  }
+  return 0;
+}
@@ -0,0 +1,136 @@
+// Checks the vectorized plots, of palette indices and of colors, against a
+// plain per-pixel version on random palettes and scanlines, for every blend
+// level and every length up to a full tile row at unaligned starts, with guard
+// pixels around the run.
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include "core/testing.h"
+#include "tile_plot.h"
+
+namespace {
+constexpr uint16_t kGuard = 0x5aa5;
+constexpr std::size_t kMargin = 8;
+
+uint32_t seed = 1;
+
+uint16_t Random16() {
+  seed = seed * 1664525 + 1013904223;
+  return static_cast<uint16_t>(seed >> 16);
+}
+
+// One in four colors is transparent
+uint16_t RandomColor() {
+  const uint16_t color = Random16();
+  return (color & 0x3) ? (color & 0x7fff) : (color | 0x8000);
+}
+
+int Interpolate(int old_value, int new_value, int blend_level) {
+  return (old_value * (4 - (blend_level + 1))) / 4 + (new_value * (blend_level + 1)) / 4;
+}
+
+void Reference(const uint8_t* pixels, const uint16_t* palette, uint16_t* line,
+               std::size_t count, bool blend, unsigned blend_level) {
+  for (std::size_t i = 0; i < count; i++) {
+    uint16_t color = palette[pixels[i]];
+    if (color & 0x8000)
+      continue;
+    if (blend && !(line[i] & 0x8000)) {
+      const int r = Interpolate((line[i] >> 10) & 0x1f, (color >> 10) & 0x1f, blend_level);
+      const int g = Interpolate((line[i] >> 5) & 0x1f, (color >> 5) & 0x1f, blend_level);
+      const int b = Interpolate(line[i] & 0x1f, color & 0x1f, blend_level);
+      color = static_cast<uint16_t>((r << 10) | (g << 5) | b);
+    }
+    line[i] = color;
+  }
+}
+
+void TestRandom(bool blend, unsigned blend_level) {
+  std::array<uint16_t, 256> palette;
+  std::array<uint8_t, 64> pixels;
+
+  for (int round = 0; round < 20; round++) {
+    for (auto& color : palette)
+      color = RandomColor();
+    for (auto& pixel : pixels)
+      pixel = static_cast<uint8_t>(Random16());
+
+    for (std::size_t count = 0; count <= pixels.size(); count++) {
+      const std::size_t offset = count % 4;
+      std::vector<uint16_t> line(kMargin + offset + count + kMargin, kGuard);
+      for (std::size_t i = 0; i < count; i++)
+        line[kMargin + offset + i] = RandomColor();
+
+      std::vector<uint16_t> expected = line;
+      Reference(pixels.data(), palette.data(), &expected[kMargin + offset], count, blend,
+                blend_level);
+      PlotTilePixels(pixels.data(), palette.data(), &line[kMargin + offset], count, blend,
+                     blend_level);
+      EXPECT(line == expected);
+    }
+  }
+}
+
+// Colors plotted directly, as in the 16 bpp modes, checked through the
+// reference with an identity lookup
+void TestColors(bool blend, unsigned blend_level) {
+  std::array<uint16_t, 256> colors;
+  std::array<uint8_t, 256> indices;
+  for (unsigned i = 0; i < indices.size(); i++)
+    indices[i] = static_cast<uint8_t>(i);
+
+  for (int round = 0; round < 20; round++) {
+    for (auto& color : colors)
+      color = RandomColor();
+
+    for (std::size_t count = 0; count <= 80; count++) {
+      const std::size_t offset = count % 4;
+      std::vector<uint16_t> line(kMargin + offset + count + kMargin, kGuard);
+      for (std::size_t i = 0; i < count; i++)
+        line[kMargin + offset + i] = RandomColor();
+
+      std::vector<uint16_t> expected = line;
+      Reference(indices.data() + offset, colors.data(), &expected[kMargin + offset], count,
+                blend, blend_level);
+      PlotTileColors(colors.data() + offset, &line[kMargin + offset], count, blend, blend_level);
+      EXPECT(line == expected);
+    }
+  }
+}
+
+// All combinations of old and new components for each blend level
+void TestAllComponents() {
+  std::array<uint16_t, 256> palette;
+  std::array<uint8_t, 32> pixels;
+  for (unsigned i = 0; i < 32; i++) {
+    palette[i] = static_cast<uint16_t>((i << 10) | (i << 5) | i);
+    pixels[i] = static_cast<uint8_t>(i);
+  }
+
+  for (unsigned blend_level = 0; blend_level < 4; blend_level++) {
+    for (unsigned old_value = 0; old_value < 32; old_value++) {
+      const uint16_t old_color = static_cast<uint16_t>((old_value << 10) | (old_value << 5) |
+                                                       (31 - old_value));
+      std::vector<uint16_t> line(pixels.size(), old_color);
+      std::vector<uint16_t> expected = line;
+      Reference(pixels.data(), palette.data(), expected.data(), pixels.size(), true, blend_level);
+      PlotTilePixels(pixels.data(), palette.data(), line.data(), pixels.size(), true,
+                     blend_level);
+      EXPECT(line == expected);
+    }
+  }
+}
+}  // namespace
+
+int main() {
+  for (unsigned blend_level = 0; blend_level < 4; blend_level++) {
+    TestRandom(false, blend_level);
+    TestRandom(true, blend_level);
+    TestColors(false, blend_level);
+    TestColors(true, blend_level);
+  }
+  TestAllComponents();
+  return TestResult();
+}
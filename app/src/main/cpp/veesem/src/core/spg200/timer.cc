@@ -1,5 +1,6 @@
 #include "timer.h"
 
+#include "core/state_serializer.h"
 #include "irq.h"
 
 Timer::Timer(Irq& irq) : irq_(irq) {}
@@ -26,6 +27,24 @@ void Timer::Reset() {
   UpdateTimerBDivisors();
 }
 
+void Timer::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("TIMR", 1))
+    return;
+  timer_clock_.Serialize(state);
+  state.Value(timer_a_divisor_);
+  state.Value(timer_b_divisor_);
+  state.Value(timer_a_enabled_);
+  state.Value(timer_a_data_);
+  state.Value(timer_a_preload_);
+  state.Value(timer_b_enabled_);
+  state.Value(timer_b_data_);
+  state.Value(timer_b_preload_);
+  state.Value(timebase_setup_.raw);
+  state.Value(timer_a_control_.raw);
+  state.Value(timer_b_control_.raw);
+  state.EndChunk();
+}
+
 void Timer::RunCycles(int cycles) {
   while (timer_clock_.Tick(cycles)) {  // 32768 Hz tick
     if (timer_a_enabled_ && timer_a_divisor_ >= 0 && timer_clock_.GetDividedTick(timer_a_divisor_))
@@ -62,6 +81,10 @@ void Timer::RunCycles(int cycles) {
   }
 }
 
+int Timer::GetCyclesToNextEvent() const {
+  return timer_clock_.GetCyclesToTick();
+}
+
 word_t Timer::GetTimerAData() {
   return timer_a_data_;
 }
@@ -3,12 +3,15 @@
 #include "core/common.h"
 
 class Irq;
+class StateSerializer;
 
 class Timer {
 public:
   Timer(Irq& irq);
   void Reset();
+  void Serialize(StateSerializer& state);
   void RunCycles(int cycles);
+  int GetCyclesToNextEvent() const;
 
   word_t GetTimebaseSetup();
   void SetTimebaseSetup(word_t value);
@@ -1,3 +1,7 @@
 #pragma once
 
-enum class VideoTiming { PAL, NTSC };
\ No newline at end of file
+enum class VideoTiming { PAL, NTSC };
+
+// Layout of the pixels returned by GetPicture(). RGB555 has red in the high
+// bits; RGBA8888 and BGRA8888 are named by their byte order in memory.
+enum class PixelFormat { RGB555, RGB565, RGBA8888, BGRA8888 };
@@ -1,5 +1,8 @@
 #include "uart.h"
 
+#include <algorithm>
+
+#include "core/state_serializer.h"
 #include "irq.h"
 #include "spg200_io.h"
 
@@ -21,6 +24,22 @@ void Uart::Reset() {
   tx_counter_ = 0;
 }
 
+void Uart::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("UART", 1))
+    return;
+  state.Value(control_.raw);
+  state.Value(status_.raw);
+  state.Value(baud_lo_);
+  state.Value(baud_hi_);
+  state.Value(tx_buf_);
+  state.Value(tx_running_);
+  state.Value(rx_buf_);
+  state.Value(rx_running_);
+  state.Value(tx_counter_);
+  state.Value(rx_counter_);
+  state.EndChunk();
+}
+
 void Uart::RunCycles(int cycles) {
   if (tx_counter_) {
     tx_counter_ -= cycles;
@@ -58,6 +77,15 @@ void Uart::RunCycles(int cycles) {
   }
 }
 
+int Uart::GetCyclesToNextEvent() const {
+  int cycles = kNoEvent;
+  if (tx_counter_)
+    cycles = tx_counter_;
+  if (rx_counter_)
+    cycles = std::min(cycles, rx_counter_);
+  return cycles;
+}
+
 word_t Uart::GetControl() {
   return control_.raw;
 }
@@ -6,13 +6,16 @@
 
 class Irq;
 class Spg200Io;
+class StateSerializer;
 
 class Uart {
 public:
   Uart(Irq& irq, Spg200Io& io);
 
   void Reset();
+  void Serialize(StateSerializer& state);
   void RunCycles(int cycles);
+  int GetCyclesToNextEvent() const;
 
   word_t GetControl();
   void SetControl(word_t value);
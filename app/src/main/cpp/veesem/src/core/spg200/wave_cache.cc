@@ -0,0 +1,41 @@
+#include "wave_cache.h"
+
+#include <algorithm>
+
+std::shared_ptr<const WaveRun> WaveCache::Find(uint64_t key) {
+  const auto it = entries_.find(key);
+  if (it == entries_.end()) {
+    stats_.misses++;
+    return nullptr;
+  }
+  it->second.last_used = ++use_counter_;
+  stats_.hits++;
+  return it->second.run;
+}
+
+void WaveCache::Insert(uint64_t key, std::shared_ptr<const WaveRun> run) {
+  const std::size_t size = run->samples.size();
+  while (!entries_.empty() && stats_.samples + size > kMaxSamples) {
+    const auto victim = std::min_element(entries_.begin(), entries_.end(), [](auto& a, auto& b) {
+      return a.second.last_used < b.second.last_used;
+    });
+    stats_.samples -= victim->second.run->samples.size();
+    entries_.erase(victim);
+  }
+
+  auto& entry = entries_[key];
+  if (entry.run)
+    stats_.samples -= entry.run->samples.size();
+  entry.run = std::move(run);
+  entry.last_used = ++use_counter_;
+  stats_.samples += size;
+}
+
+void WaveCache::Invalidate() {
+  entries_.clear();
+  stats_.samples = 0;
+}
+
+WaveCacheStats WaveCache::GetStats() const {
+  return stats_;
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+struct WaveCacheStats {
+  uint64_t hits = 0;
+  uint64_t misses = 0;
+  std::size_t samples = 0;  // currently cached
+};
+
+// Wave data of one channel decoded ahead: the value the channel's wave data
+// takes at each step from some position in ROM, up to the next end marker.
+struct WaveRun {
+  std::vector<uint16_t> samples;
+  // ADPCM decoder step index after each sample, so that a channel can leave
+  // the run at any point and carry on decoding by itself
+  std::vector<uint8_t> adpcm_step_indices;
+};
+
+// Bounded cache of decoded wave runs, keyed by where decoding starts: address,
+// shift, sample format and, for ADPCM, decoder state. Runs that have not been
+// used for longest are dropped first once the cache is full. Channels hold on
+// to the run they are playing, so dropping one never pulls it from under them.
+class WaveCache {
+public:
+  std::shared_ptr<const WaveRun> Find(uint64_t key);
+  void Insert(uint64_t key, std::shared_ptr<const WaveRun> run);
+  void Invalidate();
+
+  WaveCacheStats GetStats() const;
+
+private:
+  // 4 MiB of samples
+  static constexpr std::size_t kMaxSamples = 1 << 21;
+
+  struct Entry {
+    std::shared_ptr<const WaveRun> run;
+    uint64_t last_used = 0;
+  };
+
+  std::unordered_map<uint64_t, Entry> entries_;
+  uint64_t use_counter_ = 0;
+  WaveCacheStats stats_;
+};
@@ -0,0 +1,92 @@
+#include "state_serializer.h"
+
+StateSerializer::StateSerializer(std::vector<uint8_t>& data) : output_(&data) {
+  uint32_t magic = kMagic;
+  uint32_t format_version = kFormatVersion;
+  Value(magic);
+  Value(format_version);
+}
+
+StateSerializer::StateSerializer(std::span<const uint8_t> data)
+    : input_(data), chunk_end_(data.size()) {
+  uint32_t magic = 0;
+  uint32_t format_version = 0;
+  Value(magic);
+  Value(format_version);
+  if (magic != kMagic || format_version != kFormatVersion)
+    Fail();
+}
+
+bool StateSerializer::IsLoading() const {
+  return output_ == nullptr;
+}
+
+bool StateSerializer::IsOk() const {
+  return ok_;
+}
+
+bool StateSerializer::BeginChunk(const char (&tag)[5], uint32_t version) {
+  uint32_t tag_value;
+  std::memcpy(&tag_value, tag, sizeof(tag_value));
+
+  if (output_) {
+    uint32_t size = 0;  // filled in by EndChunk()
+    Value(tag_value);
+    Value(version);
+    Value(size);
+    chunk_start_ = output_->size();
+    chunk_version_ = version;
+    return true;
+  }
+
+  chunk_end_ = input_.size();
+  uint32_t stored_tag = 0;
+  uint32_t stored_version = 0;
+  uint32_t size = 0;
+  Value(stored_tag);
+  Value(stored_version);
+  Value(size);
+  if (!ok_ || stored_tag != tag_value || stored_version > version ||
+      size > input_.size() - position_) {
+    Fail();
+    return false;
+  }
+  chunk_start_ = position_;
+  chunk_end_ = position_ + size;
+  chunk_version_ = stored_version;
+  return true;
+}
+
+void StateSerializer::EndChunk() {
+  if (output_) {
+    const uint32_t size = static_cast<uint32_t>(output_->size() - chunk_start_);
+    std::memcpy(&(*output_)[chunk_start_ - sizeof(size)], &size, sizeof(size));
+    return;
+  }
+  // A component that read less than was stored does not understand the data
+  if (position_ != chunk_end_)
+    Fail();
+  chunk_end_ = input_.size();
+}
+
+uint32_t StateSerializer::GetChunkVersion() const {
+  return chunk_version_;
+}
+
+void StateSerializer::Require(bool condition) {
+  if (!condition)
+    Fail();
+}
+
+void StateSerializer::Value(bool& value) {
+  uint8_t byte = value;
+  Value(byte);
+  value = byte != 0;
+}
+
+void StateSerializer::Fail() {
+  ok_ = false;
+  // Everything read from here on comes out as zero
+  position_ = input_.size();
+  chunk_end_ = input_.size();
+}
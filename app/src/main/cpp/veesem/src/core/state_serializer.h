@@ -0,0 +1,89 @@
+#pragma once
+
+#include <bitset>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// Reads or writes a save state. Every component has a Serialize() method that
+// passes each of its fields to Value() in a fixed order, so that the same code
+// both saves and loads.
+//
+// A state starts with a header, then holds one chunk per component: a
+// four-character tag, a version and the size of the data that follows.
+// Components check GetChunkVersion() to load data written by older versions of
+// themselves. Loading stops at the first chunk that is missing, has an
+// unknown version or does not hold exactly what its component reads; IsOk()
+// then returns false and the values read are not to be used.
+//
+// Values are stored in host byte order, so states do not move between hosts of
+// different endianness.
+class StateSerializer {
+public:
+  // Appends a new state to data
+  explicit StateSerializer(std::vector<uint8_t>& data);
+  // Reads a state from data
+  explicit StateSerializer(std::span<const uint8_t> data);
+
+  bool IsLoading() const;
+  bool IsOk() const;
+
+  // Starts the next chunk. When loading, returns false if it is not the next
+  // one in the state or its version is newer than the given one.
+  bool BeginChunk(const char (&tag)[5], uint32_t version);
+  void EndChunk();
+  uint32_t GetChunkVersion() const;
+  // Fails loading if the condition does not hold, for values that have to
+  // match the machine being loaded into
+  void Require(bool condition);
+
+  template <typename T>
+  void Value(T& value) {
+    static_assert(std::is_trivially_copyable_v<T>);
+    Bytes(&value, sizeof(T));
+  }
+  void Value(bool& value);
+  template <std::size_t N>
+  void Value(std::bitset<N>& value) {
+    static_assert(N <= 64);
+    uint64_t bits = value.to_ullong();
+    Value(bits);
+    value = std::bitset<N>(bits);
+  }
+
+  void Bytes(void* data, std::size_t size);
+
+private:
+  static constexpr uint32_t kMagic = 0x54535356;  // "VSST"
+  static constexpr uint32_t kFormatVersion = 1;
+
+  void Fail();
+
+  std::vector<uint8_t>* output_ = nullptr;
+  std::span<const uint8_t> input_;
+  std::size_t position_ = 0;
+  bool ok_ = true;
+
+  // Where the open chunk's data starts, and when loading, where it ends
+  std::size_t chunk_start_ = 0;
+  std::size_t chunk_end_ = 0;
+  uint32_t chunk_version_ = 0;
+};
+
+inline void StateSerializer::Bytes(void* data, std::size_t size) {
+  if (output_) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    output_->insert(output_->end(), bytes, bytes + size);
+    return;
+  }
+  if (!ok_ || size > chunk_end_ - position_) {
+    Fail();
+    std::memset(data, 0, size);
+    return;
+  }
+  std::memcpy(data, &input_[position_], size);
+  position_ += size;
+}
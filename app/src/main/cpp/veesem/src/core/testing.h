@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdio>
+
+// Checks for the core's tests, which are plain executables run by CTest. A
+// failed check is reported and the test carries on, so that one run shows
+// every failure; main() returns TestResult().
+
+namespace testing_internal {
+inline int failures = 0;
+
+inline void Expect(bool condition, const char* expression, const char* file, int line) {
+  if (condition)
+    return;
+  std::fprintf(stderr, "%s:%d: expected %s\n", file, line, expression);
+  failures++;
+}
+}  // namespace testing_internal
+
+#define EXPECT(condition) testing_internal::Expect((condition), #condition, __FILE__, __LINE__)
+
+inline int TestResult() {
+  if (testing_internal::failures)
+    std::fprintf(stderr, "%d check(s) failed\n", testing_internal::failures);
+  return testing_internal::failures ? 1 : 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Hands the latest of a stream of values from one producer thread to one
+// consumer thread without locks. The producer always has a buffer to write and
+// the consumer always has one to read; the third holds the newest published
+// value, swapped with whichever side asks next. Values the consumer does not
+// get to in time are overwritten, never queued.
+template <typename T>
+class TripleBuffer {
+public:
+  TripleBuffer() = default;
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Producer side. Publish() makes the write buffer the newest value and
+  // hands the producer another one to write, whose contents are stale.
+  T& GetWriteBuffer() {
+    return buffers_[write_index_];
+  }
+  void Publish() {
+    const uint8_t previous = middle_.exchange(write_index_ | kFresh, std::memory_order_acq_rel);
+    write_index_ = previous & kIndexMask;
+  }
+
+  // Consumer side. Update() takes the newest value into the read buffer, and
+  // returns false if nothing was published since the last call.
+  bool Update() {
+    if (!(middle_.load(std::memory_order_relaxed) & kFresh))
+      return false;
+    const uint8_t previous = middle_.exchange(read_index_, std::memory_order_acq_rel);
+    read_index_ = previous & kIndexMask;
+    return true;
+  }
+  const T& GetReadBuffer() const {
+    return buffers_[read_index_];
+  }
+
+private:
+  static constexpr uint8_t kIndexMask = 0x3;
+  static constexpr uint8_t kFresh = 0x4;
+
+  std::array<T, 3> buffers_{};
+  uint8_t write_index_ = 0;  // owned by the producer
+  alignas(64) std::atomic<uint8_t> middle_ = 1;
+  alignas(64) uint8_t read_index_ = 2;  // owned by the consumer
+};
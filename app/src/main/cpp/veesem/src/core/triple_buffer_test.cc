@@ -0,0 +1,110 @@
+// Checks that the consumer always gets the newest value published, never one
+// older than the last it got, and never one the producer is still writing,
+// with both on one thread and with a producer and a consumer thread going as
+// fast as they can.
+
+#include <cstdint>
+#include <thread>
+
+#include "core/testing.h"
+#include "triple_buffer.h"
+
+namespace {
+// Large enough that a torn value would show
+struct Value {
+  uint64_t sequence = 0;
+  uint64_t words[31] = {};
+
+  void Fill(uint64_t value) {
+    sequence = value;
+    for (uint64_t i = 0; i < 31; i++)
+      words[i] = value * 0x9e3779b97f4a7c15u + i;
+  }
+
+  bool IsWhole() const {
+    for (uint64_t i = 0; i < 31; i++) {
+      if (words[i] != sequence * 0x9e3779b97f4a7c15u + i)
+        return false;
+    }
+    return true;
+  }
+};
+
+void Publish(TripleBuffer<Value>& buffer, uint64_t value) {
+  buffer.GetWriteBuffer().Fill(value);
+  buffer.Publish();
+}
+
+void TestOneThread() {
+  TripleBuffer<Value> buffer;
+  EXPECT(!buffer.Update());
+  EXPECT(buffer.GetReadBuffer().sequence == 0);
+
+  Publish(buffer, 1);
+  EXPECT(buffer.Update());
+  EXPECT(buffer.GetReadBuffer().sequence == 1);
+  EXPECT(!buffer.Update());
+  EXPECT(buffer.GetReadBuffer().sequence == 1);
+
+  // Values in between are skipped
+  Publish(buffer, 2);
+  Publish(buffer, 3);
+  Publish(buffer, 4);
+  EXPECT(buffer.Update());
+  EXPECT(buffer.GetReadBuffer().sequence == 4);
+  EXPECT(buffer.GetReadBuffer().IsWhole());
+  EXPECT(!buffer.Update());
+
+  // The producer never writes into what the consumer reads
+  bool apart = true;
+  for (uint64_t value = 5; value < 50; value++) {
+    apart &= &buffer.GetWriteBuffer() != &buffer.GetReadBuffer();
+    Publish(buffer, value);
+    apart &= &buffer.GetWriteBuffer() != &buffer.GetReadBuffer();
+    if (value % 3 == 0) {
+      buffer.Update();
+      apart &= buffer.GetReadBuffer().sequence == value;
+    }
+  }
+  EXPECT(apart);
+}
+
+void TestTwoThreads() {
+  constexpr uint64_t kValues = 1 << 20;
+  TripleBuffer<Value> buffer;
+
+  std::thread producer([&buffer] {
+    for (uint64_t value = 1; value <= kValues; value++)
+      Publish(buffer, value);
+  });
+
+  uint64_t last = 0;
+  uint64_t updates = 0;
+  bool in_order = true;
+  bool whole = true;
+  while (last < kValues) {
+    if (!buffer.Update()) {
+      // Nothing new, so what was read stays as it was
+      whole &= buffer.GetReadBuffer().sequence == last;
+      continue;
+    }
+    const Value& value = buffer.GetReadBuffer();
+    in_order &= value.sequence > last;
+    whole &= value.IsWhole();
+    last = value.sequence;
+    updates++;
+  }
+  producer.join();
+
+  EXPECT(in_order);
+  EXPECT(whole);
+  EXPECT(updates > 1);
+  EXPECT(!buffer.Update());
+}
+}  // namespace
+
+int main() {
+  TestOneThread();
+  TestTwoThreads();
+  return TestResult();
+}
@@ -0,0 +1,191 @@
+#include "boot_cache.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <system_error>
+
+#include "core_build_hash.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr uint64_t kMagic = 0x4548434143425356;  // "VSBCACHE"
+constexpr const char* kExtension = ".boot";
+// Any change to the core may make machines boot differently, so entries are
+// only used by the build that stored them
+constexpr uint64_t kCoreBuildHash = VEESEM_CORE_BUILD_HASH;
+
+constexpr uint64_t kPrime1 = 0x9e3779b185ebca87;
+constexpr uint64_t kPrime2 = 0xc2b2ae3d27d4eb4f;
+
+uint64_t HashWords(uint64_t hash, std::span<const word_t> words) {
+  // Four words at a time, mixed in the way of xxHash
+  const std::size_t blocks = words.size() / 4;
+  for (std::size_t i = 0; i < blocks; i++) {
+    uint64_t block;
+    std::memcpy(&block, &words[i * 4], sizeof(block));
+    hash ^= std::rotl(block * kPrime2, 31) * kPrime1;
+    hash = std::rotl(hash, 27) * kPrime1 + kPrime2;
+  }
+  for (std::size_t i = blocks * 4; i < words.size(); i++)
+    hash = std::rotl(hash ^ (words[i] * kPrime1), 23) * kPrime2;
+  return hash;
+}
+
+uint64_t Finish(uint64_t hash) {
+  hash ^= hash >> 33;
+  hash *= kPrime2;
+  hash ^= hash >> 29;
+  return hash;
+}
+}  // namespace
+
+BootCache::BootCache(fs::path directory, uint64_t budget_bytes)
+    : directory_(std::move(directory)), budget_bytes_(budget_bytes) {}
+
+uint64_t BootCache::HashRoms(const VSmile::SysRomType& sys_rom,
+                             const VSmile::CartRomType& cart_rom) {
+  uint64_t hash = HashWords(0, sys_rom);
+  hash = HashWords(hash, cart_rom);
+  return Finish(hash);
+}
+
+bool BootCache::Boot(const Key& key, VSmile& vsmile) {
+  Cancel();
+  if (Load(key, vsmile))
+    return true;
+
+  boot_key_ = key;
+  boot_frames_left_ = static_cast<int>(vsmile.GetFrameRate() * kBootSeconds);
+  return false;
+}
+
+bool BootCache::Update(VSmile& vsmile) {
+  if (boot_frames_left_ == 0 || --boot_frames_left_ > 0)
+    return false;
+  return Store(boot_key_, vsmile);
+}
+
+void BootCache::Cancel() {
+  boot_frames_left_ = 0;
+}
+
+bool BootCache::IsWaiting() const {
+  return boot_frames_left_ > 0;
+}
+
+bool BootCache::Load(const Key& key, VSmile& vsmile) {
+  const fs::path path = GetPath(key);
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if (!file.good())
+    return false;
+
+  const auto size = static_cast<std::size_t>(file.tellg());
+  Header header;
+  bool ok = size > sizeof(header);
+  if (ok) {
+    file.seekg(0);
+    file.read(reinterpret_cast<char*>(header.data()), sizeof(header));
+    state_.resize(size - sizeof(header));
+    file.read(reinterpret_cast<char*>(state_.data()), state_.size());
+    ok = file.good() && header == MakeHeader(key) && vsmile.LoadState(state_);
+  }
+  file.close();
+
+  std::error_code error;
+  if (!ok) {
+    fs::remove(path, error);
+    return false;
+  }
+  // Keeps it from being the next one deleted to stay within the budget
+  fs::last_write_time(path, fs::file_time_type::clock::now(), error);
+  return true;
+}
+
+bool BootCache::Store(const Key& key, VSmile& vsmile) {
+  std::error_code error;
+  fs::create_directories(directory_, error);
+
+  const fs::path path = GetPath(key);
+  fs::path temp_path = path;
+  temp_path += ".tmp";
+
+  vsmile.SaveState(state_);
+  const Header header = MakeHeader(key);
+  std::ofstream file(temp_path, std::ios::binary | std::ios::trunc);
+  file.write(reinterpret_cast<const char*>(header.data()), sizeof(header));
+  file.write(reinterpret_cast<const char*>(state_.data()), state_.size());
+  file.close();
+  if (!file.good()) {
+    fs::remove(temp_path, error);
+    return false;
+  }
+
+  fs::rename(temp_path, path, error);
+  if (error) {
+    fs::remove(temp_path, error);
+    return false;
+  }
+  Trim();
+  return true;
+}
+
+BootCache::Header BootCache::MakeHeader(const Key& key) {
+  return {kMagic,
+          kCoreBuildHash,
+          key.rom_hash,
+          key.region_code & 0xf,
+          key.vtech_logo,
+          static_cast<uint64_t>(key.video_timing)};
+}
+
+fs::path BootCache::GetPath(const Key& key) const {
+  char name[64];
+  std::snprintf(name, sizeof(name), "%016llx-%x-%d-%s%s",
+                static_cast<unsigned long long>(key.rom_hash), key.region_code & 0xf,
+                key.vtech_logo ? 1 : 0, key.video_timing == VideoTiming::PAL ? "pal" : "ntsc",
+                kExtension);
+  return directory_ / name;
+}
+
+void BootCache::Trim() {
+  struct Entry {
+    fs::path path;
+    uint64_t size;
+    fs::file_time_type last_used;
+  };
+  std::vector<Entry> entries;
+  uint64_t total_size = 0;
+
+  std::error_code error;
+  for (const auto& dir_entry : fs::directory_iterator(directory_, error)) {
+    if (dir_entry.path().extension() != kExtension || !dir_entry.is_regular_file(error))
+      continue;
+
+    uint64_t start[2] = {};
+    std::ifstream file(dir_entry.path(), std::ios::binary);
+    file.read(reinterpret_cast<char*>(start), sizeof(start));
+    file.close();
+    if (start[0] != kMagic || start[1] != kCoreBuildHash) {
+      fs::remove(dir_entry.path(), error);
+      continue;
+    }
+
+    const uint64_t size = dir_entry.file_size(error);
+    entries.push_back({dir_entry.path(), size, dir_entry.last_write_time(error)});
+    total_size += size;
+  }
+
+  std::sort(entries.begin(), entries.end(),
+            [](const Entry& a, const Entry& b) { return a.last_used < b.last_used; });
+  for (const auto& entry : entries) {
+    if (total_size <= budget_bytes_)
+      break;
+    fs::remove(entry.path, error);
+    total_size -= entry.size;
+  }
+}
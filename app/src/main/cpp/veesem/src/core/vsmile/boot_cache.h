@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "core/spg200/types.h"
+#include "vsmile.h"
+
+// Directory of save states taken a few seconds after power-on, by which time
+// the system and game intros are over. Nothing but the ROMs and jumpers
+// decides where a boot without input gets to, so later boots with the same
+// ones can load the state instead of emulating their way there.
+//
+// A boot that is not cached yet is stored when it gets there, from the frames
+// the frontend runs and shows anyway. Anything else that changes the machine
+// on the way, like input, cancels that, as the state would then be one only
+// this boot got to.
+//
+// Entries are written to a temporary file and renamed into place, so a crash
+// never leaves half an entry behind. Once the directory holds more than its
+// budget, the entries used least recently are deleted. Entries written by
+// another build of the core, or that no longer load, are deleted when found.
+//
+// Not for Art Studio cartridges, whose NVRAM would be loaded from the state.
+class BootCache {
+public:
+  struct Key {
+    uint64_t rom_hash = 0;
+    unsigned region_code = 0;
+    bool vtech_logo = true;
+    VideoTiming video_timing = VideoTiming::PAL;
+  };
+
+  // Where the boot state is taken
+  static constexpr double kBootSeconds = 5.0;
+
+  BootCache(std::filesystem::path directory, uint64_t budget_bytes);
+
+  static uint64_t HashRoms(const VSmile::SysRomType& sys_rom, const VSmile::CartRomType& cart_rom);
+
+  // Takes a machine that was just reset and loads its boot state, returning
+  // true, or else starts waiting for it to boot there (see Update()).
+  bool Boot(const Key& key, VSmile& vsmile);
+
+  // Call after each frame the machine runs forward. On the frame the boot
+  // started by Boot() gets to kBootSeconds, stores its state and returns
+  // whether that worked; false on every other frame.
+  bool Update(VSmile& vsmile);
+  // Gives up on the boot in progress, for when anything but running frames
+  // changes the machine: input, rewinding, loading a state or a reset
+  void Cancel();
+  bool IsWaiting() const;
+
+  bool Load(const Key& key, VSmile& vsmile);
+  bool Store(const Key& key, VSmile& vsmile);
+
+private:
+  using Header = std::array<uint64_t, 6>;
+
+  static Header MakeHeader(const Key& key);
+  std::filesystem::path GetPath(const Key& key) const;
+  // Deletes entries of other builds, then the least recently used ones until
+  // the rest fit in the budget
+  void Trim();
+
+  const std::filesystem::path directory_;
+  const uint64_t budget_bytes_;
+  std::vector<uint8_t> state_;
+
+  // The boot waited for, and frames until it is there
+  Key boot_key_;
+  int boot_frames_left_ = 0;
+};
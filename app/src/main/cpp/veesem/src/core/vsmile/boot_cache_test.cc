@@ -0,0 +1,119 @@
+// Checks that a boot missing from the cache is stored on the frame it gets to
+// kBootSeconds, from the frames run as usual, that later boots load that very
+// state, and that cancelling leaves nothing behind.
+
+#include <algorithm>
+#include <filesystem>
+#include <memory>
+#include <vector>
+
+#include "boot_cache.h"
+#include "core/testing.h"
+#include "vsmile.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+
+constexpr word_t Alu(int op0, int rd, int op1n, int rs) {
+  return (op0 << 12) | (rd << 9) | (op1n << 3) | rs;
+}
+
+constexpr word_t Imm6(int op0, int rd, int op1, int imm6) {
+  return (op0 << 12) | (rd << 9) | (op1 << 6) | imm6;
+}
+
+// Counts up in RAM, so that every frame leaves a different state
+std::shared_ptr<const VSmile::CartRomType> MakeCart() {
+  auto cart = std::make_shared<VSmile::CartRomType>();
+  cart->fill(0);
+  (*cart)[0xfff7] = kProgram;  // reset vector
+  const word_t program[] = {
+      Alu(9, 1, 24, 0),   // r1 = [r0]
+      Imm6(0, 1, 1, 1),   // r1 += 1
+      Alu(13, 1, 24, 0),  // [r0] = r1
+      Imm6(14, 7, 1, 4),  // jmp to the start
+  };
+  std::copy(std::begin(program), std::end(program), cart->begin() + kProgram);
+  return cart;
+}
+
+std::unique_ptr<VSmile> MakeMachine(std::shared_ptr<const VSmile::CartRomType> cart) {
+  auto sys_rom = std::make_shared<VSmile::SysRomType>();
+  sys_rom->fill(0);
+  for (addr_t addr = 0xfffc0; addr < 0xfffdc; addr += 2)
+    (*sys_rom)[addr + 1] = 0x31;
+  auto vsmile = std::make_unique<VSmile>(std::move(sys_rom), std::move(cart),
+                                         VSmile::CartType::STANDARD, nullptr, 0xe, true,
+                                         VideoTiming::PAL);
+  vsmile->Reset();
+  return vsmile;
+}
+
+// Runs frames the way a frontend does, returning the frame Update() stored
+// the state on, or 0
+int RunFrames(BootCache& cache, VSmile& vsmile, int frames) {
+  int stored_on = 0;
+  for (int frame = 1; frame <= frames; frame++) {
+    vsmile.RunFrame();
+    vsmile.GetAudioBuffer().Clear();
+    if (cache.Update(vsmile))
+      stored_on = frame;
+  }
+  return stored_on;
+}
+
+void TestStoreAndLoad(const fs::path& directory) {
+  const auto cart = MakeCart();
+  const BootCache::Key key{1, 0xe, true, VideoTiming::PAL};
+  BootCache cache(directory, 1024 * 1024);
+  auto vsmile = MakeMachine(cart);
+  const int boot_frames = static_cast<int>(vsmile->GetFrameRate() * BootCache::kBootSeconds);
+  EXPECT(!cache.Boot(key, *vsmile));
+  EXPECT(cache.IsWaiting());
+  EXPECT(RunFrames(cache, *vsmile, boot_frames - 1) == 0);
+  EXPECT(RunFrames(cache, *vsmile, 1) == 1);
+  EXPECT(!cache.IsWaiting());
+  std::vector<uint8_t> booted;
+  vsmile->SaveState(booted);
+  // Once only
+  EXPECT(RunFrames(cache, *vsmile, boot_frames) == 0);
+
+  // A new machine gets to the same state right away, with its own cache
+  BootCache other_cache(directory, 1024 * 1024);
+  auto other = MakeMachine(cart);
+  EXPECT(other_cache.Boot(key, *other));
+  EXPECT(!other_cache.IsWaiting());
+  std::vector<uint8_t> loaded;
+  other->SaveState(loaded);
+  EXPECT(loaded == booted);
+}
+
+void TestCancel(const fs::path& directory) {
+  const auto cart = MakeCart();
+  const BootCache::Key key{2, 0xe, true, VideoTiming::PAL};
+  BootCache cache(directory, 1024 * 1024);
+  auto vsmile = MakeMachine(cart);
+  const int boot_frames = static_cast<int>(vsmile->GetFrameRate() * BootCache::kBootSeconds);
+  EXPECT(!cache.Boot(key, *vsmile));
+  RunFrames(cache, *vsmile, 10);
+  cache.Cancel();
+  EXPECT(!cache.IsWaiting());
+  EXPECT(RunFrames(cache, *vsmile, boot_frames) == 0);
+
+  // Nothing was stored, and booting again starts counting over
+  auto again = MakeMachine(cart);
+  EXPECT(!cache.Boot(key, *again));
+  EXPECT(RunFrames(cache, *again, boot_frames) == boot_frames);
+}
+}  // namespace
+
+int main() {
+  const fs::path directory = fs::temp_directory_path() / "veesem_boot_cache_test";
+  fs::remove_all(directory);
+  TestStoreAndLoad(directory);
+  TestCancel(directory);
+  fs::remove_all(directory);
+  return TestResult();
+}
@@ -0,0 +1,89 @@
+// Time per frame of a machine whose CPU never idles. The program loops over
+// the instruction forms games spend most of their time in: ALU ops on imm6,
+// [bp+imm6], [rs], [rs++], registers and imm16, push/pop, mul and conditional
+// branches. Nothing else is running, so the time is almost all CPU.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+#include "vsmile.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+constexpr int kFrames = 300;
+constexpr int kRounds = 3;
+
+using Clock = std::chrono::steady_clock;
+
+constexpr word_t Alu(int op0, int rd, int op1n, int rs) {
+  return (op0 << 12) | (rd << 9) | (op1n << 3) | rs;
+}
+
+// [bp+imm6] (op1 0) and imm6 (op1 1) forms, and branches with rd = pc
+constexpr word_t Imm6(int op0, int rd, int op1, int imm6) {
+  return (op0 << 12) | (rd << 9) | (op1 << 6) | imm6;
+}
+
+std::shared_ptr<const VSmile::CartRomType> MakeCart() {
+  auto cart = std::make_shared<VSmile::CartRomType>();
+  cart->fill(0);
+  (*cart)[0xfff7] = kProgram;  // reset vector
+
+  const word_t program[] = {
+      Alu(9, 1, 33, 0), 0x0100,  // r1 = 0x0100
+      Alu(9, 5, 33, 0), 0x0200,  // bp = 0x0200
+      Alu(9, 0, 33, 0), 0x1000,  // sp = 0x1000
+      // loop:
+      Imm6(0, 2, 1, 5),          // r2 += 5
+      Imm6(13, 2, 0, 3),         // [bp+3] = r2
+      Imm6(0, 3, 0, 3),          // r3 += [bp+3]
+      Alu(9, 4, 26, 1),          // r4 = [r1++]
+      Alu(8, 3, 32, 4),          // r3 ^= r4
+      Alu(13, 3, 24, 1),         // [r1] = r3
+      Alu(13, 3, 18, 0),         // push r2, r3 to [sp]
+      Alu(15, 3, 33, 4),         // mr = r3 * r4, signed
+      Alu(9, 1, 18, 0),          // pop r2, r3 from [sp]
+      Alu(11, 1, 33, 1), 0x07ff,  // r1 &= 0x07ff
+      Imm6(4, 2, 1, 0x20),       // cmp r2, 0x20
+      Imm6(4, 7, 0, 1),          // jne +1
+      Imm6(0, 4, 1, 1),          // r4 += 1
+      Imm6(14, 7, 1, 15),        // jmp loop
+  };
+  std::copy(std::begin(program), std::end(program), cart->begin() + kProgram);
+  return cart;
+}
+
+double MicrosecondsPerFrame(std::shared_ptr<const VSmile::CartRomType> cart) {
+  auto sys_rom = std::make_shared<VSmile::SysRomType>();
+  sys_rom->fill(0);
+  for (addr_t addr = 0xfffc0; addr < 0xfffdc; addr += 2)
+    (*sys_rom)[addr + 1] = 0x31;
+  VSmile vsmile(std::move(sys_rom), std::move(cart), VSmile::CartType::STANDARD, nullptr, 0xe,
+                false, VideoTiming::PAL);
+  vsmile.Reset();
+
+  double best = 0;
+  for (int round = 0; round < kRounds; round++) {
+    const auto start = Clock::now();
+    for (int frame = 0; frame < kFrames; frame++) {
+      vsmile.RunFrame();
+      // The frontend drains the samples every frame
+      vsmile.GetAudioBuffer().Clear();
+    }
+    const double elapsed =
+        std::chrono::duration<double, std::micro>(Clock::now() - start).count() / kFrames;
+    best = round == 0 ? elapsed : std::min(best, elapsed);
+  }
+  return best;
+}
+}  // namespace
+
+int main() {
+  const double us_per_frame = MicrosecondsPerFrame(MakeCart());
+  // 50 frames per emulated second
+  std::printf("%8.1f us/frame  %6.1fx real time\n", us_per_frame, 1e6 / 50 / us_per_frame);
+  return 0;
+}
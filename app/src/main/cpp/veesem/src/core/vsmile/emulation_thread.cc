@@ -0,0 +1,192 @@
+#include "emulation_thread.h"
+
+#include <chrono>
+#include <future>
+#include <utility>
+
+#include "rewind_buffer.h"
+#include "vsmile.h"
+
+EmulationThread::EmulationThread(VSmile& vsmile) : vsmile_(vsmile) {}
+
+EmulationThread::~EmulationThread() {
+  // A command still pending when it stops may start the thread again
+  do {
+    Stop();
+  } while (IsRunning());
+}
+
+void EmulationThread::Start() {
+  std::lock_guard command_lock(command_mutex_);
+  std::lock_guard lock(mutex_);
+  if (running_)
+    return;
+  running_ = true;
+  stopping_ = false;
+  thread_ = std::thread(&EmulationThread::Run, this);
+}
+
+void EmulationThread::Stop() {
+  {
+    std::lock_guard lock(mutex_);
+    if (!running_)
+      return;
+    stopping_ = true;
+  }
+  wake_.notify_all();
+  thread_.join();
+
+  std::lock_guard command_lock(command_mutex_);
+  std::vector<Command> commands;
+  {
+    std::lock_guard lock(mutex_);
+    running_ = false;
+    commands.swap(commands_);
+  }
+  for (auto& command : commands) {
+    command(vsmile_);
+  }
+}
+
+bool EmulationThread::IsRunning() const {
+  std::lock_guard lock(mutex_);
+  return running_;
+}
+
+void EmulationThread::SetPaused(bool paused) {
+  {
+    std::lock_guard lock(mutex_);
+    paused_ = paused;
+  }
+  wake_.notify_all();
+}
+
+bool EmulationThread::IsPaused() const {
+  std::lock_guard lock(mutex_);
+  return paused_;
+}
+
+void EmulationThread::SetRewindBuffer(RewindBuffer* rewind_buffer) {
+  std::lock_guard lock(mutex_);
+  rewind_buffer_ = rewind_buffer;
+}
+
+void EmulationThread::SetRewinding(bool rewinding) {
+  std::lock_guard lock(mutex_);
+  rewinding_ = rewinding;
+}
+
+void EmulationThread::SetFrameCallback(Command callback) {
+  frame_callback_ = std::move(callback);
+}
+
+void EmulationThread::SetRunAheadFrames(int frames) {
+  std::lock_guard lock(mutex_);
+  run_ahead_frames_ = frames;
+}
+
+void EmulationThread::Post(Command command) {
+  std::unique_lock lock(mutex_);
+  if (!running_) {
+    lock.unlock();
+    // Keeps Start() and commands posted from other threads from racing with
+    // this one; the command itself may still call back into this class
+    std::lock_guard command_lock(command_mutex_);
+    lock.lock();
+    if (!running_) {
+      lock.unlock();
+      command(vsmile_);
+      return;
+    }
+  }
+  commands_.push_back(std::move(command));
+  lock.unlock();
+  wake_.notify_all();
+}
+
+void EmulationThread::Invoke(Command command) {
+  std::promise<void> done;
+  Post([&](VSmile& vsmile) {
+    command(vsmile);
+    done.set_value();
+  });
+  done.get_future().wait();
+}
+
+bool EmulationThread::UpdateFrame() {
+  return frames_.Update();
+}
+
+const EmulationThread::Frame& EmulationThread::GetFrame() const {
+  return frames_.GetReadBuffer();
+}
+
+EmulationThreadStats EmulationThread::GetStats() const {
+  return {frame_count_.load(std::memory_order_relaxed),
+          late_frames_.load(std::memory_order_relaxed)};
+}
+
+void EmulationThread::Run() {
+  using Clock = std::chrono::steady_clock;
+  const auto frame_time = std::chrono::duration_cast<Clock::duration>(
+      std::chrono::duration<double>(1.0 / vsmile_.GetFrameRate()));
+  auto next_frame = Clock::now();
+
+  std::unique_lock lock(mutex_);
+  while (!stopping_) {
+    if (!commands_.empty()) {
+      auto commands = std::move(commands_);
+      commands_.clear();
+      lock.unlock();
+      for (auto& command : commands) {
+        command(vsmile_);
+      }
+      lock.lock();
+      continue;
+    }
+    if (paused_) {
+      wake_.wait(lock);
+      next_frame = Clock::now();
+      continue;
+    }
+
+    RewindBuffer* const rewind_buffer = rewind_buffer_;
+    const bool rewinding = rewinding_;
+    const int run_ahead_frames = run_ahead_frames_;
+    lock.unlock();
+    if (rewind_buffer && rewinding) {
+      if (rewind_buffer->RewindFrame(vsmile_))
+        PublishFrame();
+    } else {
+      if (rewind_buffer) {
+        rewind_buffer->RunFrame(vsmile_);
+      } else {
+        vsmile_.RunFrame();
+      }
+      if (frame_callback_)
+        frame_callback_(vsmile_);
+      run_ahead_.Run(vsmile_, run_ahead_frames);
+      PublishFrame();
+    }
+
+    // Deadlines advance by exactly one frame so that rounding does not add
+    // up. More than a frame behind, start over from now rather than rush.
+    next_frame += frame_time;
+    const auto now = Clock::now();
+    if (now - next_frame > frame_time) {
+      late_frames_.fetch_add(1, std::memory_order_relaxed);
+      next_frame = now;
+    }
+
+    lock.lock();
+    wake_.wait_until(lock, next_frame, [this] { return stopping_; });
+  }
+}
+
+void EmulationThread::PublishFrame() {
+  const auto picture = vsmile_.GetPicture();
+  Frame& frame = frames_.GetWriteBuffer();
+  frame.pixels.assign(picture.begin(), picture.end());
+  frame.number = static_cast<int64_t>(frame_count_.fetch_add(1, std::memory_order_relaxed));
+  frames_.Publish();
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "core/triple_buffer.h"
+#include "run_ahead.h"
+
+class RewindBuffer;
+class VSmile;
+
+struct EmulationThreadStats {
+  uint64_t frames = 0;
+  // Frames that finished more than a frame late, after which pacing starts
+  // over instead of running fast to catch up
+  uint64_t late_frames = 0;
+};
+
+// Runs a VSmile on a thread of its own, one frame per deadline at the emulated
+// frame rate. Finished pictures are published through a triple buffer for any
+// other thread to poll; audio goes out through the SPU's ring buffer as usual.
+//
+// While the thread runs, nothing else may touch the VSmile directly. Input and
+// other changes are posted as commands, which run on the emulation thread
+// between frames.
+class EmulationThread {
+public:
+  using Command = std::function<void(VSmile&)>;
+
+  struct Frame {
+    std::vector<uint8_t> pixels;
+    int64_t number = -1;
+  };
+
+  explicit EmulationThread(VSmile& vsmile);
+  // Stops the thread
+  ~EmulationThread();
+
+  EmulationThread(const EmulationThread&) = delete;
+  EmulationThread& operator=(const EmulationThread&) = delete;
+
+  void Start();
+  // Waits for the frame in progress, then runs commands still pending on the
+  // calling thread
+  void Stop();
+  bool IsRunning() const;
+
+  // A paused thread still runs posted commands
+  void SetPaused(bool paused);
+  bool IsPaused() const;
+
+  // Runs frames through the given buffer, which then keeps history, and while
+  // rewinding steps back through it at the frame rate instead of running
+  // forward. The buffer stays owned by the caller and may only be touched
+  // from commands while the thread runs.
+  void SetRewindBuffer(RewindBuffer* rewind_buffer);
+  void SetRewinding(bool rewinding);
+
+  // Runs after each frame run forward, on the emulation thread, before any
+  // frames are run ahead. Set it while the thread is stopped.
+  void SetFrameCallback(Command callback);
+
+  // Shows pictures the given number of frames ahead, see RunAhead. Not while
+  // rewinding.
+  void SetRunAheadFrames(int frames);
+
+  // Runs the command before the next frame, or right away while the thread is
+  // stopped. Invoke() also waits for it to have run; it must not be called
+  // from a command.
+  void Post(Command command);
+  void Invoke(Command command);
+
+  // Consumer side of the picture hand-off. UpdateFrame() returns false if no
+  // frame finished since the last call, leaving GetFrame() as it was.
+  bool UpdateFrame();
+  const Frame& GetFrame() const;
+
+  EmulationThreadStats GetStats() const;
+
+private:
+  void Run();
+  void PublishFrame();
+
+  VSmile& vsmile_;
+  TripleBuffer<Frame> frames_;
+
+  // Held while commands run on a thread other than the emulation thread,
+  // which happens while it is stopped. Recursive so that those commands can
+  // post further commands or start the thread.
+  std::recursive_mutex command_mutex_;
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<Command> commands_;
+  bool running_ = false;
+  bool stopping_ = false;
+  bool paused_ = false;
+  RewindBuffer* rewind_buffer_ = nullptr;
+  bool rewinding_ = false;
+  Command frame_callback_;
+  int run_ahead_frames_ = 0;
+  RunAhead run_ahead_;
+  std::thread thread_;
+
+  std::atomic<uint64_t> frame_count_ = 0;
+  std::atomic<uint64_t> late_frames_ = 0;
+};
@@ -0,0 +1,278 @@
+// Checks where and in which order posted commands run: right away while the
+// thread is stopped, between frames while it runs, and on the stopping thread
+// for those still pending when it stops; also from commands that call back
+// into the class, and with several threads posting while others start and
+// stop it. Meant to be run under ThreadSanitizer as well, which sees the
+// commands' unsynchronized writes if they ever overlap.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "core/testing.h"
+#include "emulation_thread.h"
+#include "vsmile.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+
+using Clock = std::chrono::steady_clock;
+
+std::unique_ptr<VSmile> MakeMachine() {
+  auto cart = std::make_shared<VSmile::CartRomType>();
+  cart->fill(0);
+  (*cart)[0xfff7] = kProgram;  // reset vector
+  (*cart)[kProgram] = 0xee41;  // jmp to itself
+
+  auto sys_rom = std::make_shared<VSmile::SysRomType>();
+  sys_rom->fill(0);
+  for (addr_t addr = 0xfffc0; addr < 0xfffdc; addr += 2)
+    (*sys_rom)[addr + 1] = 0x31;
+  auto vsmile = std::make_unique<VSmile>(std::move(sys_rom), std::move(cart),
+                                         VSmile::CartType::STANDARD, nullptr, 0xe, false,
+                                         VideoTiming::PAL);
+  vsmile->Reset();
+  return vsmile;
+}
+
+// Polls for a new frame, for up to a second
+bool WaitForFrame(EmulationThread& thread) {
+  const auto deadline = Clock::now() + std::chrono::seconds(1);
+  while (Clock::now() < deadline) {
+    if (thread.UpdateFrame())
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return false;
+}
+
+void TestStopped() {
+  auto vsmile = MakeMachine();
+  EmulationThread thread(*vsmile);
+  EXPECT(!thread.IsRunning());
+
+  std::vector<int> order;
+  std::thread::id ran_on;
+  thread.Post([&](VSmile& machine) {
+    order.push_back(1);
+    ran_on = std::this_thread::get_id();
+    EXPECT(&machine == vsmile.get());
+  });
+  EXPECT(order.size() == 1);
+  EXPECT(ran_on == std::this_thread::get_id());
+
+  thread.Invoke([&](VSmile&) { order.push_back(2); });
+  EXPECT(order.size() == 2);
+
+  // Posting from a command runs that one right away too, inside the first
+  thread.Post([&](VSmile&) {
+    order.push_back(3);
+    thread.Post([&](VSmile&) { order.push_back(4); });
+    order.push_back(5);
+  });
+  EXPECT((order == std::vector<int>{1, 2, 3, 4, 5}));
+
+  // Nothing was published, and a paused, stopped thread still runs commands
+  EXPECT(!thread.UpdateFrame());
+  thread.SetPaused(true);
+  thread.Post([&](VSmile&) { order.push_back(6); });
+  EXPECT(order.size() == 6);
+}
+
+void TestRunning() {
+  auto vsmile = MakeMachine();
+  EmulationThread thread(*vsmile);
+  thread.Start();
+  EXPECT(thread.IsRunning());
+
+  // Pictures come out one after another
+  EXPECT(WaitForFrame(thread));
+  const int64_t first = thread.GetFrame().number;
+  EXPECT(WaitForFrame(thread));
+  EXPECT(thread.GetFrame().number > first);
+  EXPECT(thread.GetFrame().pixels.size() == vsmile->GetPicture().size());
+
+  // Posted commands run on the emulation thread, in order, and Invoke()
+  // returns after those posted before it ran
+  std::vector<int> order;
+  std::thread::id ran_on;
+  thread.Post([&](VSmile&) { order.push_back(1); });
+  thread.Post([&](VSmile&) {
+    order.push_back(2);
+    // Posted again from the emulation thread, so it runs after the others
+    thread.Post([&](VSmile&) { order.push_back(5); });
+  });
+  thread.Post([&](VSmile&) { order.push_back(3); });
+  thread.Invoke([&](VSmile&) {
+    order.push_back(4);
+    ran_on = std::this_thread::get_id();
+  });
+  EXPECT(ran_on != std::this_thread::get_id());
+  thread.Invoke([](VSmile&) {});
+  EXPECT((order == std::vector<int>{1, 2, 3, 4, 5}));
+
+  // Commands can ask about and change the thread's settings
+  bool running = false;
+  thread.Invoke([&](VSmile&) {
+    running = thread.IsRunning();
+    thread.SetPaused(true);
+  });
+  EXPECT(running);
+  EXPECT(thread.IsPaused());
+
+  // Paused, it publishes nothing more but still runs commands
+  thread.Invoke([](VSmile&) {});
+  thread.UpdateFrame();
+  const uint64_t frames = thread.GetStats().frames;
+  int ran = 0;
+  thread.Invoke([&](VSmile&) { ran++; });
+  std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  EXPECT(ran == 1);
+  EXPECT(thread.GetStats().frames == frames);
+  EXPECT(!thread.UpdateFrame());
+
+  thread.SetPaused(false);
+  EXPECT(WaitForFrame(thread));
+
+  thread.Stop();
+  EXPECT(!thread.IsRunning());
+  // Stopped again, commands run right away
+  thread.Post([&](VSmile&) { ran++; });
+  EXPECT(ran == 2);
+}
+
+// The frame callback runs on the emulation thread once per frame, before the
+// frame is published
+void TestFrameCallback() {
+  auto vsmile = MakeMachine();
+  EmulationThread thread(*vsmile);
+  // Only touched on the emulation thread, and read back from a command
+  uint64_t calls = 0;
+  bool on_thread = true;
+  const std::thread::id this_thread = std::this_thread::get_id();
+  thread.SetFrameCallback([&](VSmile& machine) {
+    calls++;
+    on_thread &= std::this_thread::get_id() != this_thread && &machine == vsmile.get();
+  });
+  thread.Start();
+  EXPECT(WaitForFrame(thread));
+  EXPECT(WaitForFrame(thread));
+
+  uint64_t seen = 0;
+  thread.Invoke([&](VSmile&) { seen = calls; });
+  thread.Stop();
+  EXPECT(seen >= 2);
+  EXPECT(calls == thread.GetStats().frames);
+  EXPECT(on_thread);
+}
+
+// Commands still queued when the thread stops run on the thread that stopped
+// it, before Stop() returns, and may post or restart from there
+void TestStopWithPending() {
+  auto vsmile = MakeMachine();
+  EmulationThread thread(*vsmile);
+  thread.Start();
+
+  std::atomic<bool> blocking = false;
+  std::atomic<bool> release = false;
+  std::vector<int> order;
+  thread.Post([&](VSmile&) {
+    blocking = true;
+    while (!release)
+      std::this_thread::yield();
+    order.push_back(1);
+  });
+  while (!blocking)
+    std::this_thread::yield();
+
+  // Queued behind the blocked command
+  thread.Post([&](VSmile&) { order.push_back(2); });
+  thread.Post([&](VSmile&) {
+    order.push_back(3);
+    thread.Post([&](VSmile&) { order.push_back(4); });
+  });
+
+  std::thread stopper([&thread] { thread.Stop(); });
+  // Gives Stop() time to get in before the blocked command finishes, so the
+  // others are left to it. Should it come late, they run on the emulation
+  // thread instead, which is just as right.
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  release = true;
+  stopper.join();
+
+  EXPECT(!thread.IsRunning());
+  EXPECT((order == std::vector<int>{1, 2, 3, 4}));
+
+  // A command run by Stop() can start the thread again
+  thread.Start();
+  thread.Post([&](VSmile&) { thread.Start(); });
+  thread.Stop();
+  thread.Post([&](VSmile&) { thread.Start(); });
+  EXPECT(thread.IsRunning());
+  EXPECT(WaitForFrame(thread));
+}
+
+// Every command runs exactly once, never two at a time, while other threads
+// post and the thread keeps being started and stopped
+void TestConcurrentPosts() {
+  constexpr int kPosters = 4;
+  constexpr int kPostsEach = 2000;
+  auto vsmile = MakeMachine();
+  EmulationThread thread(*vsmile);
+
+  // Only touched from commands, which take a while so that two running at
+  // once would overlap
+  uint64_t count = 0;
+  std::vector<int> last_seen(kPosters, -1);
+  bool in_order = true;
+  std::vector<uint64_t> scratch(1024);
+
+  std::atomic<int> posters_done = 0;
+  std::vector<std::thread> posters;
+  for (int poster = 0; poster < kPosters; poster++) {
+    posters.emplace_back([&, poster] {
+      for (int i = 0; i < kPostsEach; i++) {
+        auto command = [&, poster, i](VSmile&) {
+          count++;
+          in_order &= last_seen[poster] == i - 1;
+          last_seen[poster] = i;
+          for (auto& word : scratch)
+            word += count;
+        };
+        if (i % 100 == 99) {
+          thread.Invoke(command);
+        } else {
+          thread.Post(command);
+        }
+      }
+      posters_done++;
+    });
+  }
+
+  while (posters_done < kPosters) {
+    thread.Start();
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    thread.Stop();
+  }
+  for (auto& poster : posters)
+    poster.join();
+
+  EXPECT(count == static_cast<uint64_t>(kPosters) * kPostsEach);
+  EXPECT(in_order);
+  EXPECT(std::all_of(scratch.begin(), scratch.end(),
+                     [&](uint64_t word) { return word == scratch[0]; }));
+}
+}  // namespace
+
+int main() {
+  TestStopped();
+  TestRunning();
+  TestFrameCallback();
+  TestStopWithPending();
+  TestConcurrentPosts();
+  return TestResult();
+}
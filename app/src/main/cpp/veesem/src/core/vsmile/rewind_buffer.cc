@@ -0,0 +1,90 @@
+#include "rewind_buffer.h"
+
+#include "state_delta.h"
+#include "vsmile.h"
+
+RewindBuffer::RewindBuffer(std::size_t budget_bytes, int interval)
+    : budget_bytes_(budget_bytes), interval_(interval) {}
+
+void RewindBuffer::RunFrame(VSmile& vsmile) {
+  if (newest_.empty() || frames_since_snapshot_ >= interval_)
+    TakeSnapshot(vsmile);
+  vsmile.RunFrame();
+  frames_since_snapshot_++;
+}
+
+bool RewindBuffer::RewindFrame(VSmile& vsmile) {
+  if (newest_.empty())
+    return false;
+
+  // Taken right before the frame on screen, so it would only draw that again
+  if (frames_since_snapshot_ <= 1) {
+    if (deltas_.empty())
+      return false;
+    DropNewest();
+  }
+
+  if (!vsmile.LoadState(newest_)) {
+    Clear();
+    return false;
+  }
+  vsmile.RunFrame();
+
+  // Stay at the oldest snapshot once there is nothing before it
+  if (deltas_.empty()) {
+    frames_since_snapshot_ = 1;
+  } else {
+    DropNewest();
+    frames_since_snapshot_ = interval_ + 1;
+  }
+  return true;
+}
+
+void RewindBuffer::Clear() {
+  newest_.clear();
+  deltas_.clear();
+  delta_bytes_ = 0;
+  frames_since_snapshot_ = 0;
+}
+
+RewindStats RewindBuffer::GetStats() const {
+  RewindStats stats;
+  if (newest_.empty())
+    return stats;
+  stats.snapshots = deltas_.size() + 1;
+  stats.frames = static_cast<uint64_t>(deltas_.size()) * interval_ + frames_since_snapshot_;
+  stats.memory_bytes = newest_.size() + delta_bytes_;
+  stats.uncompressed_bytes = stats.snapshots * newest_.size();
+  return stats;
+}
+
+void RewindBuffer::TakeSnapshot(VSmile& vsmile) {
+  vsmile.SaveState(snapshot_);
+  if (!newest_.empty()) {
+    // A state of another size does not come from the same machine
+    if (snapshot_.size() == newest_.size()) {
+      EncodeStateDelta(snapshot_, newest_, encode_buffer_);
+      // Copied out so that every delta takes only what it needs
+      deltas_.emplace_back(encode_buffer_.begin(), encode_buffer_.end());
+      delta_bytes_ += encode_buffer_.size();
+    } else {
+      Clear();
+    }
+  }
+  newest_.swap(snapshot_);
+  frames_since_snapshot_ = 0;
+
+  while (!deltas_.empty() && newest_.size() + delta_bytes_ > budget_bytes_)
+    DropOldest();
+}
+
+void RewindBuffer::DropNewest() {
+  ApplyStateDelta(deltas_.back(), newest_);
+  delta_bytes_ -= deltas_.back().size();
+  deltas_.pop_back();
+}
+
+void RewindBuffer::DropOldest() {
+  delta_bytes_ -= deltas_.front().size();
+  deltas_.pop_front();
+}
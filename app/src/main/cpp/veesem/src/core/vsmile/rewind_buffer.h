@@ -0,0 +1,57 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+class VSmile;
+
+struct RewindStats {
+  std::size_t snapshots = 0;
+  // Frames of history that can be stepped back through
+  uint64_t frames = 0;
+  std::size_t memory_bytes = 0;
+  // What the snapshots would take as full save states
+  std::size_t uncompressed_bytes = 0;
+};
+
+// History of save states to step back through, within a fixed memory budget.
+// A snapshot is taken every few frames. Only the newest is kept whole; each
+// older one is stored as its delta to the snapshot after it (see
+// state_delta.h). The oldest snapshots are dropped to stay within the budget.
+//
+// Frames have to be run through RunFrame() so that snapshots line up with the
+// pictures they were taken before.
+class RewindBuffer {
+public:
+  RewindBuffer(std::size_t budget_bytes, int interval);
+
+  // Runs a frame, taking a snapshot first if one is due
+  void RunFrame(VSmile& vsmile);
+  // Goes back to the newest snapshot from before the frame on screen and runs
+  // that frame again to draw it. Its audio plays again too. Returns false if
+  // there is no history left, leaving the machine as it was.
+  bool RewindFrame(VSmile& vsmile);
+  void Clear();
+
+  RewindStats GetStats() const;
+
+private:
+  void TakeSnapshot(VSmile& vsmile);
+  // Replaces the newest snapshot with the one before it
+  void DropNewest();
+  void DropOldest();
+
+  const std::size_t budget_bytes_;
+  const int interval_;
+  // Frames run since the newest snapshot was taken
+  int frames_since_snapshot_ = 0;
+
+  std::vector<uint8_t> newest_;
+  // Oldest first; the last one turns newest_ into the snapshot before it
+  std::deque<std::vector<uint8_t>> deltas_;
+  std::size_t delta_bytes_ = 0;
+  std::vector<uint8_t> snapshot_;
+  std::vector<uint8_t> encode_buffer_;
+};
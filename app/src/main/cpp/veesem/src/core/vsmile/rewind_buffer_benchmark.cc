@@ -0,0 +1,91 @@
+// How much history the frontends' rewind buffer holds: 4 MB, a snapshot every
+// second frame. Games differ in how much of their RAM changes from one
+// snapshot to the next, so each run has a program that keeps rewriting a
+// different number of words, from none to nearly all of RAM.
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <vector>
+
+#include "rewind_buffer.h"
+#include "vsmile.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+constexpr std::size_t kBudget = 4 * 1024 * 1024;
+constexpr int kInterval = 2;
+// PAL; NTSC holds as many frames, a sixth less time
+constexpr int kFramesPerSecond = 50;
+// Five minutes; a machine that changes little does not fill the budget in that
+constexpr int kMaxFrames = 5 * 60 * kFramesPerSecond;
+
+constexpr word_t Alu(int op0, int rd, int op1n, int rs) {
+  return (op0 << 12) | (rd << 9) | (op1n << 3) | rs;
+}
+
+constexpr word_t Imm6(int op0, int rd, int op1, int imm6) {
+  return (op0 << 12) | (rd << 9) | (op1 << 6) | imm6;
+}
+
+// Counts up through the first words of RAM, all of them every frame
+std::shared_ptr<const VSmile::CartRomType> MakeCart(word_t words) {
+  auto cart = std::make_shared<VSmile::CartRomType>();
+  cart->fill(0);
+  (*cart)[0xfff7] = kProgram;  // reset vector
+  const auto mask = static_cast<word_t>(words - 1);
+  const word_t program[] = {
+      Alu(9, 1, 33, 0), 0x0000,  // r1 = 0
+      // loop:
+      Alu(9, 2, 24, 1),          // r2 = [r1]
+      Imm6(0, 2, 1, 1),          // r2 += 1
+      Alu(13, 2, 26, 1),         // [r1++] = r2
+      Alu(11, 1, 33, 1), mask,  // r1 &= words - 1
+      Imm6(14, 7, 1, 6),         // jmp loop
+  };
+  std::copy(std::begin(program), std::end(program), cart->begin() + kProgram);
+  // Only spins when there is nothing to write
+  if (words == 0)
+    (*cart)[kProgram + 2] = Imm6(14, 7, 1, 1);
+  return cart;
+}
+
+void Measure(word_t words) {
+  auto sys_rom = std::make_shared<VSmile::SysRomType>();
+  sys_rom->fill(0);
+  for (addr_t addr = 0xfffc0; addr < 0xfffdc; addr += 2)
+    (*sys_rom)[addr + 1] = 0x31;
+  VSmile vsmile(std::move(sys_rom), MakeCart(words), VSmile::CartType::STANDARD, nullptr, 0xe,
+                false, VideoTiming::PAL);
+  vsmile.Reset();
+
+  // Runs until the budget is full and then as long again, so that the history
+  // no longer starts at reset
+  RewindBuffer rewind(kBudget, kInterval);
+  int frames = 0;
+  int full_at = 0;
+  while ((!full_at || frames < full_at * 2) && frames < kMaxFrames) {
+    rewind.RunFrame(vsmile);
+    vsmile.GetAudioBuffer().Clear();
+    frames++;
+    const RewindStats stats = rewind.GetStats();
+    if (!full_at && stats.memory_bytes + stats.memory_bytes / stats.snapshots > kBudget)
+      full_at = frames;
+  }
+
+  const RewindStats stats = rewind.GetStats();
+  const std::size_t state_bytes = stats.uncompressed_bytes / stats.snapshots;
+  const std::size_t delta_bytes =
+      stats.snapshots > 1 ? (stats.memory_bytes - state_bytes) / (stats.snapshots - 1) : 0;
+  std::printf("%5u words  %6zu bytes/state  %6zu bytes/snapshot  %s%6.1f s of history\n", words,
+              state_bytes, delta_bytes, full_at ? " " : ">",
+              static_cast<double>(stats.frames) / kFramesPerSecond);
+}
+}  // namespace
+
+int main() {
+  for (word_t words : {0, 0x40, 0x200, 0x800, 0x2000})
+    Measure(words);
+  return 0;
+}
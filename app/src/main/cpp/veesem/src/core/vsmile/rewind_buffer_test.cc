@@ -0,0 +1,239 @@
+// Checks that state deltas turn either state into the other for every kind of
+// run the encoding has, and that rewinding steps back through the states the
+// machine was in, snapshot by snapshot, down to the oldest one the memory
+// budget kept.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "core/testing.h"
+#include "rewind_buffer.h"
+#include "state_delta.h"
+#include "vsmile.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+constexpr int kInterval = 2;
+
+constexpr word_t Alu(int op0, int rd, int op1n, int rs) {
+  return (op0 << 12) | (rd << 9) | (op1n << 3) | rs;
+}
+
+constexpr word_t Imm6(int op0, int rd, int op1, int imm6) {
+  return (op0 << 12) | (rd << 9) | (op1 << 6) | imm6;
+}
+
+bool RoundTrip(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b,
+               std::size_t max_delta_size) {
+  std::vector<uint8_t> delta;
+  EncodeStateDelta(a, b, delta);
+  std::vector<uint8_t> from_a = a;
+  ApplyStateDelta(delta, from_a);
+  std::vector<uint8_t> from_b = b;
+  ApplyStateDelta(delta, from_b);
+  return from_a == b && from_b == a && delta.size() <= max_delta_size;
+}
+
+std::vector<uint8_t> RandomBytes(std::size_t size, std::mt19937& rng) {
+  std::vector<uint8_t> bytes(size);
+  for (auto& byte : bytes)
+    byte = static_cast<uint8_t>(rng());
+  return bytes;
+}
+
+void TestIdentical() {
+  std::mt19937 rng(1);
+  const auto a = RandomBytes(100000, rng);
+  // One unchanged run of three varint bytes, and an empty literal
+  EXPECT(RoundTrip(a, a, 4));
+  EXPECT(RoundTrip({}, {}, 0));
+}
+
+// Changes at either end, after unchanged runs whose lengths take one, two and
+// three varint bytes
+void TestSparseChanges() {
+  std::mt19937 rng(2);
+  const auto a = RandomBytes(100000, rng);
+
+  auto b = a;
+  b.front() ^= 1;
+  EXPECT(RoundTrip(a, b, 7));
+  b = a;
+  b.back() ^= 0x80;
+  EXPECT(RoundTrip(a, b, 5));
+
+  for (std::size_t gap : {1, 3, 4, 5, 127, 128, 129, 16383, 16384, 16385, 50000}) {
+    b = a;
+    b[0] ^= 0xff;
+    b[1 + gap] ^= 0xff;
+    b[1 + gap + gap] ^= 0xff;
+    EXPECT(RoundTrip(a, b, 32));
+  }
+}
+
+// Changed runs of every length across the varint boundaries, broken by
+// unchanged bytes too few to end them
+void TestLiterals() {
+  std::mt19937 rng(3);
+  const auto a = RandomBytes(70000, rng);
+
+  for (std::size_t length : {1, 2, 127, 128, 129, 16383, 16384, 16385, 69999}) {
+    auto b = a;
+    for (std::size_t i = 0; i < length; i++)
+      b[i] = static_cast<uint8_t>(~b[i]);
+    EXPECT(RoundTrip(a, b, length + 8));
+  }
+
+  auto b = a;
+  for (std::size_t i = 100; i < 60000; i += 1 + i % 4)
+    b[i] ^= 0x5a;
+  EXPECT(RoundTrip(a, b, 60000));
+}
+
+void TestRandom() {
+  std::mt19937 rng(4);
+  bool all_match = true;
+  for (int round = 0; round < 200; round++) {
+    const auto a = RandomBytes(rng() % 5000, rng);
+    auto b = a;
+    const std::size_t changes = a.empty() ? 0 : rng() % 64;
+    for (std::size_t i = 0; i < changes; i++)
+      b[rng() % b.size()] ^= static_cast<uint8_t>(1 + rng() % 255);
+    all_match &= RoundTrip(a, b, a.size() * 2 + 8);
+  }
+  EXPECT(all_match);
+}
+
+// A game that keeps counting up through its RAM, so every snapshot differs
+std::unique_ptr<VSmile> MakeMachine() {
+  auto cart = std::make_shared<VSmile::CartRomType>();
+  cart->fill(0);
+  (*cart)[0xfff7] = kProgram;  // reset vector
+  const word_t program[] = {
+      Alu(9, 1, 33, 0), 0x0100,   // r1 = 0x0100
+      // loop:
+      Alu(9, 2, 24, 1),           // r2 = [r1]
+      Imm6(0, 2, 1, 1),           // r2 += 1
+      Alu(13, 2, 26, 1),          // [r1++] = r2
+      Alu(11, 1, 33, 1), 0x07ff,  // r1 &= 0x07ff
+      Imm6(14, 7, 1, 6),          // jmp loop
+  };
+  std::copy(std::begin(program), std::end(program), cart->begin() + kProgram);
+
+  auto sys_rom = std::make_shared<VSmile::SysRomType>();
+  sys_rom->fill(0);
+  for (addr_t addr = 0xfffc0; addr < 0xfffdc; addr += 2)
+    (*sys_rom)[addr + 1] = 0x31;
+  auto vsmile = std::make_unique<VSmile>(std::move(sys_rom), std::move(cart),
+                                         VSmile::CartType::STANDARD, nullptr, 0xe, true,
+                                         VideoTiming::PAL);
+  vsmile->Reset();
+  return vsmile;
+}
+
+// Runs frames through the buffer and returns the state after each one
+std::vector<std::vector<uint8_t>> Run(RewindBuffer& rewind, VSmile& vsmile, int frames) {
+  std::vector<std::vector<uint8_t>> states(frames);
+  for (auto& state : states) {
+    rewind.RunFrame(vsmile);
+    vsmile.GetAudioBuffer().Clear();
+    vsmile.SaveState(state);
+  }
+  return states;
+}
+
+// Each step back lands on the state after the frame interval frames before,
+// until the oldest snapshot has been replayed
+void TestRewind() {
+  constexpr int kFrames = 21;
+  auto vsmile = MakeMachine();
+  RewindBuffer rewind(64 * 1024 * 1024, kInterval);
+  const auto states = Run(rewind, *vsmile, kFrames);
+
+  const RewindStats stats = rewind.GetStats();
+  EXPECT(stats.snapshots == 11);
+  EXPECT(stats.frames == kFrames);
+  EXPECT(stats.uncompressed_bytes == 11 * states[0].size());
+  EXPECT(stats.memory_bytes > states[0].size());
+  EXPECT(stats.memory_bytes < stats.uncompressed_bytes / 2);
+  EXPECT(states[kFrames - 1] != states[kFrames - 1 - kInterval]);
+
+  bool all_match = true;
+  std::vector<uint8_t> state;
+  for (int frame = kFrames - 1 - kInterval; frame >= 0; frame -= kInterval) {
+    all_match &= rewind.RewindFrame(*vsmile);
+    vsmile->GetAudioBuffer().Clear();
+    vsmile->SaveState(state);
+    all_match &= state == states[frame];
+    all_match &= rewind.GetStats().frames == static_cast<uint64_t>(frame) + 1;
+  }
+  EXPECT(all_match);
+  EXPECT(rewind.GetStats().snapshots == 1);
+
+  // Nothing left, and the machine stays at the oldest frame
+  EXPECT(!rewind.RewindFrame(*vsmile));
+  vsmile->SaveState(state);
+  EXPECT(state == states[0]);
+
+  // Running on from there records new history, with a snapshot after the
+  // second frame as the oldest one was taken before the first
+  const auto rerun = Run(rewind, *vsmile, 3);
+  EXPECT(rerun[0] == states[1]);
+  EXPECT(rewind.RewindFrame(*vsmile));
+  vsmile->SaveState(state);
+  EXPECT(state == states[2]);
+}
+
+// The oldest snapshots go to stay within the budget, and rewinding stops at
+// the oldest one kept
+void TestBudget() {
+  constexpr int kFrames = 201;
+  auto vsmile = MakeMachine();
+  std::vector<uint8_t> state;
+  vsmile->SaveState(state);
+  const std::size_t budget = state.size() + 16 * 1024;
+  RewindBuffer rewind(budget, kInterval);
+
+  bool within_budget = true;
+  std::vector<std::vector<uint8_t>> states;
+  for (int frame = 0; frame < kFrames; frame++) {
+    auto run = Run(rewind, *vsmile, 1);
+    states.push_back(std::move(run[0]));
+    within_budget &= rewind.GetStats().memory_bytes <= budget;
+  }
+  EXPECT(within_budget);
+
+  const RewindStats stats = rewind.GetStats();
+  EXPECT(stats.snapshots > 2);
+  EXPECT(stats.snapshots < (kFrames + 1) / kInterval);
+  EXPECT(stats.frames == (stats.snapshots - 1) * kInterval + 1);
+
+  bool all_match = true;
+  int frame = kFrames - 1;
+  for (std::size_t i = 1; i < stats.snapshots; i++) {
+    frame -= kInterval;
+    all_match &= rewind.RewindFrame(*vsmile);
+    vsmile->SaveState(state);
+    all_match &= state == states[frame];
+  }
+  EXPECT(all_match);
+  EXPECT(!rewind.RewindFrame(*vsmile));
+
+  rewind.Clear();
+  EXPECT(rewind.GetStats().snapshots == 0);
+  EXPECT(!rewind.RewindFrame(*vsmile));
+}
+}  // namespace
+
+int main() {
+  TestIdentical();
+  TestSparseChanges();
+  TestLiterals();
+  TestRandom();
+  TestRewind();
+  TestBudget();
+  return TestResult();
+}
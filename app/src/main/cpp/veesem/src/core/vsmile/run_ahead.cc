@@ -0,0 +1,16 @@
+#include "run_ahead.h"
+
+#include "vsmile.h"
+
+void RunAhead::Run(VSmile& vsmile, int frames) {
+  if (frames <= 0)
+    return;
+
+  vsmile.SaveState(state_);
+  vsmile.SetAudioMuted(true);
+  for (int i = 0; i < frames; i++)
+    vsmile.RunFrame();
+  vsmile.SetAudioMuted(false);
+  // The picture is not part of the state, so the one from ahead stays
+  vsmile.RestoreState(state_);
+}
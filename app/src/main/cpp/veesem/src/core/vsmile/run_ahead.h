@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class VSmile;
+
+// Cuts the delay between input and its result on screen. Games usually react
+// to the controller a frame or two late, and the joystick's serial link adds
+// more. After each frame, Run() carries on for a few frames with the same
+// input, keeps the last picture and goes back to where it was, so the picture
+// shown is always the given number of frames ahead of the machine.
+//
+// The frames run ahead are muted, so the audio only ever comes from frames
+// that were kept.
+class RunAhead {
+public:
+  // Call after each frame. Does nothing for 0 frames.
+  void Run(VSmile& vsmile, int frames);
+
+private:
+  std::vector<uint8_t> state_;
+};
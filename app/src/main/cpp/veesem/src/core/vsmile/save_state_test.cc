@@ -0,0 +1,210 @@
+// Runs a machine, saves, runs on; then loads the state back, into the same
+// machine and into a fresh one, and runs again. Every frame of the reruns must
+// show the same picture and play the same audio as the first run.
+
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "core/spg200/audio_ring_buffer.h"
+#include "core/testing.h"
+#include "vsmile.h"
+
+namespace {
+constexpr addr_t kProgram = 0x8000;
+constexpr addr_t kTilemapData = 0x9000;
+constexpr addr_t kTilemap = 0x1000;  // in RAM
+constexpr int kTilemapWords = 64 * 32;
+constexpr addr_t kTiles = 0x10000;
+constexpr addr_t kPcmWave = 0x20000;
+constexpr addr_t kAdpcmWave = 0x30000;
+constexpr int kWaveWords = 0x1000;
+
+constexpr int kFramesBeforeSave = 20;
+constexpr int kFramesAfterSave = 30;
+
+// Just the few instruction forms the test program needs
+class Assembler {
+public:
+  Assembler(VSmile::CartRomType& rom, addr_t addr) : rom_(rom), addr_(addr) {}
+
+  addr_t GetAddress() const { return addr_; }
+
+  // rd = imm
+  void LoadImmediate(int rd, word_t imm) { Emit(Alu(9, rd, 33, 0), imm); }
+  // rd = [addr]
+  void Load(int rd, word_t addr) { Emit(Alu(9, rd, 34, rd), addr); }
+  // [addr] = rd
+  void Store(int rd, word_t addr) { Emit(Alu(13, rd, 35, rd), addr); }
+  void Goto(addr_t addr) { Emit(0xfe80 | (addr >> 16), addr & 0xffff); }
+
+  void Write(word_t addr, word_t value) {
+    LoadImmediate(1, value);
+    Store(1, addr);
+  }
+
+private:
+  static word_t Alu(int op0, int rd, int op1n, int rs) {
+    return (op0 << 12) | (rd << 9) | (op1n << 3) | rs;
+  }
+
+  void Emit(word_t first, word_t second) {
+    rom_[addr_++] = first;
+    rom_[addr_++] = second;
+  }
+
+  VSmile::CartRomType& rom_;
+  addr_t addr_;
+};
+
+// A game that draws a 4bpp background and loops two samples, and
+// keeps changing its palette, scroll and volume to values from the random
+// number generators
+std::shared_ptr<const VSmile::CartRomType> MakeCart() {
+  auto cart = std::make_shared<VSmile::CartRomType>();
+  std::mt19937 rng(1);
+  for (auto& word : *cart)
+    word = rng();
+  for (addr_t addr = kTilemapData; addr < kTilemapData + kTilemapWords; addr++)
+    (*cart)[addr] &= 0x3ff;
+  // Keeps clear of the end of sample markers
+  for (addr_t addr = kPcmWave; addr < kPcmWave + kWaveWords; addr++)
+    (*cart)[addr] &= 0x7f7f;
+  for (addr_t addr = kAdpcmWave; addr < kAdpcmWave + kWaveWords; addr++)
+    (*cart)[addr] &= 0x7f7f;
+
+  (*cart)[0xfff7] = kProgram;  // reset vector
+
+  Assembler as(*cart, kProgram);
+  // Copies the tilemap to RAM
+  as.Write(0x3e00, kTilemapData & 0xffff);
+  as.Write(0x3e01, kTilemapData >> 16);
+  as.Write(0x3e03, kTilemap);
+  as.Write(0x3e02, kTilemapWords);
+
+  as.Write(0x2812, 0x0001);  // BG1 attribute: 4bpp, 8x8 tiles
+  as.Write(0x2813, 0x000a);  // BG1 control: enabled, attributes from register
+  as.Write(0x2814, kTilemap);
+  as.Write(0x2820, kTiles >> 6);
+
+  // Channel 0 loops 16 bit PCM, channel 1 ADPCM
+  const word_t pcm_hi = kPcmWave >> 16;
+  as.Write(0x3000, kPcmWave & 0xffff);
+  as.Write(0x3001, 0x6000 | (pcm_hi << 6) | pcm_hi);
+  as.Write(0x3002, kPcmWave & 0xffff);
+  as.Write(0x3003, 0x407f);
+  as.Write(0x3005, 0x007f);
+  as.Write(0x3204, 0x2000);
+  const word_t adpcm_hi = kAdpcmWave >> 16;
+  as.Write(0x3010, kAdpcmWave & 0xffff);
+  as.Write(0x3011, 0xa000 | (adpcm_hi << 6) | adpcm_hi);
+  as.Write(0x3012, kAdpcmWave & 0xffff);
+  as.Write(0x3013, 0x407f);
+  as.Write(0x3015, 0x007f);
+  as.Write(0x3214, 0x3000);
+  as.Write(0x3415, 0x0003);  // envelopes under software control
+  as.Write(0x3401, 0x007f);
+  as.Write(0x3400, 0x0003);
+
+  const addr_t loop = as.GetAddress();
+  for (word_t entry = 0; entry < 16; entry++) {
+    as.Load(1, 0x3d2c);
+    as.Store(1, 0x2b00 + entry);
+  }
+  as.Load(1, 0x3d2d);
+  as.Store(1, 0x2810);
+  as.Load(1, 0x3d2d);
+  as.Store(1, 0x2811);
+  as.Load(1, 0x3d2c);
+  as.Store(1, 0x3003);
+  as.Goto(loop);
+  return cart;
+}
+
+std::unique_ptr<VSmile> MakeMachine(std::shared_ptr<const VSmile::CartRomType> cart) {
+  auto sys_rom = std::make_shared<VSmile::SysRomType>();
+  sys_rom->fill(0);
+  for (addr_t addr = 0xfffc0; addr < 0xfffdc; addr += 2)
+    (*sys_rom)[addr + 1] = 0x31;
+  auto vsmile = std::make_unique<VSmile>(std::move(sys_rom), std::move(cart),
+                                         VSmile::CartType::STANDARD, nullptr, 0xe, true,
+                                         VideoTiming::PAL);
+  vsmile->Reset();
+  return vsmile;
+}
+
+struct Frame {
+  std::vector<uint8_t> picture;
+  std::vector<uint16_t> audio;
+
+  bool operator==(const Frame&) const = default;
+};
+
+std::vector<Frame> Run(VSmile& vsmile, int frames) {
+  std::vector<Frame> run;
+  for (int i = 0; i < frames; i++) {
+    vsmile.RunFrame();
+    Frame frame;
+    const auto picture = vsmile.GetPicture();
+    frame.picture.assign(picture.begin(), picture.end());
+    auto& audio = vsmile.GetAudioBuffer();
+    frame.audio.resize(audio.GetFillLevel() * 2);
+    frame.audio.resize(audio.Read(frame.audio.data(), frame.audio.size() / 2) * 2);
+    run.push_back(std::move(frame));
+  }
+  return run;
+}
+
+bool HasPicture(const std::vector<Frame>& run) {
+  for (const auto& frame : run) {
+    for (auto byte : frame.picture) {
+      if (byte != frame.picture[0])
+        return true;
+    }
+  }
+  return false;
+}
+
+bool HasAudio(const std::vector<Frame>& run) {
+  for (const auto& frame : run) {
+    for (auto sample : frame.audio) {
+      if (sample != frame.audio[0])
+        return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
+int main() {
+  const auto cart = MakeCart();
+  auto vsmile = MakeMachine(cart);
+  Run(*vsmile, kFramesBeforeSave);
+
+  std::vector<uint8_t> state;
+  vsmile->SaveState(state);
+  const auto expected = Run(*vsmile, kFramesAfterSave);
+  EXPECT(HasPicture(expected));
+  EXPECT(HasAudio(expected));
+
+  EXPECT(vsmile->LoadState(state));
+  std::vector<uint8_t> reloaded_state;
+  vsmile->SaveState(reloaded_state);
+  EXPECT(reloaded_state == state);
+  EXPECT(Run(*vsmile, kFramesAfterSave) == expected);
+
+  auto fresh = MakeMachine(cart);
+  EXPECT(fresh->LoadState(state));
+  EXPECT(Run(*fresh, kFramesAfterSave) == expected);
+
+  // A truncated state is refused and leaves the machine as it was
+  std::vector<uint8_t> before;
+  fresh->SaveState(before);
+  EXPECT(!fresh->LoadState(std::span(state).first(state.size() / 2)));
+  std::vector<uint8_t> after;
+  fresh->SaveState(after);
+  EXPECT(after == before);
+
+  return TestResult();
+}
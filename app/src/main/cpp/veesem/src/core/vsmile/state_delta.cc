@@ -0,0 +1,67 @@
+#include "state_delta.h"
+
+#include <cstring>
+
+namespace {
+// Shorter runs of unchanged bytes are cheaper to store as part of a literal
+constexpr std::size_t kMinZeroRun = 4;
+
+void PutVarint(std::vector<uint8_t>& out, std::size_t value) {
+  while (value >= 0x80) {
+    out.push_back(static_cast<uint8_t>(value | 0x80));
+    value >>= 7;
+  }
+  out.push_back(static_cast<uint8_t>(value));
+}
+
+std::size_t GetVarint(const uint8_t*& in) {
+  std::size_t value = 0;
+  int shift = 0;
+  uint8_t byte;
+  do {
+    byte = *in++;
+    value |= static_cast<std::size_t>(byte & 0x7f) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+  return value;
+}
+}  // namespace
+
+void EncodeStateDelta(std::span<const uint8_t> a, std::span<const uint8_t> b,
+                      std::vector<uint8_t>& out) {
+  const std::size_t size = a.size();
+  out.clear();
+
+  std::size_t pos = 0;
+  while (pos < size) {
+    const std::size_t zeros_start = pos;
+    while (pos + 8 <= size && std::memcmp(&a[pos], &b[pos], 8) == 0)
+      pos += 8;
+    while (pos < size && a[pos] == b[pos])
+      pos++;
+    PutVarint(out, pos - zeros_start);
+
+    const std::size_t literal_start = pos;
+    std::size_t zero_run = 0;
+    while (pos < size && zero_run < kMinZeroRun) {
+      zero_run = a[pos] == b[pos] ? zero_run + 1 : 0;
+      pos++;
+    }
+    pos -= zero_run;
+    PutVarint(out, pos - literal_start);
+    for (std::size_t i = literal_start; i < pos; i++)
+      out.push_back(a[i] ^ b[i]);
+  }
+}
+
+void ApplyStateDelta(std::span<const uint8_t> delta, std::span<uint8_t> data) {
+  const uint8_t* in = delta.data();
+  const uint8_t* const end = in + delta.size();
+  std::size_t pos = 0;
+  while (in < end) {
+    pos += GetVarint(in);
+    const std::size_t literal_size = GetVarint(in);
+    for (std::size_t i = 0; i < literal_size; i++)
+      data[pos++] ^= *in++;
+  }
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+// Compact difference between two save states of the same machine: the XOR of
+// both, as alternating runs of unchanged bytes, given by their length, and
+// changed bytes, given by their length and the XOR. Most of the machine does
+// not change from one snapshot to the next, so little is left.
+
+// Replaces out with the delta between a and b, which have the same size
+void EncodeStateDelta(std::span<const uint8_t> a, std::span<const uint8_t> b,
+                      std::vector<uint8_t>& out);
+// XORs a delta from EncodeStateDelta() onto data, turning either side into the
+// other
+void ApplyStateDelta(std::span<const uint8_t> delta, std::span<uint8_t> data);
@@ -1,5 +1,7 @@
 #include "vsmile.h"
 
+#include "core/state_serializer.h"
+
 /* V.Smile system ROM region codes:
  * 0x0/0x1: no V.Smile screen (1.02+)
  * 0x2: Italian (1.03), UK English without subtitle (1.02)
@@ -24,13 +26,33 @@
  * With a cartridge it will display the US English intro.
  */
 
-VSmile::VSmile(std::unique_ptr<SysRomType> sys_rom, std::unique_ptr<CartRomType> cart_rom,
-               CartType cart_type, std::unique_ptr<ArtNvramType> initial_art_nvram,
-               unsigned region_code, bool vtech_logo, VideoTiming video_timing)
+VSmile::VSmile(std::shared_ptr<const SysRomType> sys_rom,
+               std::shared_ptr<const CartRomType> cart_rom, CartType cart_type,
+               std::unique_ptr<ArtNvramType> initial_art_nvram, unsigned region_code,
+               bool vtech_logo, VideoTiming video_timing)
     : io_(std::move(sys_rom), std::move(cart_rom), cart_type, std::move(initial_art_nvram),
           region_code, vtech_logo, *this),
       spg200_(video_timing, io_),
-      joy_send_(*this, 0) {}
+      joy_send_(*this, 0),
+      video_timing_(video_timing) {}
+
+std::unique_ptr<VSmile> VSmile::Clone() {
+  std::unique_ptr<ArtNvramType> art_nvram;
+  if (io_.art_nvram_)
+    art_nvram = std::make_unique<ArtNvramType>(*io_.art_nvram_);
+
+  auto clone = std::make_unique<VSmile>(io_.sys_rom_, io_.cart_rom_, io_.cart_type_,
+                                        std::move(art_nvram), io_.region_code_, io_.vtech_logo_,
+                                        video_timing_);
+  clone->SetPixelFormat(pixel_format_);
+
+  // Reset first so that nothing a state leaves out is left uninitialized
+  std::vector<uint8_t> data;
+  SaveState(data);
+  clone->Reset();
+  clone->RestoreState(data);
+  return clone;
+}
 
 void VSmile::RunFrame() {
   spg200_.RunFrame();
@@ -56,22 +78,113 @@ void VSmile::Reset() {
   io_.restart_button_pressed_ = false;
 }
 
+void VSmile::SaveState(std::vector<uint8_t>& data) {
+  data.clear();
+  StateSerializer state(data);
+  Serialize(state);
+}
+
+bool VSmile::LoadState(std::span<const uint8_t> data) {
+  // A state can turn out to be bad halfway through, so keep the current one
+  // to go back to
+  std::vector<uint8_t> backup;
+  SaveState(backup);
+
+  StateSerializer state(data);
+  Serialize(state);
+  if (state.IsOk())
+    return true;
+
+  StateSerializer restore(std::span<const uint8_t>{backup});
+  Serialize(restore);
+  return false;
+}
+
+void VSmile::RestoreState(std::span<const uint8_t> data) {
+  StateSerializer state(data);
+  Serialize(state);
+}
+
+void VSmile::Serialize(StateSerializer& state) {
+  spg200_.Serialize(state);
+
+  if (!state.BeginChunk("VSIO", 1))
+    return;
+  state.Value(io_.rts_);
+  state.Value(io_.cts_);
+  state.Value(io_.on_button_pressed_);
+  state.Value(io_.off_button_pressed_);
+  state.Value(io_.restart_button_pressed_);
+  bool has_art_nvram = io_.art_nvram_ != nullptr;
+  state.Value(has_art_nvram);
+  state.Require(has_art_nvram == (io_.art_nvram_ != nullptr));
+  if (has_art_nvram && state.IsOk()) {
+    if (state.IsLoading()) {
+      // What was cached from the NVRAM only goes stale if it changed
+      auto art_nvram = std::make_unique_for_overwrite<ArtNvramType>();
+      state.Value(*art_nvram);
+      if (state.IsOk() && *art_nvram != *io_.art_nvram_) {
+        *io_.art_nvram_ = *art_nvram;
+        spg200_.InvalidateExternalMemoryCaches();
+      }
+    } else {
+      state.Value(*io_.art_nvram_);
+    }
+  }
+  state.EndChunk();
+
+  io_.joy_.Serialize(state);
+}
+
 std::span<uint8_t> VSmile::GetPicture() const {
   return spg200_.GetPicture();
 }
 
-std::span<uint16_t> VSmile::GetAudio() {
-  return spg200_.GetAudio();
+AudioRingBuffer& VSmile::GetAudioBuffer() {
+  return spg200_.GetAudioBuffer();
 }
 
 const VSmile::ArtNvramType* VSmile::GetArtNvram() {
   return io_.art_nvram_.get();
 }
 
+void VSmile::SetPixelFormat(PixelFormat pixel_format) {
+  pixel_format_ = pixel_format;
+  spg200_.SetPixelFormat(pixel_format);
+}
+
 void VSmile::SetPpuViewSettings(PpuViewSettings& ppu_view_settings) {
   spg200_.SetPpuViewSettings(ppu_view_settings);
 }
 
+TileCacheStats VSmile::GetTileCacheStats() const {
+  return spg200_.GetTileCacheStats();
+}
+
+WaveCacheStats VSmile::GetWaveCacheStats() const {
+  return spg200_.GetWaveCacheStats();
+}
+
+bool VSmile::StartStemCapture(const std::string& path_prefix) {
+  return spg200_.StartStemCapture(path_prefix);
+}
+
+void VSmile::StopStemCapture() {
+  spg200_.StopStemCapture();
+}
+
+bool VSmile::IsCapturingStems() const {
+  return spg200_.IsCapturingStems();
+}
+
+void VSmile::SetAudioMuted(bool muted) {
+  spg200_.SetAudioMuted(muted);
+}
+
+double VSmile::GetFrameRate() const {
+  return spg200_.GetFrameRate();
+}
+
 VSmile::JoyLedStatus VSmile::GetControllerLed() {
   return io_.joy_.GetLeds();
 }
@@ -92,9 +205,10 @@ void VSmile::UpdateRestartButton(bool pressed) {
   io_.restart_button_pressed_ = pressed;
 }
 
-VSmile::Io::Io(std::unique_ptr<SysRomType> sys_rom, std::unique_ptr<CartRomType> cart_rom,
-               CartType cart_type, std::unique_ptr<ArtNvramType> initial_art_nvram,
-               unsigned region_code, bool vtech_logo, VSmile& vsmile)
+VSmile::Io::Io(std::shared_ptr<const SysRomType> sys_rom,
+               std::shared_ptr<const CartRomType> cart_rom, CartType cart_type,
+               std::unique_ptr<ArtNvramType> initial_art_nvram, unsigned region_code,
+               bool vtech_logo, VSmile& vsmile)
     : region_code_(region_code & 0xf),
       vtech_logo_(vtech_logo),
       sys_rom_(std::move(sys_rom)),
@@ -113,6 +227,10 @@ void VSmile::Io::RunCycles(int cycles) {
   joy_.RunCycles(cycles);
 }
 
+int VSmile::Io::GetCyclesToNextEvent() {
+  return joy_.GetCyclesToNextEvent();
+}
+
 unsigned VSmile::Io::GetAdc0() {
   return 0x0;
 }
@@ -193,6 +311,44 @@ word_t VSmile::Io::ReadCsb3(addr_t addr) {
 
 void VSmile::Io::WriteCsb3(addr_t addr, word_t value) {}
 
+const word_t* VSmile::Io::GetRomCsbReadPtr(addr_t addr) {
+  return &(*cart_rom_)[addr];
+}
+
+word_t* VSmile::Io::GetRomCsbWritePtr(addr_t addr) {
+  return nullptr;
+}
+
+const word_t* VSmile::Io::GetCsb1ReadPtr(addr_t addr) {
+  return &(*cart_rom_)[addr + 0x100000];
+}
+
+word_t* VSmile::Io::GetCsb1WritePtr(addr_t addr) {
+  return nullptr;
+}
+
+const word_t* VSmile::Io::GetCsb2ReadPtr(addr_t addr) {
+  if (cart_type_ == CartType::ART_STUDIO) {
+    return &(*art_nvram_)[addr & 0x1ffff];
+  }
+  return &(*cart_rom_)[addr + 0x200000];
+}
+
+word_t* VSmile::Io::GetCsb2WritePtr(addr_t addr) {
+  if (cart_type_ == CartType::ART_STUDIO) {
+    return &(*art_nvram_)[addr & 0x1ffff];
+  }
+  return nullptr;
+}
+
+const word_t* VSmile::Io::GetCsb3ReadPtr(addr_t addr) {
+  return &(*sys_rom_)[addr];
+}
+
+word_t* VSmile::Io::GetCsb3WritePtr(addr_t addr) {
+  return nullptr;
+}
+
 void VSmile::Io::TxUart(uint8_t value) {
   if (cts_[0])
     joy_.Rx(value);
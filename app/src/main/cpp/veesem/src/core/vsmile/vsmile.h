@@ -1,5 +1,8 @@
 #pragma once
 
+#include <memory>
+#include <vector>
+
 #include "core/common.h"
 
 #include "core/spg200/settings.h"
@@ -10,6 +13,7 @@
 #include "vsmile_joy.h"
 
 class IoIrq;
+class StateSerializer;
 
 class VSmile {
 public:
@@ -25,19 +29,41 @@ public:
   using JoyInput = VSmileJoy::JoyInput;
   using JoyLedStatus = VSmileJoy::JoyLedStatus;
 
-  VSmile(std::unique_ptr<SysRomType> sys_rom, std::unique_ptr<CartRomType> cart_rom,
+  // The ROMs are only ever read, so machines made from the same files can share them
+  VSmile(std::shared_ptr<const SysRomType> sys_rom, std::shared_ptr<const CartRomType> cart_rom,
          CartType cart_type, std::unique_ptr<ArtNvramType> initial_art_nvram, unsigned region_code,
          bool vtech_logo, VideoTiming video_timing);
 
+  // Makes a new machine in the same state as this one, sharing its ROMs. The
+  // clone starts with an empty audio buffer, no stem capture and default PPU
+  // view settings; the pixel format is carried over.
+  std::unique_ptr<VSmile> Clone();
+
   void RunFrame();
   void Step();
   void Reset();
 
+  // A save state holds everything but the ROMs and host-side settings, and
+  // only loads into a machine with the same cartridge type.
+  void SaveState(std::vector<uint8_t>& data);
+  bool LoadState(std::span<const uint8_t> data);
+  // Loads a state this machine or one of its clones saved, which cannot fail,
+  // without the backup LoadState() keeps
+  void RestoreState(std::span<const uint8_t> data);
+
   std::span<uint8_t> GetPicture() const;
-  std::span<uint16_t> GetAudio();
+  AudioRingBuffer& GetAudioBuffer();
   const ArtNvramType* GetArtNvram();
 
+  void SetPixelFormat(PixelFormat pixel_format);
   void SetPpuViewSettings(PpuViewSettings& ppu_view_settings);
+  TileCacheStats GetTileCacheStats() const;
+  WaveCacheStats GetWaveCacheStats() const;
+  bool StartStemCapture(const std::string& path_prefix);
+  void StopStemCapture();
+  bool IsCapturingStems() const;
+  void SetAudioMuted(bool muted);
+  double GetFrameRate() const;
 
   void UpdateJoystick(const JoyInput& joy_input);
   JoyLedStatus GetControllerLed();
@@ -47,13 +73,16 @@ public:
   void UpdateRestartButton(bool pressed);
 
 private:
+  void Serialize(StateSerializer& state);
+
   class Io : public Spg200Io {
   public:
-    Io(std::unique_ptr<SysRomType> sys_rom, std::unique_ptr<CartRomType> cart_rom,
+    Io(std::shared_ptr<const SysRomType> sys_rom, std::shared_ptr<const CartRomType> cart_rom,
        CartType cart_type, std::unique_ptr<ArtNvramType> initial_art_nvram, unsigned region_code,
        bool vtech_logo, VSmile& vsmile);
 
     void RunCycles(int cycles) override;
+    int GetCyclesToNextEvent() override;
 
     unsigned GetAdc0() override;
     unsigned GetAdc1() override;
@@ -80,11 +109,20 @@ private:
     word_t ReadCsb3(addr_t addr) override;
     void WriteCsb3(addr_t addr, word_t value) override;
 
+    const word_t* GetRomCsbReadPtr(addr_t addr) override;
+    word_t* GetRomCsbWritePtr(addr_t addr) override;
+    const word_t* GetCsb1ReadPtr(addr_t addr) override;
+    word_t* GetCsb1WritePtr(addr_t addr) override;
+    const word_t* GetCsb2ReadPtr(addr_t addr) override;
+    word_t* GetCsb2WritePtr(addr_t addr) override;
+    const word_t* GetCsb3ReadPtr(addr_t addr) override;
+    word_t* GetCsb3WritePtr(addr_t addr) override;
+
     const unsigned region_code_;
     const bool vtech_logo_;
 
-    std::unique_ptr<SysRomType> sys_rom_;
-    std::unique_ptr<CartRomType> cart_rom_;
+    std::shared_ptr<const SysRomType> sys_rom_;
+    std::shared_ptr<const CartRomType> cart_rom_;
     CartType cart_type_ = CartType::STANDARD;
     std::unique_ptr<ArtNvramType> art_nvram_;
     VSmileJoy joy_;
@@ -111,4 +149,8 @@ private:
 
   Spg200 spg200_;
   JoySend joy_send_;
+
+  // Kept to construct clones with
+  const VideoTiming video_timing_;
+  PixelFormat pixel_format_ = PixelFormat::RGB555;
 };
@@ -3,6 +3,7 @@
 #include <algorithm>
 #include <cassert>
 
+#include "core/state_serializer.h"
 #include "vsmile_common.h"
 
 VSmileJoy::VSmileJoy(VSmileJoySend& joy_send) : joy_send_(joy_send) {}
@@ -29,6 +30,28 @@ void VSmileJoy::Reset() {
   led_status_.green = false;
 }
 
+void VSmileJoy::Serialize(StateSerializer& state) {
+  if (!state.BeginChunk("JOY ", 1))
+    return;
+  state.Value(current_);
+  state.Value(last_sent_);
+  idle_timer_.Serialize(state);
+  rts_timeout_timer_.Serialize(state);
+  tx_start_timer_.Serialize(state);
+  state.Value(tx_buffer_);
+  state.Value(tx_buffer_write_);
+  state.Value(tx_buffer_read_);
+  state.Value(probe_history_);
+  state.Value(cts_);
+  state.Value(rts_);
+  state.Value(tx_busy_);
+  state.Value(joy_active_);
+  state.Value(tx_starting_);
+  state.Value(current_updated_);
+  state.Value(led_status_);
+  state.EndChunk();
+}
+
 void VSmileJoy::RunCycles(int cycles) {
   if (!tx_busy_) {
     if (idle_timer_.Tick(cycles)) {
@@ -74,6 +97,20 @@ void VSmileJoy::RunCycles(int cycles) {
   }
 }
 
+int VSmileJoy::GetCyclesToNextEvent() const {
+  if (joy_active_ && current_updated_)
+    return 1;
+
+  int cycles = kNoEvent;
+  if (!tx_busy_)
+    cycles = std::min(cycles, idle_timer_.GetCyclesToTick());
+  if (tx_starting_)
+    cycles = std::min(cycles, tx_start_timer_.GetCyclesToTick());
+  if (!rts_ && !cts_ && !tx_starting_ && !tx_busy_)
+    cycles = std::min(cycles, rts_timeout_timer_.GetCyclesToTick());
+  return cycles;
+}
+
 void VSmileJoy::UpdateJoystick(const JoyInput& new_input) {
   current_ = new_input;
   current_updated_ = true;
@@ -145,8 +182,12 @@ void VSmileJoy::QueueJoyUpdates() {
                        current_.yellow != last_sent_.yellow || current_.red != last_sent_.red;
   bool update_joy = current_.x != last_sent_.x || current_.y != last_sent_.y;
 
-  if (!update_buttons && !update_colors && !update_joy)
+  if (!update_buttons && !update_colors && !update_joy) {
+    // Frontends update the input every frame, mostly with nothing new. Clearing
+    // the flag keeps GetCyclesToNextEvent() from asking to run every cycle.
+    current_updated_ = false;
     return;
+  }
 
   if (update_buttons) {
     uint8_t button_value = 0xa0;
@@ -4,12 +4,14 @@
 
 #include <array>
 
+class StateSerializer;
 class VSmileJoySend;
 
 class VSmileJoy {
 public:
   struct JoyInput {
     JoyInput() { red = yellow = blue = green = enter = back = help = abc = false; }
+    bool operator==(const JoyInput&) const = default;
 
     int y = 0;
     int x = 0;
@@ -33,7 +35,9 @@ public:
   explicit VSmileJoy(VSmileJoySend& joy_ctrl);
 
   void Reset();
+  void Serialize(StateSerializer& state);
   void RunCycles(int cycles);
+  int GetCyclesToNextEvent() const;
   void Rx(uint8_t value);
   void SetCts(bool value);
   void TxDone();
@@ -25,6 +25,8 @@ void PrintUsage(std::string exec_name) {
       << "  -region NUM       Set jumpers configuring system ROM region as hex number in range 0-f"
       << std::endl
       << "  -novtech          Set jumpers disabling VTech logo in system ROM intro" << std::endl
+      << "  -boot-cache DIR   Skip the intros at startup using machine states cached in DIR"
+      << std::endl
       << std::endl
       << "  -leds            Show controller LEDs at startup" << std::endl
       << "  -fps             Show emulation FPS at startup" << std::endl
@@ -50,6 +52,7 @@ int main(int argc, char** argv) {
   std::optional<std::string> sysrom_path;
   std::optional<std::string> cartrom_path;
   std::optional<std::string> art_nvram_path;
+  std::optional<std::string> boot_cache_path;
   unsigned region_code = 0xe;  // UK English as default
   const std::vector<std::string_view> args(argv + 1, argv + argc);
 
@@ -99,6 +102,12 @@ int main(int argc, char** argv) {
           std::cerr << "Error: Region code out of range (should be in range 0-f)" << std::endl;
           return EXIT_FAILURE;
         }
+      } else if (arg == "-boot-cache") {
+        if (argpos + 1 >= args.size()) {
+          std::cerr << "Error: Expected boot cache directory" << std::endl;
+          return EXIT_FAILURE;
+        }
+        boot_cache_path = args[++argpos];
       } else if (arg == "-novtech") {
         vtech_logo = false;
       } else if (arg == "-leds") {
@@ -123,5 +132,5 @@ int main(int argc, char** argv) {
   }
 
   return RunEmulation(sysrom_path, cartrom_path, cart_type, art_nvram_path, region_code, vtech_logo,
-                      video_timing, show_leds, show_fps);
+                      video_timing, boot_cache_path, show_leds, show_fps);
 }
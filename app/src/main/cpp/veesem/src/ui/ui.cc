@@ -2,6 +2,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <optional>
 #include <vector>
 
 #include <SDL.h>
@@ -10,6 +11,11 @@
 #include "imgui_impl_opengl2.h"
 #include "imgui_impl_sdl2.h"
 
+#include "core/spg200/rate_controller.h"
+#include "core/spg200/resampler.h"
+#include "core/vsmile/boot_cache.h"
+#include "core/vsmile/rewind_buffer.h"
+#include "core/vsmile/run_ahead.h"
 #include "core/vsmile/vsmile.h"
 #include "graphics_state.h"
 
@@ -21,6 +27,7 @@ static struct UiSettings {
   bool off_button = false;
   bool restart_button = false;
   bool frame_advance = false;
+  int run_ahead_frames = 0;
   bool show_leds = false;
   bool show_fps = false;
   bool bilinear = true;
@@ -30,14 +37,53 @@ static struct UiSettings {
   std::array<float, 281250 / 4> audio_samples_left;
   std::array<float, 281250 / 4> audio_samples_right;
   int audio_samples_offset = 0;
+  RateControlStats rate_control_stats;
 
   PpuViewSettings ppu_view_settings = {};
 } ui;
 
-static void SdlAudioCallback(void* audio_stream, unsigned char* output, int len) {
-  int written = SDL_AudioStreamGet(static_cast<SDL_AudioStream*>(audio_stream), output, len);
-  if (written < len)
-    SDL_memset(output + written, 0, len - written);
+// Owned by the SDL audio thread, which drains the SPU's buffer directly
+struct AudioOutput {
+  // Samples kept queued between the emulation and the audio device
+  static constexpr size_t kTargetLatency = Resampler::kInputRate / 20;  // 50 ms
+
+  AudioRingBuffer* input;
+  Resampler resampler{48000};
+  RateController rate_control{kTargetLatency};
+  std::vector<uint16_t> samples;
+};
+
+static void SdlAudioCallback(void* userdata, unsigned char* output, int len) {
+  auto& audio = *static_cast<AudioOutput*>(userdata);
+  const size_t frames = len / (2 * sizeof(int16_t));
+
+  // Far behind after fast forwarding or a stall: skip ahead instead of
+  // slowly catching up
+  size_t fill = audio.input->GetFillLevel();
+  if (fill > 4 * AudioOutput::kTargetLatency) {
+    audio.input->Consume(fill - AudioOutput::kTargetLatency);
+    fill = AudioOutput::kTargetLatency;
+  }
+  audio.resampler.SetRateAdjustment(audio.rate_control.Update(fill));
+  ui.rate_control_stats = audio.rate_control.GetStats();
+
+  audio.samples.resize(audio.resampler.GetInputFramesNeeded(frames) * 2);
+  const size_t read = audio.input->Read(audio.samples.data(), audio.samples.size() / 2);
+  audio.resampler.Push({audio.samples.data(), read * 2});
+
+  // The SPU output window reads these with the audio device locked
+  for (size_t i = 0; i < read * 2; i += 2) {
+    ui.audio_samples_left[ui.audio_samples_offset] = (audio.samples[i] - 32768);
+    ui.audio_samples_right[ui.audio_samples_offset] = (audio.samples[i + 1] - 32768);
+    ui.audio_samples_offset++;
+
+    if (ui.audio_samples_offset == std::size(ui.audio_samples_left))
+      ui.audio_samples_offset = 0;
+  }
+
+  const size_t written = audio.resampler.Read(reinterpret_cast<int16_t*>(output), frames);
+  if (written < frames)
+    SDL_memset(output + written * 2 * sizeof(int16_t), 0, len - written * 2 * sizeof(int16_t));
 }
 
 static VSmile::JoyInput ReadController(SDL_GameController* pad) {
@@ -145,7 +191,8 @@ static void DrawLeds(VSmile::JoyLedStatus leds, ImVec2 overlay_pos) {
   ImGui::PopStyleVar();
 }
 
-static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile) {
+static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile, const RewindBuffer& rewind,
+                    BootCache* boot_cache) {
   ImGuiIO& io = ImGui::GetIO();
   ui.frame_advance = false;
   if (SDL_GetMouseFocus() && !ui.fullscreen && ImGui::BeginMainMenuBar()) {
@@ -153,13 +200,25 @@ static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile) {
       ImGui::MenuItem("Run", "", &ui.run_emulation);
       ImGui::MenuItem("Unlock Framerate", "", &ui.unlock_framerate);
       ImGui::MenuItem("Frame Advance", "", &ui.frame_advance);
+      ImGui::SliderInt("Run Ahead", &ui.run_ahead_frames, 0, 4, "%d frames");
       if (ImGui::MenuItem("Hard Reset")) {
         vsmile.Reset();
+        if (boot_cache)
+          boot_cache->Cancel();
       }
       ImGui::Separator();
       ImGui::MenuItem("ON Button", "F1", &ui.on_button);
       ImGui::MenuItem("OFF Button", "F2", &ui.off_button);
       ImGui::MenuItem("RESTART Button", "F3", &ui.restart_button);
+      ImGui::Separator();
+      const RewindStats rewind_stats = rewind.GetStats();
+      ImGui::TextDisabled("Rewind (Backspace): %.1f s, %.2f MB, %.0fx compressed",
+                          rewind_stats.frames / vsmile.GetFrameRate(),
+                          rewind_stats.memory_bytes / (1024.0 * 1024.0),
+                          rewind_stats.memory_bytes
+                              ? static_cast<double>(rewind_stats.uncompressed_bytes) /
+                                    rewind_stats.memory_bytes
+                              : 0.0);
       ImGui::EndMenu();
     }
     if (ImGui::BeginMenu("View")) {
@@ -218,6 +277,11 @@ static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile) {
     if (updated) {
       vsmile.SetPpuViewSettings(ui.ppu_view_settings);
     }
+    ImGui::Separator();
+    const TileCacheStats tile_cache_stats = vsmile.GetTileCacheStats();
+    ImGui::Text("Tile cache: %llu hits, %llu misses",
+                static_cast<unsigned long long>(tile_cache_stats.hits),
+                static_cast<unsigned long long>(tile_cache_stats.misses));
     ImGui::End();
   }
 
@@ -226,6 +290,27 @@ static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile) {
     ImGui::Begin("SPU Output", &ui.show_spu_output_window);
     static int zoom = 1;
     ImGui::SliderInt("Zoom Level", &zoom, 1, 8);
+
+    SDL_LockAudio();
+    const RateControlStats& stats = ui.rate_control_stats;
+    const double ms_per_frame = 1000.0 / Resampler::kInputRate;
+    ImGui::Text("Buffered: %.1f ms (%.1f-%.1f ms), rate %+.3f%%",
+                stats.average_fill * ms_per_frame, stats.min_fill * ms_per_frame,
+                stats.max_fill * ms_per_frame, (stats.adjustment - 1.0) * 100);
+    ImGui::Text("Overruns: %llu frames, underruns: %llu",
+                static_cast<unsigned long long>(vsmile.GetAudioBuffer().GetOverruns()),
+                static_cast<unsigned long long>(vsmile.GetAudioBuffer().GetUnderruns()));
+    const WaveCacheStats wave_cache_stats = vsmile.GetWaveCacheStats();
+    ImGui::Text("Wave cache: %llu hits, %llu misses, %zu samples",
+                static_cast<unsigned long long>(wave_cache_stats.hits),
+                static_cast<unsigned long long>(wave_cache_stats.misses), wave_cache_stats.samples);
+    if (!vsmile.IsCapturingStems()) {
+      if (ImGui::Button("Capture Stems"))
+        vsmile.StartStemCapture("stems");
+    } else if (ImGui::Button("Stop Capture")) {
+      vsmile.StopStemCapture();
+    }
+
     auto region_avail = ImGui::GetContentRegionAvail();
     auto height =
         (region_avail.y - ImGui::GetStyle().ItemSpacing.y - ImGui::GetStyle().FramePadding.y) / 2;
@@ -236,6 +321,7 @@ static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile) {
     ImGui::PlotLines("##spu_right", std::data(ui.audio_samples_right),
                      std::size(ui.audio_samples_right), ui.audio_samples_offset, "Right Channel",
                      -(32768. / zoom), (32768. / zoom), ImVec2(region_avail.x, height));
+    SDL_UnlockAudio();
     ImGui::End();
   }
 
@@ -249,8 +335,8 @@ static void DrawGui(GraphicsState& graphics_state, VSmile& vsmile) {
 
 int RunEmulation(std::optional<std::string> sysrom_path, std::optional<std::string> cartrom_path,
                  VSmile::CartType cart_type, std::optional<std::string> art_nvram_path,
-                 unsigned region_code, bool vtech_logo, VideoTiming video_timing, bool show_leds,
-                 bool show_fps) {
+                 unsigned region_code, bool vtech_logo, VideoTiming video_timing,
+                 std::optional<std::string> boot_cache_path, bool show_leds, bool show_fps) {
   if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_GAMECONTROLLER) < 0) {
     std::cerr << "Unable to initialize SDL";
     return EXIT_FAILURE;
@@ -306,11 +392,26 @@ int RunEmulation(std::optional<std::string> sysrom_path, std::optional<std::stri
     }
   }
 
-  auto vsmile =
-      std::make_unique<VSmile>(std::move(sysrom), std::move(cartrom), cart_type,
-                               std::move(initial_art_nvram), region_code, vtech_logo, video_timing);
+  // Art Studio NVRAM is part of the state, so those boots are not cached
+  std::optional<BootCache::Key> boot_key;
+  if (boot_cache_path.has_value() && cart_type == VSmile::CartType::STANDARD) {
+    boot_key = BootCache::Key{BootCache::HashRoms(*sysrom, *cartrom), region_code, vtech_logo,
+                              video_timing};
+  }
+
+  auto vsmile = std::make_unique<VSmile>(std::move(sysrom), std::move(cartrom), cart_type,
+                                         std::move(initial_art_nvram), region_code, vtech_logo,
+                                         video_timing);
   vsmile->Reset();
 
+  std::optional<BootCache> boot_cache;
+  if (boot_key.has_value()) {
+    // Room for about 160 games
+    boot_cache.emplace(boot_cache_path.value(), 4 * 1024 * 1024);
+    if (boot_cache->Boot(boot_key.value(), *vsmile))
+      std::cout << "Boot state loaded from cache" << std::endl;
+  }
+
   GraphicsState graphics_state;
   graphics_state.Init(640, 480);
   ImguiInit(graphics_state);
@@ -322,11 +423,12 @@ int RunEmulation(std::optional<std::string> sysrom_path, std::optional<std::stri
     std::cout << "Controller found: " << SDL_GameControllerName(pad) << std::endl;
   };
 
-  SDL_AudioStream* audio_stream = SDL_NewAudioStream(AUDIO_U16, 2, 281250, AUDIO_S16, 2, 48000);
+  AudioOutput audio_output;
+  audio_output.input = &vsmile->GetAudioBuffer();
 
   SDL_AudioSpec audiospec;
   audiospec.callback = SdlAudioCallback;
-  audiospec.userdata = audio_stream;
+  audiospec.userdata = &audio_output;
   audiospec.freq = 48000;
   audiospec.format = AUDIO_S16;
   audiospec.channels = 2;
@@ -338,9 +440,19 @@ int RunEmulation(std::optional<std::string> sysrom_path, std::optional<std::stri
   SDL_Event e;
   bool quit = false;
 
+  const uint64_t frame_ticks =
+      static_cast<uint64_t>(SDL_GetPerformanceFrequency() / vsmile->GetFrameRate());
+  uint64_t next_frame = SDL_GetPerformanceCounter();
+
   ui.show_leds = show_leds;
   ui.show_fps = show_fps;
 
+  // Stepped through two frames at a time. How far back it goes depends on how
+  // much of its RAM the game rewrites: from ten seconds if all of it every
+  // frame to minutes if little (see rewind_buffer_benchmark.cc).
+  RewindBuffer rewind(4 * 1024 * 1024, 2);
+  RunAhead run_ahead;
+
   while (!quit) {
     while (SDL_PollEvent(&e) != 0) {
       ImGui_ImplSDL2_ProcessEvent(&e);
@@ -368,38 +480,37 @@ int RunEmulation(std::optional<std::string> sysrom_path, std::optional<std::stri
     ImGui_ImplSDL2_NewFrame();
     ImGui::NewFrame();
 
-    DrawGui(graphics_state, *vsmile);
+    DrawGui(graphics_state, *vsmile, rewind, boot_cache ? &*boot_cache : nullptr);
 
     bool fast_forward = ImGui::IsKeyDown(ImGuiKey_Tab) || ui.unlock_framerate;
 
     if (ui.run_emulation || ui.frame_advance) {
-      if (pad) {
-        vsmile->UpdateJoystick(ReadController(pad));
-      } else {
-        vsmile->UpdateJoystick(ReadControllerFromKeyboard());
-      }
-
-      vsmile->UpdateOnButton(ui.on_button || ImGui::IsKeyDown(ImGuiKey_F1));
-      vsmile->UpdateOffButton(ui.off_button || ImGui::IsKeyDown(ImGuiKey_F2));
-      vsmile->UpdateRestartButton(ui.restart_button || ImGui::IsKeyDown(ImGuiKey_F3));
+      const VSmile::JoyInput joy_input =
+          pad ? ReadController(pad) : ReadControllerFromKeyboard();
+      const bool on_button = ui.on_button || ImGui::IsKeyDown(ImGuiKey_F1);
+      const bool off_button = ui.off_button || ImGui::IsKeyDown(ImGuiKey_F2);
+      const bool restart_button = ui.restart_button || ImGui::IsKeyDown(ImGuiKey_F3);
+      vsmile->UpdateJoystick(joy_input);
+      vsmile->UpdateOnButton(on_button);
+      vsmile->UpdateOffButton(off_button);
+      vsmile->UpdateRestartButton(restart_button);
       ui.on_button = false;
       ui.off_button = false;
       ui.restart_button = false;
 
-      vsmile->RunFrame();
-
-      auto ab = vsmile->GetAudio();
-      SDL_AudioStreamPut(audio_stream, ab.data(), ab.size() * sizeof(uint16_t));
-
-      if (ui.show_spu_output_window) {
-        for (size_t i = 0; i < ab.size(); i += 2) {
-          ui.audio_samples_left[ui.audio_samples_offset] = (ab[i] - 32768);
-          ui.audio_samples_right[ui.audio_samples_offset] = (ab[i + 1] - 32768);
-          ui.audio_samples_offset++;
+      const bool rewinding = ImGui::IsKeyDown(ImGuiKey_Backspace);
+      if (boot_cache && (joy_input != VSmile::JoyInput{} || on_button || off_button ||
+                         restart_button || rewinding)) {
+        boot_cache->Cancel();
+      }
 
-          if (ui.audio_samples_offset == std::size(ui.audio_samples_left))
-            ui.audio_samples_offset = 0;
-        }
+      if (rewinding) {
+        rewind.RewindFrame(*vsmile);
+      } else {
+        rewind.RunFrame(*vsmile);
+        if (boot_cache && boot_cache->Update(*vsmile))
+          std::cout << "Boot state stored in cache" << std::endl;
+        run_ahead.Run(*vsmile, ui.run_ahead_frames);
       }
     }
 
@@ -410,13 +521,15 @@ int RunEmulation(std::optional<std::string> sysrom_path, std::optional<std::stri
     ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
     graphics_state.SwapWindow();
 
-    while (SDL_AudioStreamAvailable(audio_stream) > 0.1 * 48000 * sizeof(int16_t)) {
-      // TODO: better way to sync?
-      if (fast_forward) {
-        SDL_AudioStreamClear(audio_stream);
-      } else {
-        SDL_Delay(10);  // better way to sync????
-      }
+    // Frames are paced by the host clock. The audio callback absorbs the
+    // difference to the audio device's clock through rate control.
+    const uint64_t now = SDL_GetPerformanceCounter();
+    if (fast_forward || !ui.run_emulation || now > next_frame + frame_ticks) {
+      next_frame = now;
+    } else {
+      next_frame += frame_ticks;
+      if (next_frame > now)
+        SDL_Delay(static_cast<Uint32>((next_frame - now) * 1000 / SDL_GetPerformanceFrequency()));
     }
     if (!ui.run_emulation) {
       SDL_Delay(20);
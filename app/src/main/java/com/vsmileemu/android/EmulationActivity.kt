@@ -63,8 +63,9 @@ import com.vsmileemu.android.util.StorageHelper
 import kotlinx.coroutines.*
 import kotlinx.coroutines.flow.MutableStateFlow
 import kotlinx.coroutines.flow.StateFlow
+import java.io.File
 import java.nio.ByteBuffer
-import java.nio.ByteOrder
+import java.nio.ShortBuffer
 import kotlin.math.abs
 import kotlin.math.roundToInt
 
@@ -126,8 +127,8 @@ class EmulationActivity : ComponentActivity() {
     private var targetFrameTimeNanos = PAL_FRAME_TIME_NS
     private var audioFramesPerVideoFrame = PAL_AUDIO_FRAMES
     
-    // Audio resampler converts SPU output (281.25 kHz) to 48 kHz for AudioTrack
-    private val audioResampler = AudioResampler(targetFramesPerVideoFrame = PAL_AUDIO_FRAMES)
+    // Splits audio (resampled to 48 kHz by the native core) into AudioTrack writes
+    private val audioChunker = AudioChunker(targetFramesPerVideoFrame = PAL_AUDIO_FRAMES)
 
     private val _controllerLayout = MutableStateFlow(ColorButtonLayout.GRID)
     val controllerLayout: StateFlow<ColorButtonLayout> = _controllerLayout
@@ -243,6 +244,11 @@ class EmulationActivity : ComponentActivity() {
                 FileLogger.log("This will load native library: libvsmile_android.so")
                 
                 emulator = EmulatorCore()
+                emulator.setAudioOutput(AudioManager.SAMPLE_RATE)
+                if (audioManager.bufferFrames > 0) {
+                    // Keep the AudioTrack about half full
+                    emulator.setAudioLatency(audioManager.bufferFrames / 2)
+                }
                 
                 Log.d(TAG, "✓ EmulatorCore created successfully")
                 FileLogger.log("✓ EmulatorCore created successfully")
@@ -367,7 +373,7 @@ class EmulationActivity : ComponentActivity() {
         usePalTiming = usePal
         targetFrameTimeNanos = if (usePal) PAL_FRAME_TIME_NS else NTSC_FRAME_TIME_NS
         audioFramesPerVideoFrame = if (usePal) PAL_AUDIO_FRAMES else NTSC_AUDIO_FRAMES
-        audioResampler.updateTargetFramesPerVideoFrame(audioFramesPerVideoFrame)
+        audioChunker.updateTargetFramesPerVideoFrame(audioFramesPerVideoFrame)
         FileLogger.log("Timing configured: ${if (usePal) "PAL 50Hz" else "NTSC 60Hz"}")
         Log.i(TAG, "Timing configured: usePal=$usePal, targetFrameTime=$targetFrameTimeNanos ns, audioFrames=$audioFramesPerVideoFrame")
     }
@@ -599,7 +605,9 @@ class EmulationActivity : ComponentActivity() {
                 
                 val usePal = true
                 configureTiming(usePal)
-                audioResampler.reset()
+                audioChunker.reset()
+                
+                emulator.setBootCacheDir(File(cacheDir, "boot").path)
                 
                 val success = emulator.initialize(
                     sysrom = biosData,
@@ -617,6 +625,12 @@ class EmulationActivity : ComponentActivity() {
                 Log.i(TAG, "Emulator initialized successfully")
                 FileLogger.log("✓ Emulator initialized successfully")
                 
+                // Pace frames at the exact emulated rate rather than a rounded one
+                val frameRate = emulator.getFrameRate()
+                if (frameRate > 0.0) {
+                    targetFrameTimeNanos = (1_000_000_000.0 / frameRate).toLong()
+                }
+                
                 // Mark emulator as initialized
                 isEmulatorInitialized = true
                 
@@ -652,41 +666,11 @@ class EmulationActivity : ComponentActivity() {
     }
     
     private val reusableBitmap = Bitmap.createBitmap(320, 240, Bitmap.Config.RGB_565)
-    private val reusableBuffer = ByteBuffer.allocateDirect(320 * 240 * 2).order(ByteOrder.LITTLE_ENDIAN)
     
-    private fun convertFrameToBitmap(frameData: ByteArray): Bitmap {
-        // V.Smile PPU: RGB555+T → RGB565 conversion
-        // This is the performance bottleneck - optimize heavily!
-        
-        reusableBuffer.clear()
-        
-        // Unroll and optimize the conversion loop
-        var i = 0
-        while (i < frameData.size - 1) {
-            val low = frameData[i].toInt() and 0xFF
-            val high = frameData[i + 1].toInt() and 0xFF
-            val colorWord = (high shl 8) or low
-            
-            // Extract RGB555+T: [15:T][14-10:R][9-5:G][4-0:B]
-            // Target RGB565: [15-11:R][10-5:G][4-0:B]
-            val rgb565 = if ((colorWord and 0x8000) != 0) {
-                0  // Transparent = black
-            } else {
-                // Shift R from bits [14-10] to [15-11]
-                // Shift G from bits [9-5] to [10-5] (double it for 6-bit)
-                // B stays at [4-0]
-                val r5 = (colorWord shr 10) and 0x1F
-                val g5 = (colorWord shr 5) and 0x1F
-                val b5 = colorWord and 0x1F
-                (r5 shl 11) or ((g5 shl 1) shl 5) or b5
-            }
-            
-            reusableBuffer.putShort(rgb565.toShort())
-            i += 2
-        }
-        
-        reusableBuffer.rewind()
-        reusableBitmap.copyPixelsFromBuffer(reusableBuffer)
+    private fun convertFrameToBitmap(frameData: ByteBuffer): Bitmap {
+        // The native PPU already outputs RGB565 in bitmap byte order
+        frameData.rewind()
+        reusableBitmap.copyPixelsFromBuffer(frameData)
         return reusableBitmap
     }
     
@@ -706,9 +690,12 @@ class EmulationActivity : ComponentActivity() {
         FileLogger.log("isRunning = $isRunning")
         FileLogger.log("Launching coroutine...")
         
+        // Frames run and are paced on a native thread; this loop only picks up
+        // its output
+        emulator.startEmulation()
+        
         emulationJob = lifecycleScope.launch(Dispatchers.Default) {
-            var frameNumber = 0
-            var lastFrameTime = System.nanoTime()
+            var polls = 0
             
             Log.e(TAG, "✓✓✓ Inside emulation coroutine! Loop starting...")
             FileLogger.log("✓✓✓ Inside emulation coroutine!")
@@ -717,58 +704,33 @@ class EmulationActivity : ComponentActivity() {
             FileLogger.log("Starting while loop...")
             
             while (isActive && isRunning) {
-                val frameStartTime = System.nanoTime()
-                
                 try {
-                    if (frameNumber < 3) {
-                        Log.e(TAG, ">>> FRAME $frameNumber starting...")
-                        FileLogger.log("Frame $frameNumber: calling emulator.runFrame()")
-                    }
-                    
-                    // Run one frame of emulation
-                    emulator.runFrame()
+                    // Audio produced since the last poll, already resampled for playback
+                    val audioFrames = emulator.pollAudio(audioManager.getQueuedFrames())
                     
-                    if (frameNumber < 3) {
-                        FileLogger.log("Frame $frameNumber: runFrame() returned")
-                    }
-                    
-                    // Get audio samples and resample for playback
-                    val rawAudioSamples = emulator.getAudioSamples()
-
-                    if (_audioEnabled.value && rawAudioSamples != null && rawAudioSamples.isNotEmpty()) {
-                        val processedAudio = audioResampler.resample(rawAudioSamples)
-
-                        if (frameNumber < 5) {
-                            val min = rawAudioSamples.minOrNull() ?: 0
-                            val max = rawAudioSamples.maxOrNull() ?: 0
-                            val avg = rawAudioSamples.average()
-                            Log.d(TAG, "Frame $frameNumber audio raw: size=${rawAudioSamples.size}, min=$min, max=$max, avg=${"%.1f".format(avg)}")
-                            FileLogger.log("Frame $frameNumber audio raw: size=${rawAudioSamples.size}, min=$min, max=$max, avg=${"%.1f".format(avg)}")
-
-                            val minRes = processedAudio.minOrNull() ?: 0
-                            val maxRes = processedAudio.maxOrNull() ?: 0
-                            val avgRes = processedAudio.average()
-                            Log.d(TAG, "Frame $frameNumber audio resampled: size=${processedAudio.size}, min=$minRes, max=$maxRes, avg=${"%.1f".format(avgRes)}")
-                            FileLogger.log("Frame $frameNumber audio resampled: size=${processedAudio.size}, min=$minRes, max=$maxRes, avg=${"%.1f".format(avgRes)}")
+                    if (_audioEnabled.value && audioFrames > 0) {
+                        val audioSamples = emulator.audioBuffer
+                        audioSamples.clear()
+                        audioSamples.limit(audioFrames * 2)
+                        
+                        if (polls < 5) {
+                            Log.d(TAG, "Poll $polls audio: $audioFrames frames")
+                            FileLogger.log("Poll $polls audio: $audioFrames frames")
                         }
 
-                        val chunks = audioResampler.produceChunks(processedAudio)
+                        val chunks = audioChunker.produceChunks(audioSamples)
                         for (chunk in chunks) {
                             audioManager.writeSamples(chunk)
                         }
                     }
                     
-                    // Get frame buffer
-                    val frameData = emulator.getFrameBuffer()
+                    // Newest picture, if a frame finished since the last poll
+                    val frameNumber = emulator.pollFrame()
                     
-                    if (frameNumber < 3) {
-                        FileLogger.log("Frame $frameNumber: got ${frameData?.size ?: 0} bytes of frame data")
-                    }
-                    
-                    if (frameData != null && frameData.size >= 320 * 240 * 2) {
+                    if (frameNumber >= 0) {
                         // Convert to bitmap and update UI (wrap in FrameData to force StateFlow update)
-                        val bitmap = convertFrameToBitmap(frameData)
-                        _currentFrame.value = FrameData(bitmap, frameNumber.toLong())
+                        val bitmap = convertFrameToBitmap(emulator.videoBuffer)
+                        _currentFrame.value = FrameData(bitmap, frameNumber)
                         
                         if (frameNumber < 3) {
                             Log.d(TAG, "Frame $frameNumber: bitmap size=${bitmap.width}x${bitmap.height}")
@@ -783,32 +745,27 @@ class EmulationActivity : ComponentActivity() {
                             _currentFps.value = fps
                             Log.e(TAG, "✓✓✓ FPS: ${"%.1f".format(fps)} ✓✓✓")
                             FileLogger.log("FPS: ${"%.1f".format(fps)}")
+                            emulator.getAudioStats()?.let { stats ->
+                                val audioStats = "Audio: rate ${"%+.3f".format((stats[0] - 1.0) * 100)}%, " +
+                                    "queued avg ${stats[1].toInt()} (${stats[2].toInt()}-${stats[3].toInt()}), " +
+                                    "empty ${stats[5].toInt()}/${stats[4].toInt()}"
+                                Log.d(TAG, audioStats)
+                                FileLogger.log(audioStats)
+                            }
                             frameCount = 0
                             lastFpsTime = now
                         }
-                    } else {
-                        Log.e(TAG, "Invalid frame data: ${frameData?.size ?: 0} bytes")
-                        if (frameNumber < 10) {
-                            FileLogger.log("Frame $frameNumber: INVALID frame data!")
-                        }
                     }
                     
-                    frameNumber++
-                    
-                    // Frame limiter: Sleep for remaining time to hit 60 FPS
-                    val frameEndTime = System.nanoTime()
-                    val frameTime = frameEndTime - frameStartTime
-                    val targetFrameTime = targetFrameTimeNanos
-                    val sleepTimeMs = (targetFrameTime - frameTime) / 1_000_000 // Convert to milliseconds
-                    if (sleepTimeMs > 0) {
-                        delay(sleepTimeMs)
-                    }
+                    polls++
                     
-                    lastFrameTime = frameEndTime
+                    // Poll a few times per frame so that pictures are picked
+                    // up soon after they are done
+                    delay((targetFrameTimeNanos / 4 / 1_000_000).coerceAtLeast(1))
                     
                 } catch (e: Exception) {
-                    Log.e(TAG, "Error in emulation loop at frame $frameNumber", e)
-                    FileLogger.logError("✗✗✗ CRASH IN EMULATION LOOP at frame $frameNumber", e)
+                    Log.e(TAG, "Error in emulation loop at poll $polls", e)
+                    FileLogger.logError("✗✗✗ CRASH IN EMULATION LOOP at poll $polls", e)
                     throw e
                 }
             }
@@ -821,6 +778,9 @@ class EmulationActivity : ComponentActivity() {
         super.onPause()
         isRunning = false
         emulationJob?.cancel()
+        if (::emulator.isInitialized) {
+            emulator.stopEmulation()
+        }
         audioManager.stop()
         FileLogger.log("EmulationActivity paused - emulation and audio stopped")
     }
@@ -1186,45 +1146,17 @@ fun InGameSettingsScreen(
     }
 }
 
-private class AudioResampler(
-    private val inputSampleRate: Int = 281_250,
-    private val outputSampleRate: Int = 48_000,
+private class AudioChunker(
     private var targetFramesPerVideoFrame: Int = 800  // 48kHz / 60fps
 ) {
     private var leftover = ShortArray(0)
 
-    fun resample(input: ShortArray): ShortArray {
-        if (input.isEmpty()) return ShortArray(0)
-        val framesIn = input.size / 2
-        if (framesIn <= 0) return ShortArray(0)
-
-        val framesOut = ((framesIn.toLong() * outputSampleRate + inputSampleRate / 2) / inputSampleRate)
-            .toInt()
-            .coerceAtLeast(1)
-        val output = ShortArray(framesOut * 2)
+    fun produceChunks(resampled: ShortBuffer): List<ShortArray> {
+        if (!resampled.hasRemaining()) return emptyList()
 
-        val step = inputSampleRate.toDouble() / outputSampleRate.toDouble()
-        var position = 0.0
-        var outIndex = 0
-        for (frame in 0 until framesOut) {
-            val index = position.toInt().coerceIn(0, framesIn - 1)
-            val frac = position - index
-            val nextIndex = if (index + 1 < framesIn) index + 1 else index
-            val base = index * 2
-            val nextBase = nextIndex * 2
-            output[outIndex++] = interpolate(input[base], input[nextBase], frac)
-            output[outIndex++] = interpolate(input[base + 1], input[nextBase + 1], frac)
-            position += step
-        }
-        return output
-    }
-
-    fun produceChunks(resampled: ShortArray): List<ShortArray> {
-        if (resampled.isEmpty()) return emptyList()
-
-        val combined = ShortArray(leftover.size + resampled.size)
+        val combined = ShortArray(leftover.size + resampled.remaining())
         leftover.copyInto(combined, 0, 0, leftover.size)
-        resampled.copyInto(combined, leftover.size, 0, resampled.size)
+        resampled.get(combined, leftover.size, resampled.remaining())
 
         val chunks = mutableListOf<ShortArray>()
         var offset = 0
@@ -1252,13 +1184,4 @@ private class AudioResampler(
     fun reset() {
         leftover = ShortArray(0)
     }
-
-    private fun interpolate(a: Short, b: Short, fraction: Double): Short {
-        if (fraction <= 0.0) return a
-        if (fraction >= 1.0) return b
-        val aInt = a.toInt()
-        val bInt = b.toInt()
-        val value = aInt + (bInt - aInt) * fraction
-        return value.roundToInt().coerceIn(-32768, 32767).toShort()
-    }
 }
@@ -9,6 +9,7 @@ import kotlinx.coroutines.Dispatchers
 import kotlinx.coroutines.Job
 import kotlinx.coroutines.channels.Channel
 import kotlinx.coroutines.launch
+import java.util.concurrent.atomic.AtomicLong
 
 /**
  * Manages audio playback for the emulator with non-blocking writes
@@ -16,7 +17,7 @@ import kotlinx.coroutines.launch
 class AudioManager {
     companion object {
         private const val TAG = "AudioManager"
-        private const val SAMPLE_RATE = 48000 // Output sample rate after resampling
+        const val SAMPLE_RATE = 48000 // Output sample rate after resampling
         private const val CHANNEL_CONFIG = AudioFormat.CHANNEL_OUT_STEREO
         private const val AUDIO_FORMAT = AudioFormat.ENCODING_PCM_16BIT
     }
@@ -28,6 +29,17 @@ class AudioManager {
     private var audioJob: Job? = null
     private var droppedSamples = 0
     
+    // Frames handed to writeSamples() and the playback position when playback
+    // started, to tell how much audio is still queued
+    private val submittedFrames = AtomicLong(0)
+    private var startHeadPosition = 0L
+    
+    /**
+     * Size of the AudioTrack buffer in frames
+     */
+    var bufferFrames = 0
+        private set
+    
     /**
      * Initialize the audio system
      */
@@ -40,6 +52,7 @@ class AudioManager {
             )
             
             val bufferSize = minBufferSize * 4
+            bufferFrames = bufferSize / 4  // 16-bit stereo
             
             Log.i(TAG, "Audio buffer config: minSize=$minBufferSize, using=${bufferSize}")
             
@@ -81,6 +94,8 @@ class AudioManager {
                     }
                     
                     track.play()
+                    submittedFrames.set(0)
+                    startHeadPosition = track.playbackHeadPosition.toLong() and 0xffffffffL
                     isPlaying = true
                     Log.i(TAG, "Audio playback started")
                     
@@ -139,7 +154,9 @@ class AudioManager {
             if (isPlaying && samples.isNotEmpty()) {
                 // Non-blocking write - if queue is full, skip this batch
                 val result = audioQueue.trySend(samples)
-                if (result.isFailure) {
+                if (result.isSuccess) {
+                    submittedFrames.addAndGet(samples.size / 2L)
+                } else {
                     droppedSamples++
                     if (droppedSamples % 100 == 0) {
                         Log.w(TAG, "Audio queue full, dropped $droppedSamples sample batches")
@@ -151,6 +168,17 @@ class AudioManager {
         }
     }
     
+    /**
+     * Number of frames written but not yet played, both in the queue and in
+     * the AudioTrack buffer, or -1 when not playing
+     */
+    fun getQueuedFrames(): Int {
+        val track = audioTrack ?: return -1
+        if (!isPlaying) return -1
+        val played = (track.playbackHeadPosition.toLong() and 0xffffffffL) - startHeadPosition
+        return (submittedFrames.get() - played).coerceIn(0L, Int.MAX_VALUE.toLong()).toInt()
+    }
+    
     /**
      * Release audio resources
      */
@@ -1,6 +1,18 @@
 package com.vsmileemu.android.core
 
 import android.util.Log
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.ShortBuffer
+
+/**
+ * Filter length used when resampling SPU output to the host rate
+ */
+enum class AudioQuality {
+    LOW,
+    MEDIUM,
+    HIGH
+}
 
 /**
  * Native wrapper for the VSmile emulator core
@@ -9,6 +21,10 @@ class EmulatorCore {
     
     companion object {
         private const val TAG = "EmulatorCore"
+        private const val VIDEO_BYTES = 320 * 240 * 2
+        // Several frames' worth at 48 kHz; audio that does not fit waits for
+        // the next frame
+        private const val AUDIO_BUFFER_FRAMES = 8192
         private var libraryLoaded = false
         private var libraryError: Throwable? = null
         
@@ -37,6 +53,23 @@ class EmulatorCore {
     
     private var initialized = false
     
+    private val audioByteBuffer: ByteBuffer =
+        ByteBuffer.allocateDirect(AUDIO_BUFFER_FRAMES * 4).order(ByteOrder.nativeOrder())
+    
+    /**
+     * The picture of the last [runFrame], 320x240 RGB565 in bitmap byte order.
+     * Written by native code; read it between frames only.
+     */
+    val videoBuffer: ByteBuffer =
+        ByteBuffer.allocateDirect(VIDEO_BYTES).order(ByteOrder.LITTLE_ENDIAN)
+    
+    /**
+     * Audio of the last [runFrame], signed 16-bit stereo at the rate set with
+     * [setAudioOutput]. Its first 2 * (return value of runFrame) samples are
+     * valid.
+     */
+    val audioBuffer: ShortBuffer = audioByteBuffer.asShortBuffer()
+    
     /**
      * Initialize the emulator with ROM data
      * @param sysrom System ROM (2MB), null to use dummy ROM
@@ -54,7 +87,11 @@ class EmulatorCore {
             return true
         }
         
-        val result = nativeInit(sysrom, cartrom, cartrom.size, usePAL)
+        var result = nativeInit(sysrom, cartrom, cartrom.size, usePAL)
+        if (result && !nativeSetFrameBuffers(videoBuffer, audioByteBuffer)) {
+            nativeDestroy()
+            result = false
+        }
         initialized = result
         
         if (result) {
@@ -67,18 +104,61 @@ class EmulatorCore {
     }
     
     /**
-     * Run one frame of emulation
+     * Run one frame of emulation, leaving its picture in [videoBuffer] and its
+     * audio in [audioBuffer]
+     * @param queuedFrames Frames still waiting to be played by the audio output,
+     * used to steer latency toward [setAudioLatency]; -1 if unknown
+     * @return Number of stereo frames written to [audioBuffer]
      */
-    fun runFrame() {
+    fun runFrame(queuedFrames: Int = -1): Int {
         if (!initialized) {
             Log.w(TAG, "Cannot run frame: emulator not initialized")
-            return
+            return 0
         }
-        nativeRunFrame()
+        return nativeRunFrame(queuedFrames)
+    }
+    
+    /**
+     * Start running frames on a native thread, paced to the emulated frame
+     * rate. Use [pollFrame] and [pollAudio] for its output; [runFrame] is not
+     * available until [stopEmulation].
+     */
+    fun startEmulation() {
+        if (!initialized) return
+        nativeStartEmulation()
     }
     
     /**
-     * Get the current video frame buffer (320x240x2 bytes, RGB565)
+     * Stop the native emulation thread after the frame in progress
+     */
+    fun stopEmulation() {
+        if (!initialized) return
+        nativeStopEmulation()
+    }
+    
+    /**
+     * Copy the newest picture from the emulation thread into [videoBuffer]
+     * @return Number of that frame, or -1 if none finished since the last call
+     */
+    fun pollFrame(): Long {
+        if (!initialized) return -1
+        return nativePollFrame()
+    }
+    
+    /**
+     * Write the audio produced since the last call into [audioBuffer]
+     * @param queuedFrames Frames still waiting to be played by the audio output,
+     * used to steer latency toward [setAudioLatency]; -1 if unknown
+     * @return Number of stereo frames written to [audioBuffer]
+     */
+    fun pollAudio(queuedFrames: Int = -1): Int {
+        if (!initialized) return 0
+        return nativePollAudio(queuedFrames)
+    }
+    
+    /**
+     * Get a copy of the current video frame buffer (320x240x2 bytes, RGB565).
+     * [videoBuffer] holds the same data without allocating.
      * @return Frame buffer as ByteArray, or null if not initialized
      */
     fun getFrameBuffer(): ByteArray? {
@@ -87,12 +167,129 @@ class EmulatorCore {
     }
     
     /**
-     * Get audio samples for the current frame (stereo 16-bit)
+     * Get audio samples not yet written to [audioBuffer] (stereo 16-bit,
+     * resampled to the rate set with [setAudioOutput], 48 kHz by default)
+     * @param queuedFrames Frames still waiting to be played by the audio output,
+     * used to steer latency toward [setAudioLatency]; -1 if unknown
      * @return Audio samples as ShortArray, or null if not initialized
      */
-    fun getAudioSamples(): ShortArray? {
+    fun getAudioSamples(queuedFrames: Int = -1): ShortArray? {
+        if (!initialized) return null
+        return nativeGetAudioSamples(queuedFrames)
+    }
+    
+    /**
+     * Set the sample rate and resampling quality of the audio from [runFrame]
+     */
+    fun setAudioOutput(sampleRate: Int, quality: AudioQuality = AudioQuality.MEDIUM) {
+        nativeSetAudioOutput(sampleRate, quality.ordinal)
+    }
+    
+    /**
+     * Set how many frames [runFrame] tries to keep queued for playback.
+     * The output rate is nudged by up to 0.5% to hold the queue at this level.
+     */
+    fun setAudioLatency(targetFrames: Int) {
+        nativeSetAudioLatency(targetFrames)
+    }
+    
+    /**
+     * Get audio pacing statistics since the previous call
+     * @return [rate adjustment, average queued frames, min queued, max queued,
+     * updates, updates with nothing queued]
+     */
+    fun getAudioStats(): DoubleArray? {
+        return nativeGetAudioStats()
+    }
+    
+    /**
+     * Get the emulated frame rate in Hz (about 50.08 for PAL, 60.05 for NTSC)
+     * @return Frame rate, or 0 if not initialized
+     */
+    fun getFrameRate(): Double {
+        if (!initialized) return 0.0
+        return nativeGetFrameRate()
+    }
+    
+    /**
+     * Record every sound channel and the final mix to WAV files, for
+     * debugging audio or extracting sounds
+     * @param pathPrefix Files are named <pathPrefix>_ch00.wav to _ch15.wav,
+     * <pathPrefix>_mix.wav and <pathPrefix>_index.txt
+     * @return true if capture started
+     */
+    fun startStemCapture(pathPrefix: String): Boolean {
+        if (!initialized) return false
+        return nativeStartStemCapture(pathPrefix)
+    }
+    
+    /**
+     * Stop recording and finish the files started by [startStemCapture]
+     */
+    fun stopStemCapture() {
+        if (!initialized) return
+        nativeStopStemCapture()
+    }
+    
+    /**
+     * Step back through recent play instead of running forward, for as long
+     * as this is on; from the last ten seconds to several minutes, depending
+     * on how much the game changes. Play resumes from where rewinding
+     * stopped.
+     */
+    fun setRewinding(rewinding: Boolean) {
+        if (!initialized) return
+        nativeSetRewinding(rewinding)
+    }
+    
+    /**
+     * Show the picture a number of frames ahead of the emulation, which hides
+     * that much of the delay before games react to input. Every frame ahead
+     * costs about as much CPU time as a normal frame; sound is unaffected.
+     * @param frames 0 to turn run-ahead off
+     */
+    fun setRunAheadFrames(frames: Int) {
+        nativeSetRunAheadFrames(frames)
+    }
+    
+    /**
+     * Cache machine states from after the intros in a directory, so that
+     * [initialize] boots straight to the game the next time. The first boot of
+     * a game plays as usual and is stored once past the intros, unless there
+     * was input before then. Call before [initialize].
+     * @param directory Cache directory, created if needed; null to boot normally
+     */
+    fun setBootCacheDir(directory: String?) {
+        nativeSetBootCacheDir(directory)
+    }
+    
+    /**
+     * Get how much history there is to rewind through
+     * @return Array of [seconds, memory used in bytes, compression ratio,
+     * snapshots], or null if not initialized
+     */
+    fun getRewindStats(): DoubleArray? {
+        if (!initialized) return null
+        return nativeGetRewindStats()
+    }
+    
+    /**
+     * Save the whole emulated machine, to be restored by [loadState]. States
+     * do not include the ROMs and only load with the same game.
+     * @return State data, or null if not initialized
+     */
+    fun saveState(): ByteArray? {
         if (!initialized) return null
-        return nativeGetAudioSamples()
+        return nativeSaveState()
+    }
+    
+    /**
+     * Restore a state made by [saveState]
+     * @return true if loaded; otherwise the emulator is left as it was
+     */
+    fun loadState(stateData: ByteArray): Boolean {
+        if (!initialized) return false
+        return nativeLoadState(stateData)
     }
     
     /**
@@ -140,9 +337,26 @@ class EmulatorCore {
         usePAL: Boolean
     ): Boolean
     
-    private external fun nativeRunFrame()
+    private external fun nativeSetFrameBuffers(video: ByteBuffer?, audio: ByteBuffer?): Boolean
+    private external fun nativeRunFrame(queuedFrames: Int): Int
+    private external fun nativeStartEmulation()
+    private external fun nativeStopEmulation()
+    private external fun nativePollFrame(): Long
+    private external fun nativePollAudio(queuedFrames: Int): Int
     private external fun nativeGetFrameBuffer(): ByteArray?
-    private external fun nativeGetAudioSamples(): ShortArray?
+    private external fun nativeGetAudioSamples(queuedFrames: Int): ShortArray?
+    private external fun nativeSetAudioOutput(sampleRate: Int, quality: Int)
+    private external fun nativeSetAudioLatency(targetFrames: Int)
+    private external fun nativeGetAudioStats(): DoubleArray?
+    private external fun nativeGetFrameRate(): Double
+    private external fun nativeStartStemCapture(pathPrefix: String): Boolean
+    private external fun nativeStopStemCapture()
+    private external fun nativeSetRewinding(rewinding: Boolean)
+    private external fun nativeSetRunAheadFrames(frames: Int)
+    private external fun nativeSetBootCacheDir(directory: String?)
+    private external fun nativeGetRewindStats(): DoubleArray?
+    private external fun nativeSaveState(): ByteArray?
+    private external fun nativeLoadState(stateData: ByteArray): Boolean
     private external fun nativeSendInput(
         enter: Boolean,
         help: Boolean,